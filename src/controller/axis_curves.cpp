@@ -0,0 +1,104 @@
+#include "axis_curves.hpp"
+#include <math.h>
+#if AXIS_CURVES_SSE2
+#include <emmintrin.h>
+#endif
+
+// Keeps dt/(smoothing + dt) defined for back to back updates without smoothing
+static constexpr float DT_EPSILON_MS = 1e-3f;
+static constexpr float MAX_SMOOTHING_MS = 1000.0f;
+
+AxisCurves::AxisCurves()
+:   custom_axes(0), is_settling(false)
+{
+    for (size_t i = 0; i < TOTAL_AXES; i++) {
+        set_params(i, Params{});
+    }
+    reset();
+}
+
+bool AxisCurves::set_params(size_t axis, const Params& params) {
+    if (axis >= TOTAL_AXES) return false;
+    if ((params.deadzone < 0.0f) || (params.saturation > 1.0f) || (params.deadzone >= params.saturation)) return false;
+    if ((params.expo < 0.0f) || (params.s_curve < 0.0f) || (params.expo + params.s_curve > 1.0f)) return false;
+    if ((params.smoothing_ms < 0.0f) || (params.smoothing_ms > MAX_SMOOTHING_MS)) return false;
+
+    // expo:    (1-e)*t + e*t^3
+    // s_curve: (1-s)*t + s*(3t^2 - 2t^3)
+    // NOTE: The sum stays monotonic while e + s <= 1
+    deadzone[axis] = params.deadzone;
+    inv_range[axis] = 1.0f/(params.saturation - params.deadzone);
+    c1[axis] = 1.0f - params.expo - params.s_curve;
+    c2[axis] = 3.0f*params.s_curve;
+    c3[axis] = params.expo - 2.0f*params.s_curve;
+    smoothing_ms[axis] = params.smoothing_ms;
+
+    const Params identity;
+    const bool is_custom =
+        (params.deadzone != identity.deadzone) || (params.saturation != identity.saturation) ||
+        (params.expo != identity.expo) || (params.s_curve != identity.s_curve) ||
+        (params.smoothing_ms != identity.smoothing_ms);
+    const uint16_t mask = uint16_t(1u << axis);
+    custom_axes = is_custom ? (custom_axes | mask) : (custom_axes & ~mask);
+    return true;
+}
+
+void AxisCurves::set_state(size_t axis, float value) {
+    input[axis] = value;
+    output[axis] = value;
+}
+
+void AxisCurves::reset() {
+    for (size_t i = 0; i < TOTAL_AXES; i++) {
+        input[i] = 0.0f;
+        output[i] = 0.0f;
+    }
+    is_settling = false;
+}
+
+#if AXIS_CURVES_SSE2
+void AxisCurves::process(float dt_ms) {
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(SETTLE_EPSILON);
+    const __m128 dt = _mm_set1_ps(fmaxf(dt_ms, 0.0f) + DT_EPSILON_MS);
+    __m128 settling = zero;
+    for (size_t i = 0; i < TOTAL_AXES; i += 4) {
+        const __m128 x = _mm_load_ps(input+i);
+        const __m128 sign = _mm_and_ps(x, sign_mask);
+        __m128 t = _mm_andnot_ps(sign_mask, x);
+        t = _mm_mul_ps(_mm_sub_ps(t, _mm_load_ps(deadzone+i)), _mm_load_ps(inv_range+i));
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+        // Horner's method
+        __m128 y = _mm_add_ps(_mm_mul_ps(_mm_load_ps(c3+i), t), _mm_load_ps(c2+i));
+        y = _mm_add_ps(_mm_mul_ps(y, t), _mm_load_ps(c1+i));
+        y = _mm_or_ps(_mm_mul_ps(y, t), sign);
+
+        const __m128 alpha = _mm_div_ps(dt, _mm_add_ps(_mm_load_ps(smoothing_ms+i), dt));
+        __m128 out = _mm_load_ps(output+i);
+        out = _mm_add_ps(out, _mm_mul_ps(_mm_sub_ps(y, out), alpha));
+        _mm_store_ps(output+i, out);
+        const __m128 error = _mm_andnot_ps(sign_mask, _mm_sub_ps(y, out));
+        settling = _mm_or_ps(settling, _mm_cmpgt_ps(error, epsilon));
+    }
+    is_settling = _mm_movemask_ps(settling) != 0;
+}
+#else
+void AxisCurves::process(float dt_ms) {
+    const float dt = fmaxf(dt_ms, 0.0f) + DT_EPSILON_MS;
+    bool settling = false;
+    for (size_t i = 0; i < TOTAL_AXES; i++) {
+        const float x = input[i];
+        float t = (fabsf(x) - deadzone[i])*inv_range[i];
+        t = fminf(fmaxf(t, 0.0f), 1.0f);
+        float y = ((c3[i]*t + c2[i])*t + c1[i])*t;
+        y = copysignf(y, x);
+
+        const float alpha = dt/(smoothing_ms[i] + dt);
+        output[i] += (y - output[i])*alpha;
+        settling = settling || (fabsf(y - output[i]) > SETTLE_EPSILON);
+    }
+    is_settling = settling;
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AXIS_CURVES_SSE2 1
+#endif
+
+// Deadzone, saturation, response curve and smoothing applied to all axes of a device
+// Parameters are compiled into coefficient tables so every axis runs the same arithmetic
+// and the whole device is processed as 4 batches of 4 axes per update
+//     t = clamp((|x| - deadzone)/(saturation - deadzone), 0, 1)
+//     y = sign(x)*(c1*t + c2*t^2 + c3*t^3)
+//     output += (y - output)*dt/(smoothing + dt)
+class AxisCurves
+{
+public:
+    static constexpr size_t TOTAL_AXES = 16;
+    // Difference below which smoothing is considered settled
+    static constexpr float SETTLE_EPSILON = 1.0f/4096.0f;
+    // Longest step the filter takes, which is the interval settling axes are updated at
+    // NOTE: Otherwise the first input after an idle period jumps straight to its target
+    static constexpr float MAX_STEP_MS = 10.0f;
+
+    // Normalised between 0 and 1 except for the smoothing time constant
+    struct Params {
+        float deadzone = 0.0f;
+        float saturation = 1.0f;
+        // Flattens the center, expo + s_curve must be at most 1
+        float expo = 0.0f;
+        // Flattens the center and the ends
+        float s_curve = 0.0f;
+        float smoothing_ms = 0.0f;
+    };
+private:
+    alignas(16) float deadzone[TOTAL_AXES];
+    alignas(16) float inv_range[TOTAL_AXES];
+    alignas(16) float c1[TOTAL_AXES];
+    alignas(16) float c2[TOTAL_AXES];
+    alignas(16) float c3[TOTAL_AXES];
+    alignas(16) float smoothing_ms[TOTAL_AXES];
+    alignas(16) float input[TOTAL_AXES];
+    alignas(16) float output[TOTAL_AXES];
+    uint16_t custom_axes;
+    bool is_settling;
+public:
+    AxisCurves();
+    // Returns false if the parameters are out of range
+    bool set_params(size_t axis, const Params& params);
+    // Bypass the stage when no axis has custom parameters
+    bool is_enabled() const { return custom_axes != 0; }
+    bool get_is_settling() const { return is_settling; }
+    void set_input(size_t axis, float value) { input[axis] = value; }
+    float get_input(size_t axis) const { return input[axis]; }
+    float get_output(size_t axis) const { return output[axis]; }
+    // Start smoothing from this value instead of moving towards it
+    void set_state(size_t axis, float value);
+    void process(float dt_ms);
+    void reset();
+};
@@ -1,18 +1,24 @@
 #pragma once
+#include <algorithm>
+#include <chrono>
+#include <memory>
 #include "vjoy.hpp"
+#include "packets.hpp"
+#include "axis_curves.hpp"
+#include "device_capabilities.hpp"
+#include "utility/object_pool.hpp"
+#include "utility/trace.hpp"
 
 // Light wrapper around vjoy device calls
-class Controller 
+// NOTE: Pooled for the 16 devices that vjoy supports
+class Controller: public Pooled<Controller, 16>
 {
 private:
-    struct axis_bounds {
-        int32_t min;
-        int32_t max;
-        int32_t center;
-        int32_t range;
-    };
+    using axis_bounds = AxisBounds;
 public:
     const vjoy::Device_ID rid;
+    // NOTE: Kept alive here so replies built from it stay valid if the cache entry is replaced
+    const std::shared_ptr<const DeviceCapabilities> capabilities;
     const axis_bounds axis_x; 
     const axis_bounds axis_y; 
     const axis_bounds axis_z; 
@@ -33,27 +39,36 @@ public:
     const vjoy::Device_Info device_info;
 private:
     vjoy::Joystick_Position state;
+    // Lets observers detect changes without being notified
+    uint32_t total_updates;
+    // NOTE: When enabled set_axis only stages the value, all axes are written on update
+    AxisCurves curves;
+    std::chrono::steady_clock::time_point last_update;
 public:
+    // Bounds and capabilities come from the process wide cache so acquiring doesn't query every axis
     Controller(const vjoy::Device_ID _rid)
     :   rid(_rid),
-        axis_x          (update_axis_bounds(vjoy::Axis::X)),
-        axis_y          (update_axis_bounds(vjoy::Axis::Y)),
-        axis_z          (update_axis_bounds(vjoy::Axis::Z)),
-        axis_rx         (update_axis_bounds(vjoy::Axis::RX)),
-        axis_ry         (update_axis_bounds(vjoy::Axis::RY)),
-        axis_rz         (update_axis_bounds(vjoy::Axis::RZ)),
-        axis_slider     (update_axis_bounds(vjoy::Axis::SLIDER)),
-        axis_dial       (update_axis_bounds(vjoy::Axis::DIAL)),
-        axis_wheel      (update_axis_bounds(vjoy::Axis::WHEEL)),
-        axis_accelerator(update_axis_bounds(vjoy::Axis::ACCELERATOR)),
-        axis_brake      (update_axis_bounds(vjoy::Axis::BRAKE)),
-        axis_clutch     (update_axis_bounds(vjoy::Axis::CLUTCH)),
-        axis_steering   (update_axis_bounds(vjoy::Axis::STEERING)),
-        axis_rudder     (update_axis_bounds(vjoy::Axis::RUDDER)),
-        axis_aileron    (update_axis_bounds(vjoy::Axis::AILERON)),
-        axis_throttle   (update_axis_bounds(vjoy::Axis::THROTTLE)),
-        total_buttons(vjoy::device_get_total_buttons(rid)),
-        device_info(vjoy::device_get_info(rid))
+        capabilities(get_device_capability_cache().get(_rid)),
+        axis_x          (capabilities->axis_x),
+        axis_y          (capabilities->axis_y),
+        axis_z          (capabilities->axis_z),
+        axis_rx         (capabilities->axis_rx),
+        axis_ry         (capabilities->axis_ry),
+        axis_rz         (capabilities->axis_rz),
+        axis_slider     (capabilities->axis_slider),
+        axis_dial       (capabilities->axis_dial),
+        axis_wheel      (capabilities->axis_wheel),
+        axis_accelerator(capabilities->axis_accelerator),
+        axis_brake      (capabilities->axis_brake),
+        axis_clutch     (capabilities->axis_clutch),
+        axis_steering   (capabilities->axis_steering),
+        axis_rudder     (capabilities->axis_rudder),
+        axis_aileron    (capabilities->axis_aileron),
+        axis_throttle   (capabilities->axis_throttle),
+        total_buttons(capabilities->total_buttons),
+        device_info(capabilities->device_info),
+        total_updates(0),
+        last_update(std::chrono::steady_clock::now())
     {
         reset();
         update();
@@ -97,10 +112,80 @@ public:
         state.wAxisVBRX = 0;
         state.wAxisVBRY = 0;
         state.wAxisVBRZ = 0;
+        curves.reset();
     }
 
     void update() {
-        vjoy::device_update(rid, &state);
+        TRACE_SPAN(TraceSpanId::CONTROLLER_UPDATE);
+        const auto now = std::chrono::steady_clock::now();
+        if (curves.is_enabled()) {
+            const float dt_ms = std::chrono::duration<float, std::milli>(now - last_update).count();
+            curves.process(std::min(dt_ms, AxisCurves::MAX_STEP_MS));
+            for (uint8_t i = 0; i < AxisCurves::TOTAL_AXES; i++) {
+                write_axis(Axis(i), curves.get_output(i));
+            }
+        }
+        last_update = now;
+        {
+            TRACE_SPAN(TraceSpanId::DEVICE_UPDATE);
+            vjoy::device_update(rid, &state);
+        }
+        total_updates++;
+    }
+
+    // Returns false if the axis id or parameters are invalid
+    bool set_axis_curve(const Axis axis_id, const AxisCurves::Params& params) {
+        if (size_t(axis_id) >= AxisCurves::TOTAL_AXES) return false;
+        const bool was_enabled = curves.is_enabled();
+        if (!was_enabled) {
+            for (uint8_t i = 0; i < AxisCurves::TOTAL_AXES; i++) {
+                curves.set_state(i, get_axis(Axis(i)));
+            }
+        }
+        if (!curves.set_params(size_t(axis_id), params)) return false;
+        // Write the staged input back since update won't do it anymore
+        if (was_enabled && !curves.is_enabled()) {
+            for (uint8_t i = 0; i < AxisCurves::TOTAL_AXES; i++) {
+                write_axis(Axis(i), curves.get_input(i));
+            }
+        }
+        return true;
+    }
+
+    // Smoothed axes need more updates to reach their input
+    bool get_is_settling() const {
+        return curves.is_enabled() && curves.get_is_settling();
+    }
+
+    uint32_t get_total_updates() const {
+        return total_updates;
+    }
+
+    const vjoy::Joystick_Position& get_state() const {
+        return state;
+    }
+
+    // Normalised between -1 and +1, returns 0 if the axis id is invalid
+    float get_axis(const Axis axis_id) const {
+        switch (axis_id) {
+        case Axis::X:           return get_axis_value(state.wAxisX,       axis_x);
+        case Axis::Y:           return get_axis_value(state.wAxisY,       axis_y);
+        case Axis::Z:           return get_axis_value(state.wAxisZ,       axis_z);
+        case Axis::RX:          return get_axis_value(state.wAxisXRot,    axis_rx);
+        case Axis::RY:          return get_axis_value(state.wAxisYRot,    axis_ry);
+        case Axis::RZ:          return get_axis_value(state.wAxisZRot,    axis_rz);
+        case Axis::SLIDER:      return get_axis_value(state.wSlider,      axis_slider);
+        case Axis::DIAL:        return get_axis_value(state.wDial,        axis_dial);
+        case Axis::WHEEL:       return get_axis_value(state.wWheel,       axis_wheel);
+        case Axis::ACCELERATOR: return get_axis_value(state.wAccelerator, axis_accelerator);
+        case Axis::BRAKE:       return get_axis_value(state.wBrake,       axis_brake);
+        case Axis::CLUTCH:      return get_axis_value(state.wClutch,      axis_clutch);
+        case Axis::STEERING:    return get_axis_value(state.wSteering,    axis_steering);
+        case Axis::AILERON:     return get_axis_value(state.wAileron,     axis_aileron);
+        case Axis::RUDDER:      return get_axis_value(state.wRudder,      axis_rudder);
+        case Axis::THROTTLE:    return get_axis_value(state.wThrottle,    axis_throttle);
+        default:                return 0.0f;
+        }
     }
 
     void set_x          (const float v) { state.wAxisX       = get_norm_value(v, axis_x); }
@@ -120,6 +205,16 @@ public:
     void set_aileron    (const float v) { state.wAileron     = get_norm_value(v, axis_aileron); }
     void set_throttle   (const float v) { state.wThrottle    = get_norm_value(v, axis_throttle); }
 
+    // Returns false if the axis id is invalid
+    bool set_axis(const Axis axis_id, const float v) {
+        if (curves.is_enabled()) {
+            if (size_t(axis_id) >= AxisCurves::TOTAL_AXES) return false;
+            curves.set_input(size_t(axis_id), v);
+            return true;
+        }
+        return write_axis(axis_id, v);
+    }
+
     void set_button(const uint8_t index, const bool is_pressed) {
         if (index < 32)  return set_button_x(index,    is_pressed, state.lButtons);
         if (index < 64)  return set_button_x(index-32, is_pressed, state.lButtonsEx1);
@@ -127,14 +222,28 @@ public:
         if (index < 128) return set_button_x(index-96, is_pressed, state.lButtonsEx3);
     }
 private:
-    axis_bounds update_axis_bounds(vjoy::Axis vjd_axis) {
-        axis_bounds axis;
-        vjoy::device_get_axis_min(rid, vjd_axis, &axis.min);
-        vjoy::device_get_axis_max(rid, vjd_axis, &axis.max);
-        axis.center = (axis.min + axis.max)/2;
-        axis.range = (axis.max - axis.min)/2;
-        return axis;
+    bool write_axis(const Axis axis_id, const float v) {
+        switch (axis_id) {
+        case Axis::X:           set_x          (v); return true;
+        case Axis::Y:           set_y          (v); return true;
+        case Axis::Z:           set_z          (v); return true;
+        case Axis::RX:          set_rx         (v); return true;
+        case Axis::RY:          set_ry         (v); return true;
+        case Axis::RZ:          set_rz         (v); return true;
+        case Axis::SLIDER:      set_slider     (v); return true;
+        case Axis::DIAL:        set_dial       (v); return true;
+        case Axis::WHEEL:       set_wheel      (v); return true;
+        case Axis::ACCELERATOR: set_accelerator(v); return true;
+        case Axis::BRAKE:       set_brake      (v); return true;
+        case Axis::CLUTCH:      set_clutch     (v); return true;
+        case Axis::STEERING:    set_steering   (v); return true;
+        case Axis::AILERON:     set_aileron    (v); return true;
+        case Axis::RUDDER:      set_rudder     (v); return true;
+        case Axis::THROTTLE:    set_throttle   (v); return true;
+        default:                return false;
+        }
     }
+
     void set_button_x(const uint8_t v, const bool is_pressed, uint32_t& reg) {
         const uint32_t mask = uint32_t(1) << v;
         if (is_pressed) {
@@ -144,6 +253,11 @@ private:
         }
     }
 
+    float get_axis_value(int32_t value, axis_bounds axis) const {
+        if (axis.range == 0) return 0.0f;
+        return float(value - axis.center) / float(axis.range);
+    }
+
     int32_t get_norm_value(float x, axis_bounds axis) {
         const int32_t value = axis.center + int32_t(float(axis.range)*x);
         return clamp(value, axis.min, axis.max);
@@ -1,184 +1,452 @@
 #include "controller_packet_handler.hpp"
 #include "packets.hpp"
 #include "controller_session.hpp"
+#include "macro_player.hpp"
+#include "jitter_buffer.hpp"
+#include "utility/trace.hpp"
+#include "utility/logger.hpp"
 #include <stdint.h>
-#include <vector>
+#include <stdio.h>
 #include "utility/span.hpp"
 
-ControllerPacketHandler::ControllerPacketHandler() {
-    // Large enough for largest encoded packet
-    encode_buf.resize(256);
-    session = std::make_unique<ControllerSession>();
+ControllerPacketHandler::ControllerPacketHandler(TaskScheduler* _scheduler, DeviceStateBoard* _board, const ProfileRegistry* _profiles, DevicePool* devices) 
+:   sink(nullptr), scheduler(_scheduler), smoothing_task(TaskScheduler::INVALID_TASK), board(_board), profiles(_profiles), profile_generation(0), receive_time_us(0)
+{
+    session = std::make_unique<ControllerSession>(devices);
+    macro_player = std::make_unique<MacroPlayer>(scheduler, [this]() {
+        schedule_smoothing();
+    });
+    jitter_buffer = std::make_unique<JitterBuffer>(scheduler, [this](tcb::span<const uint8_t> buf) {
+        const auto res = process(buf);
+        schedule_smoothing();
+        if (sink != nullptr) {
+            sink->send_packet(res);
+        }
+    });
 }
 
 ControllerPacketHandler::~ControllerPacketHandler() {
-
+    if ((scheduler != nullptr) && (smoothing_task != TaskScheduler::INVALID_TASK)) {
+        scheduler->cancel(smoothing_task);
+    }
+    auto* controller = session->get_controller();
+    if ((board != nullptr) && (controller != nullptr)) {
+        board->detach(uint8_t(controller->get_id()));
+    }
 }
 
 tcb::span<const uint8_t> ControllerPacketHandler::on_packet(tcb::span<const uint8_t> buf) {
+    TRACE_SPAN(TraceSpanId::ON_PACKET);
+    receive_time_us = get_server_time_us();
+    const auto res = receive(buf);
+    schedule_smoothing();
+    latency.processing.add(get_server_time_us() - receive_time_us);
+    return res;
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::receive(tcb::span<const uint8_t> buf) {
     if (buf.size() == 0) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::EMPTY_REQUEST);
+        return create_error(Status_Error::EMPTY_REQUEST);
     }
 
     const Command command = Command(buf[0]);
-    auto data_buf = buf.subspan(1);
-    switch (command) {
-    case Command::ACQUIRE_DEVICE:   return on_acquire(data_buf);
-    case Command::SET_BUTTON:       return on_button(data_buf);
-    case Command::SET_AXIS:         return on_axis(data_buf);
-    case Command::RESET:            return on_reset(data_buf);
-    case Command::GET_DEV_INFO:     return on_dev_info(data_buf);
-    default:                        return create_packet(Command::INVALID_REQUEST, Status_Error::INVALID_COMMAND);
+    if (command == Command::TIMESTAMPED) {
+        return process(buf);
     }
+    // NOTE: Untimestamped packets would overtake buffered ones so apply those first
+    if (!jitter_buffer->get_is_empty()) {
+        jitter_buffer->flush();
+    }
+    return process(buf);
 }
 
-// Acquire device
-tcb::span<const uint8_t> ControllerPacketHandler::on_acquire(tcb::span<const uint8_t> buf) {
-    constexpr size_t N = 1;
-    if (buf.size() != N) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::INCORRECT_LENGTH);
+// Routes are generated from packets.schema so handlers get a view that is already the right length
+tcb::span<const uint8_t> ControllerPacketHandler::process(tcb::span<const uint8_t> buf) {
+    const auto& route = PacketRoutes<ControllerPacketHandler>::ROUTES[buf[0]];
+    if (route.callback == nullptr) {
+        return create_error(Status_Error::INVALID_COMMAND);
     }
+    if ((buf.size() < route.min_size) || (buf.size() > route.max_size)) {
+        return create_error(Status_Error::INCORRECT_LENGTH);
+    }
+    return route.callback(*this, buf);
+}
+
+PacketInfo ControllerPacketHandler::get_packet_info(tcb::span<const uint8_t> buf) {
+    return get_controller_packet_info(buf);
+}
 
-    const uint8_t device_id = buf[0];
+PacketInfo get_controller_packet_info(tcb::span<const uint8_t> buf) {
+    PacketInfo info;
+    // Only the latest axis value matters so older ones can be discarded
+    constexpr size_t TIMESTAMP_SIZE = TimestampedRequest::MIN_SIZE;
+    if ((buf.size() == TIMESTAMP_SIZE+SetAxisRequest::MIN_SIZE) && (Command(buf[0]) == Command::TIMESTAMPED)) {
+        buf = buf.subspan(TIMESTAMP_SIZE);
+    }
+    if ((buf.size() == SetAxisRequest::MIN_SIZE) && (Command(buf[0]) == Command::SET_AXIS)) {
+        info.priority = PacketPriority::CONFLATE;
+        info.conflate_key = uint16_t(buf[0]) << 8 | uint16_t(buf[1]);
+    }
+    return info;
+}
+
+// Successful replies to high rate input, errors and state such as device info or clock sync are never dropped
+bool get_is_controller_ack(tcb::span<const uint8_t> response) {
+    if (response.size() < 2) return false;
+    switch (Command(response[0])) {
+    case Command::SET_BUTTON:     return Status_Button(response[1]) == Status_Button::SUCCESS;
+    case Command::SET_AXIS:       return Status_Axis(response[1]) == Status_Axis::SUCCESS;
+    case Command::REPORT_LATENCY: return Status_Latency(response[1]) == Status_Latency::SUCCESS;
+    default:                      return false;
+    }
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_rate_limited(tcb::span<const uint8_t> buf) {
+    return create_error(Status_Error::RATE_LIMITED);
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_flow_control(const FlowControl& flow) {
+    return FlowControlResponse::write(encode_buf, flow.max_rate_hz, flow.batch_ms);
+}
+
+// Acquire device
+tcb::span<const uint8_t> ControllerPacketHandler::on_acquire_device(AcquireDeviceRequest req) {
+    const uint8_t device_id = req.get_vjoy_id();
     const auto status = session->open_controller(vjoy::Device_ID(device_id));
     switch (status) {
     case ControllerSession::Status_Acquire::SUCCESS:
-        return create_packet(Command::ACQUIRE_DEVICE, Status_Acquire::SUCCESS, device_id);
+        on_acquired();
+        return AcquireDeviceResponse::write(encode_buf, Status_Acquire::SUCCESS, device_id);
     case ControllerSession::Status_Acquire::DEVICE_ALREADY_ACQUIRED:
-        return create_packet(Command::ACQUIRE_DEVICE, Status_Acquire::ERROR_DEVICE_ALREADY_ACQUIRED, device_id);
+        return AcquireDeviceResponse::write(encode_buf, Status_Acquire::ERROR_DEVICE_ALREADY_ACQUIRED, device_id);
     case ControllerSession::Status_Acquire::DEVICE_NOT_EXISTS:
-        return create_packet(Command::ACQUIRE_DEVICE, Status_Acquire::ERROR_DEVICE_NOT_EXISTS, device_id);
+        return AcquireDeviceResponse::write(encode_buf, Status_Acquire::ERROR_DEVICE_NOT_EXISTS, device_id);
     case ControllerSession::Status_Acquire::DEVICE_BUSY:
-        return create_packet(Command::ACQUIRE_DEVICE, Status_Acquire::ERROR_DEVICE_BUSY, device_id);
+        return AcquireDeviceResponse::write(encode_buf, Status_Acquire::ERROR_DEVICE_BUSY, device_id);
     default:
-        return create_packet(Command::INVALID_REQUEST, Status_Error::UNKNOWN_ERROR);
+        return create_error(Status_Error::UNKNOWN_ERROR);
     }
 }
 
-tcb::span<const uint8_t> ControllerPacketHandler::on_button(tcb::span<const uint8_t> buf) {
-    constexpr size_t N = 2;
-    if (buf.size() != N) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::INCORRECT_LENGTH);
+// Acquire any free device so clients don't need to know which ids exist or are taken
+tcb::span<const uint8_t> ControllerPacketHandler::on_acquire_any(AcquireAnyRequest req) {
+    const auto status = session->open_any_controller();
+    const tcb::span<const uint8_t> no_axes;
+    switch (status) {
+    case ControllerSession::Status_Acquire::SUCCESS:
+        break;
+    case ControllerSession::Status_Acquire::DEVICE_ALREADY_ACQUIRED:
+    {
+        // NOTE: Reply with the device we hold so a resent request still tells the client its id
+        auto* controller = session->get_controller();
+        return AcquireAnyResponse::write(encode_buf, Status_Acquire::ERROR_DEVICE_ALREADY_ACQUIRED, uint8_t(controller->get_id()), 0, 0, 0, no_axes);
     }
+    case ControllerSession::Status_Acquire::NO_FREE_DEVICES:
+        return AcquireAnyResponse::write(encode_buf, Status_Acquire::ERROR_NO_FREE_DEVICES, 0, 0, 0, 0, no_axes);
+    default:
+        return create_error(Status_Error::UNKNOWN_ERROR);
+    }
+
+    on_acquired();
+    auto* controller = session->get_controller();
+    const auto& info = controller->device_info;
+    return AcquireAnyResponse::write(
+        encode_buf, Status_Acquire::SUCCESS, uint8_t(controller->get_id()),
+        uint8_t(info.nButtons), uint8_t(info.nDiscHats), uint8_t(info.nContHats),
+        controller->capabilities->get_axes()
+    );
+}
+
+void ControllerPacketHandler::on_acquired() {
+    auto* controller = session->get_controller();
+    log_info("Acquired vJoy device {}", unsigned(controller->get_id()));
+    if (board != nullptr) {
+        board->attach(uint8_t(controller->get_id()), controller);
+    }
+    mapper.reset();
+    update_profile(true);
+    controller->update();
+}
 
+tcb::span<const uint8_t> ControllerPacketHandler::on_set_button(SetButtonRequest req) {
     auto* controller = session->get_controller();
     if (controller == NULL) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::DEVICE_NOT_ACQUIRED);
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
     }
 
     const auto& dev_info = controller->device_info;
-    const uint8_t button_id = buf[0];
-    const bool is_pressed = bool(buf[1]);
+    const uint8_t button_id = req.get_button_id();
+    const bool is_pressed = bool(req.get_state());
 
     if (button_id > dev_info.nButtons) {
-        return create_packet(Command::SET_BUTTON, Status_Button::ERROR_INVALID_BUTTON, button_id);
+        return SetButtonResponse::write(encode_buf, Status_Button::ERROR_INVALID_BUTTON, button_id);
     }
 
-    controller->set_button(button_id, is_pressed);
+    update_profile();
+    mapper.set_button(controller, button_id, is_pressed);
     controller->update();
-    return create_packet(Command::SET_BUTTON, Status_Button::SUCCESS, button_id);
+    return SetButtonResponse::write(encode_buf, Status_Button::SUCCESS, button_id);
 }
 
-tcb::span<const uint8_t> ControllerPacketHandler::on_axis(tcb::span<const uint8_t> buf) {
-    constexpr size_t N = 2;
-    if (buf.size() != N) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::INCORRECT_LENGTH);
-    }
-
+tcb::span<const uint8_t> ControllerPacketHandler::on_set_axis(SetAxisRequest req) {
     auto* controller = session->get_controller();
     if (controller == NULL) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::DEVICE_NOT_ACQUIRED);
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
     }
 
-    const Axis axis_id = Axis(buf[0]);
-    const uint8_t norm_value = buf[1];
+    const uint8_t axis_id = req.get_axis_id();
+    const uint8_t norm_value = req.get_state();
     constexpr float range = 100.0f;
     const float value = (float(norm_value) - range) / range;
 
-    switch (axis_id) {
-    case Axis::X:           controller->set_x          (value); break;
-    case Axis::Y:           controller->set_y          (value); break;
-    case Axis::Z:           controller->set_z          (value); break;
-    case Axis::RX:          controller->set_rx         (value); break;
-    case Axis::RY:          controller->set_ry         (value); break;
-    case Axis::RZ:          controller->set_rz         (value); break;
-    case Axis::SLIDER:      controller->set_slider     (value); break;
-    case Axis::DIAL:        controller->set_dial       (value); break;
-    case Axis::WHEEL:       controller->set_wheel      (value); break;
-    case Axis::ACCELERATOR: controller->set_accelerator(value); break;
-    case Axis::BRAKE:       controller->set_brake      (value); break;
-    case Axis::CLUTCH:      controller->set_clutch     (value); break;
-    case Axis::STEERING:    controller->set_steering   (value); break;
-    case Axis::AILERON:     controller->set_aileron    (value); break;
-    case Axis::RUDDER:      controller->set_rudder     (value); break;
-    case Axis::THROTTLE:    controller->set_throttle   (value); break;
-    default:            
-        return create_packet(Command::SET_AXIS, Status_Axis::ERROR_INVALID_AXIS, axis_id);
+    update_profile();
+    if (!mapper.set_axis(controller, axis_id, value)) {
+        return SetAxisResponse::write(encode_buf, Status_Axis::ERROR_INVALID_AXIS, axis_id);
     }
 
     controller->update();
-    return create_packet(Command::SET_AXIS, Status_Button::SUCCESS, axis_id);
+    return SetAxisResponse::write(encode_buf, Status_Axis::SUCCESS, axis_id);
 }
 
-tcb::span<const uint8_t> ControllerPacketHandler::on_reset(tcb::span<const uint8_t> buf) {
-    const size_t N = 0;
-    if (buf.size() != N) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::INCORRECT_LENGTH);
-    }
-
+tcb::span<const uint8_t> ControllerPacketHandler::on_reset(ResetRequest req) {
     auto* controller = session->get_controller();
     if (controller == NULL) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::DEVICE_NOT_ACQUIRED);
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
     }
 
+    // NOTE: Running macros would overwrite the reset state
+    macro_player->stop_all();
+    mapper.reset();
+    imu.recenter();
     controller->reset();
+    update_profile(true);
     controller->update();
-    return create_packet(Command::RESET, Status_Reset::SUCCESS);
+    return ResetResponse::write(encode_buf, Status_Reset::SUCCESS);
 }
 
-tcb::span<const uint8_t> ControllerPacketHandler::on_dev_info(tcb::span<const uint8_t> buf) {
-    const size_t N = 0;
-    if (buf.size() != N) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::INCORRECT_LENGTH);
+tcb::span<const uint8_t> ControllerPacketHandler::on_get_dev_info(GetDevInfoRequest req) {
+    auto* controller = session->get_controller();
+    if (controller == NULL) {
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
     }
 
+    // NOTE: Encoded when the device capabilities were read
+    return controller->capabilities->get_dev_info_reply();
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_upload_macro(UploadMacroRequest req) {
+    const uint8_t macro_id = req.get_macro_id();
+    const auto status = macro_player->upload(macro_id, req.get_steps());
+    return UploadMacroResponse::write(encode_buf, status, macro_id);
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_trigger_macro(TriggerMacroRequest req) {
     auto* controller = session->get_controller();
     if (controller == NULL) {
-        return create_packet(Command::INVALID_REQUEST, Status_Error::DEVICE_NOT_ACQUIRED);
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
     }
 
-    const auto& info = controller->device_info;
+    const uint8_t macro_id = req.get_macro_id();
+    const auto status = macro_player->trigger(macro_id, controller);
+    return TriggerMacroResponse::write(encode_buf, status, macro_id);
+}
 
-    encode_buf[0] = uint8_t(Command::GET_DEV_INFO); 
-    // Create list of available axes
-    uint8_t total_axes = 0;
-    {
-        const size_t N = 2;
-        auto list_buf = tcb::span(encode_buf).subspan(N);
-        size_t i = 0;
-        if (info.AxisX)         list_buf[i++] = uint8_t(Axis::X);
-        if (info.AxisY)         list_buf[i++] = uint8_t(Axis::Y);
-        if (info.AxisZ)         list_buf[i++] = uint8_t(Axis::Z);
-        if (info.AxisXRot)      list_buf[i++] = uint8_t(Axis::RX);
-        if (info.AxisYRot)      list_buf[i++] = uint8_t(Axis::RY);
-        if (info.AxisZRot)      list_buf[i++] = uint8_t(Axis::RZ);
-        if (info.Slider)        list_buf[i++] = uint8_t(Axis::SLIDER);
-        if (info.Dial)          list_buf[i++] = uint8_t(Axis::DIAL);
-        if (info.Wheel)         list_buf[i++] = uint8_t(Axis::WHEEL);
-        if (info.Accelerator)   list_buf[i++] = uint8_t(Axis::ACCELERATOR);
-        if (info.Brake)         list_buf[i++] = uint8_t(Axis::BRAKE);
-        if (info.Clutch)        list_buf[i++] = uint8_t(Axis::CLUTCH);
-        if (info.Steering)      list_buf[i++] = uint8_t(Axis::STEERING);
-        if (info.Aileron)       list_buf[i++] = uint8_t(Axis::AILERON);
-        if (info.Rudder)        list_buf[i++] = uint8_t(Axis::RUDDER);
-        if (info.Throttle)      list_buf[i++] = uint8_t(Axis::THROTTLE);
-        total_axes = uint8_t(i);
-    }
-    encode_buf[1] = total_axes;
-    encode_buf[2+total_axes+0] = uint8_t(info.nButtons);
-    encode_buf[2+total_axes+1] = uint8_t(info.nDiscHats);
-    encode_buf[2+total_axes+2] = uint8_t(info.nContHats);
-
-    const size_t encode_size = 2+total_axes+2+1;
-    return tcb::span(encode_buf).first(encode_size);
-}
\ No newline at end of file
+tcb::span<const uint8_t> ControllerPacketHandler::on_stop_macro(StopMacroRequest req) {
+    const uint8_t macro_id = req.get_macro_id();
+    const auto status = macro_player->stop(macro_id);
+    return StopMacroResponse::write(encode_buf, status, macro_id);
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_timestamped(TimestampedRequest req) {
+    auto packet = req.get_packet();
+    if (packet.empty()) {
+        return create_error(Status_Error::INCORRECT_LENGTH);
+    }
+
+    const uint32_t client_time = req.get_client_time_us();
+    latency.add_client_time(client_time, receive_time_us);
+    const Command command = Command(packet[0]);
+    if ((command == Command::TIMESTAMPED) || (command == Command::SET_PLAYOUT)) {
+        return create_error(Status_Error::INVALID_COMMAND);
+    }
+    // NOTE: Response is sent through the sink when the packet is played out
+    if (jitter_buffer->push(client_time, packet)) {
+        return {};
+    }
+    return process(packet);
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_set_playout(SetPlayoutRequest req) {
+    const bool is_enabled = bool(req.get_is_enabled());
+    if (!jitter_buffer->configure(is_enabled, req.get_min_delay_ms(), req.get_max_delay_ms())) {
+        return SetPlayoutResponse::write(encode_buf, Status_Playout::ERROR_INVALID_VALUE);
+    }
+    return SetPlayoutResponse::write(encode_buf, Status_Playout::SUCCESS);
+}
+
+// Reply with the client time and our receive and send times so the client can estimate rtt and clock offset
+tcb::span<const uint8_t> ControllerPacketHandler::on_clock_sync(ClockSyncRequest req) {
+    return ClockSyncResponse::write(encode_buf, req.get_client_send_us(), receive_time_us, get_server_time_us());
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_report_latency(ReportLatencyRequest req) {
+    latency.rtt.add(req.get_rtt_us());
+    latency.clock_offset_us = req.get_clock_offset_us();
+    latency.is_clock_synced = true;
+    return ReportLatencyResponse::write(encode_buf, Status_Latency::SUCCESS);
+}
+
+// Select a profile by name for this session, an empty name selects the device default
+tcb::span<const uint8_t> ControllerPacketHandler::on_select_profile(SelectProfileRequest req) {
+    const auto buf = req.get_name();
+    auto name = std::string(reinterpret_cast<const char*>(buf.data()), buf.size());
+    if (!name.empty() && ((profiles == nullptr) || (profiles->find(name) == nullptr))) {
+        return SelectProfileResponse::write(encode_buf, Status_Profile::ERROR_PROFILE_NOT_EXISTS);
+    }
+    profile_name = std::move(name);
+    auto* controller = session->get_controller();
+    if (controller != nullptr) {
+        update_profile(true);
+        controller->update();
+    }
+    return SelectProfileResponse::write(encode_buf, Status_Profile::SUCCESS);
+}
+
+// Resolve the profile again after a reload or when forced to rebuild the outputs
+void ControllerPacketHandler::update_profile(bool is_forced) {
+    if ((profiles == nullptr) || (!is_forced && (profile_generation == profiles->get_generation()))) {
+        return;
+    }
+    profile_generation = profiles->get_generation();
+    auto* controller = session->get_controller();
+    if (controller == nullptr) {
+        return;
+    }
+    const auto& name = profile_name.empty() ? profiles->get_device_profile(uint8_t(controller->get_id())) : profile_name;
+    // NOTE: Falls back to identity if a reload removed the selected profile
+    auto profile = name.empty() ? nullptr : profiles->find(name);
+    if (is_forced || (profile.get() != mapper.get_profile())) {
+        mapper.set_profile(std::move(profile), controller);
+    }
+}
+
+// Percentages are used so the packet fits in bytes, smoothing is a time constant in ms
+tcb::span<const uint8_t> ControllerPacketHandler::on_set_axis_curve(SetAxisCurveRequest req) {
+    auto* controller = session->get_controller();
+    if (controller == NULL) {
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
+    }
+
+    const uint8_t axis_id = req.get_axis_id();
+    if (size_t(axis_id) >= AxisCurves::TOTAL_AXES) {
+        return SetAxisCurveResponse::write(encode_buf, Status_Curve::ERROR_INVALID_AXIS, axis_id);
+    }
+
+    constexpr float range = 100.0f;
+    AxisCurves::Params params;
+    params.deadzone = float(req.get_deadzone()) / range;
+    params.saturation = float(req.get_saturation()) / range;
+    params.expo = float(req.get_expo()) / range;
+    params.s_curve = float(req.get_s_curve()) / range;
+    params.smoothing_ms = float(req.get_smoothing_ms());
+    if (!controller->set_axis_curve(Axis(axis_id), params)) {
+        return SetAxisCurveResponse::write(encode_buf, Status_Curve::ERROR_INVALID_VALUE, axis_id);
+    }
+
+    controller->update();
+    return SetAxisCurveResponse::write(encode_buf, Status_Curve::SUCCESS, axis_id);
+}
+
+// Samples are fused at the rate they arrive, the attitude is applied once per packet
+tcb::span<const uint8_t> ControllerPacketHandler::on_imu_samples(ImuSamplesRequest req) {
+    auto* controller = session->get_controller();
+    if (controller == NULL) {
+        return create_error(Status_Error::DEVICE_NOT_ACQUIRED);
+    }
+
+    constexpr uint16_t MIN_INTERVAL_US = 1000;
+    constexpr uint16_t MAX_INTERVAL_US = 50000;
+    const uint16_t interval_us = req.get_interval_us();
+    if ((interval_us < MIN_INTERVAL_US) || (interval_us > MAX_INTERVAL_US)) {
+        return ImuSamplesResponse::write(encode_buf, Status_Imu::ERROR_INVALID_VALUE);
+    }
+    if (!imu.process(req.get_samples(), float(interval_us)*1e-6f)) {
+        return ImuSamplesResponse::write(encode_buf, Status_Imu::ERROR_INVALID_SAMPLES);
+    }
+    if (!imu.is_enabled()) {
+        return {};
+    }
+
+    update_profile();
+    for (int i = 0; i < ImuFusion::TOTAL_ANGLES; i++) {
+        const auto angle = ImuFusion::Angle(i);
+        const uint8_t axis_id = imu.get_axis(angle);
+        if (axis_id == ImuFusion::AXIS_DISABLED) continue;
+        mapper.set_axis(controller, axis_id, imu.get_output(angle));
+    }
+    controller->update();
+    // NOTE: No reply on success since samples arrive at up to 200Hz
+    return {};
+}
+
+tcb::span<const uint8_t> ControllerPacketHandler::on_set_imu(SetImuRequest req) {
+    ImuFusion::Params params;
+    params.axes[ImuFusion::ROLL] = req.get_roll_axis();
+    params.axes[ImuFusion::PITCH] = req.get_pitch_axis();
+    params.axes[ImuFusion::YAW] = req.get_yaw_axis();
+    for (const uint8_t axis_id: params.axes) {
+        if ((axis_id != ImuFusion::AXIS_DISABLED) && (size_t(axis_id) >= AxisCurves::TOTAL_AXES)) {
+            return SetImuResponse::write(encode_buf, Status_Imu::ERROR_INVALID_AXIS);
+        }
+    }
+    params.range_deg = float(req.get_range_deg());
+    params.beta = float(req.get_beta()) / 100.0f;
+    if (!imu.configure(params)) {
+        return SetImuResponse::write(encode_buf, Status_Imu::ERROR_INVALID_VALUE);
+    }
+    return SetImuResponse::write(encode_buf, Status_Imu::SUCCESS);
+}
+
+void ControllerPacketHandler::schedule_smoothing() {
+    auto* controller = session->get_controller();
+    if ((scheduler == nullptr) || (smoothing_task != TaskScheduler::INVALID_TASK)) return;
+    if ((controller == nullptr) || !controller->get_is_settling()) return;
+
+    const auto deadline = TaskScheduler::Clock::now() + std::chrono::milliseconds(SMOOTHING_INTERVAL_MS);
+    smoothing_task = scheduler->schedule(deadline, [this]() {
+        smoothing_task = TaskScheduler::INVALID_TASK;
+        auto* controller = session->get_controller();
+        if (controller == nullptr) return;
+        controller->update();
+        schedule_smoothing();
+    });
+}
+
+void ControllerPacketHandler::write_stats(std::string& dst) const {
+    auto* controller = session->get_controller();
+    auto* profile = mapper.get_profile();
+    char buf[128];
+    const int N = snprintf(buf, sizeof(buf), "\"device\":%u,\"profile\":\"%.64s\",", 
+        (controller != nullptr) ? unsigned(controller->get_id()) : 0u,
+        (profile != nullptr) ? profile->name.c_str() : ""
+    );
+    dst.append(buf, size_t(N));
+    latency.write_stats(dst);
+}
+
+void ControllerPacketHandlerFactory::write_stats(std::string& dst) const {
+    dst.append("\"pools\":{");
+    ControllerPacketHandler::get_pool_stats().write_stats(dst, "handlers");
+    dst.append(",");
+    ControllerSession::get_pool_stats().write_stats(dst, "sessions");
+    dst.append(",");
+    Controller::get_pool_stats().write_stats(dst, "controllers");
+    dst.append(",");
+    MacroPlayer::get_pool_stats().write_stats(dst, "macro_players");
+    dst.append(",");
+    JitterBuffer::get_pool_stats().write_stats(dst, "jitter_buffers");
+    dst.append("},");
+    devices.write_stats(dst);
+    dst.append(",");
+    get_device_capability_cache().write_stats(dst);
+}
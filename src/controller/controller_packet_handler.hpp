@@ -1,38 +1,120 @@
 #pragma once
 #include <stdint.h>
-#include <vector>
+#include <array>
 #include <memory>
 #include "utility/span.hpp"
+#include "utility/object_pool.hpp"
 #include "server/packet_handler.hpp"
+#include "latency_stats.hpp"
+#include "device_state_board.hpp"
+#include "device_pool.hpp"
+#include "device_capabilities.hpp"
+#include "axis_curves.hpp"
+#include "input_profile.hpp"
+#include "imu_fusion.hpp"
+#include "packets.hpp"
 
 class ControllerSession;
+class MacroPlayer;
+class JitterBuffer;
 
-class ControllerPacketHandler: public PacketHandler
+// Classify controller packets for transports, shared with the relay
+PacketInfo get_controller_packet_info(tcb::span<const uint8_t> buf);
+bool get_is_controller_ack(tcb::span<const uint8_t> response);
+
+// NOTE: Pooled along with its session, macro player and jitter buffer so connecting doesn't allocate
+class ControllerPacketHandler: public PacketHandler, public Pooled<ControllerPacketHandler, 64>
 {
+public:
+    static constexpr int SMOOTHING_INTERVAL_MS = int(AxisCurves::MAX_STEP_MS);
 private:
-    std::vector<uint8_t> encode_buf;
+    // Large enough for largest encoded packet
+    std::array<uint8_t, 256> encode_buf;
     std::unique_ptr<ControllerSession> session;
+    // NOTE: Declared after session so macros stop before the device is released
+    std::unique_ptr<MacroPlayer> macro_player;
+    std::unique_ptr<JitterBuffer> jitter_buffer;
+    PacketSink* sink;
+    TaskScheduler* const scheduler;
+    // Keeps updating the device while smoothed axes settle
+    TaskScheduler::TaskID smoothing_task;
+    DeviceStateBoard* const board;
+    const ProfileRegistry* const profiles;
+    ProfileMapper mapper;
+    ImuFusion imu;
+    // Empty selects the device default from the registry
+    std::string profile_name;
+    uint32_t profile_generation;
+    LatencyStats latency;
+    uint32_t receive_time_us;
 public:
-    ControllerPacketHandler(); 
+    ControllerPacketHandler(TaskScheduler* scheduler = nullptr, DeviceStateBoard* _board = nullptr, const ProfileRegistry* _profiles = nullptr, DevicePool* devices = nullptr); 
     ~ControllerPacketHandler() override;
     tcb::span<const uint8_t> on_packet(tcb::span<const uint8_t> buf) override;
+    PacketInfo get_packet_info(tcb::span<const uint8_t> buf) override;
+    tcb::span<const uint8_t> on_rate_limited(tcb::span<const uint8_t> buf) override;
+    tcb::span<const uint8_t> on_flow_control(const FlowControl& flow) override;
+    bool get_is_droppable(tcb::span<const uint8_t> response) const override { return get_is_controller_ack(response); }
+    void attach_sink(PacketSink* _sink) override { sink = _sink; }
+    void write_stats(std::string& dst) const override;
 private:
-    tcb::span<const uint8_t> on_acquire(tcb::span<const uint8_t> buf);
-    tcb::span<const uint8_t> on_button(tcb::span<const uint8_t> buf);
-    tcb::span<const uint8_t> on_axis(tcb::span<const uint8_t> buf);
-    tcb::span<const uint8_t> on_reset(tcb::span<const uint8_t> buf);
-    tcb::span<const uint8_t> on_dev_info(tcb::span<const uint8_t> buf);
+    tcb::span<const uint8_t> receive(tcb::span<const uint8_t> buf);
+    tcb::span<const uint8_t> process(tcb::span<const uint8_t> buf);
+    // Routed from packets.schema by PacketRoutes, the view is already the right length
+    friend struct PacketRoutes<ControllerPacketHandler>;
+    tcb::span<const uint8_t> on_acquire_device(AcquireDeviceRequest req);
+    tcb::span<const uint8_t> on_set_button(SetButtonRequest req);
+    tcb::span<const uint8_t> on_set_axis(SetAxisRequest req);
+    tcb::span<const uint8_t> on_reset(ResetRequest req);
+    tcb::span<const uint8_t> on_get_dev_info(GetDevInfoRequest req);
+    tcb::span<const uint8_t> on_upload_macro(UploadMacroRequest req);
+    tcb::span<const uint8_t> on_trigger_macro(TriggerMacroRequest req);
+    tcb::span<const uint8_t> on_stop_macro(StopMacroRequest req);
+    tcb::span<const uint8_t> on_timestamped(TimestampedRequest req);
+    tcb::span<const uint8_t> on_set_playout(SetPlayoutRequest req);
+    tcb::span<const uint8_t> on_clock_sync(ClockSyncRequest req);
+    tcb::span<const uint8_t> on_report_latency(ReportLatencyRequest req);
+    tcb::span<const uint8_t> on_select_profile(SelectProfileRequest req);
+    tcb::span<const uint8_t> on_set_axis_curve(SetAxisCurveRequest req);
+    tcb::span<const uint8_t> on_acquire_any(AcquireAnyRequest req);
+    tcb::span<const uint8_t> on_imu_samples(ImuSamplesRequest req);
+    tcb::span<const uint8_t> on_set_imu(SetImuRequest req);
+    void on_acquired();
+    void schedule_smoothing();
+    void update_profile(bool is_forced = false);
+
+    tcb::span<const uint8_t> create_error(Status_Error status) {
+        return InvalidRequestResponse::write(encode_buf, status);
+    }
+};
 
-    // Helper to type cast arguments into packet bytes
-    template <typename ... U>
-    tcb::span<const uint8_t> create_packet(U&& ... args) {
-        const size_t N = sizeof...(args);
-        // NOTE: This is a fold expression
-        //       https://en.cppreference.com/w/cpp/language/fold
-        size_t i = 0;
-        ([&] {
-            encode_buf[i++] = uint8_t(args);
-        } (), ...);
-        return tcb::span(encode_buf).first(N);
+class ControllerPacketHandlerFactory: public PacketHandlerFactory 
+{
+private:
+    TaskScheduler* scheduler = nullptr;
+    DeviceStateBoard board;
+    ProfileRegistry profiles;
+    DevicePool devices;
+public:
+    std::unique_ptr<PacketHandler> create_handler(void) override {
+        return std::make_unique<ControllerPacketHandler>(scheduler, &board, &profiles, &devices);
+    }
+    void attach_scheduler(TaskScheduler* _scheduler) override {
+        scheduler = _scheduler;
+        // NOTE: Every device is read and probed when the server starts so acquiring never has to
+        if (scheduler != nullptr) {
+            devices.probe();
+            get_device_capability_cache().preload();
+        }
+    }
+    void on_housekeeping() override {
+        profiles.check_for_changes();
+    }
+    bool load_profiles(const char* filepath, std::string& error) {
+        return profiles.load(filepath, error);
+    }
+    void write_stats(std::string& dst) const override;
+    ObserverSource* get_observer_source() override {
+        return &board;
     }
-};
\ No newline at end of file
+};
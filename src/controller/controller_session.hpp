@@ -1,11 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include "controller.hpp"
 #include "vjoy.hpp"
+#include "device_pool.hpp"
+#include "utility/object_pool.hpp"
 
 // Manage ownership of controller
-class ControllerSession 
+class ControllerSession: public Pooled<ControllerSession, 64>
 {
 public:
     enum Status_Acquire {
@@ -13,11 +16,14 @@ public:
         DEVICE_NOT_EXISTS,
         DEVICE_BUSY,
         DEVICE_ALREADY_ACQUIRED,
+        NO_FREE_DEVICES,
     };
 private:
     std::unique_ptr<Controller> controller;
+    // Kept in sync with the devices we hold if the server tracks free devices
+    DevicePool* const pool;
 public:
-    ControllerSession() {
+    ControllerSession(DevicePool* _pool = nullptr): pool(_pool) {
         controller = nullptr;
     }
 
@@ -25,6 +31,9 @@ public:
         if (controller != nullptr) {
             const auto id = controller->get_id();
             vjoy::device_release(id);
+            if (pool != nullptr) {
+                pool->release(uint8_t(id));
+            }
         }
     }
 
@@ -47,12 +56,57 @@ public:
             return Status_Acquire::DEVICE_NOT_EXISTS;
         }
 
+        // NOTE: Another of our sessions holds it, the driver would refuse and it must stay taken until released
+        if ((pool != nullptr) && (pool->get_state(uint8_t(id)) == DevicePool::State::TAKEN)) {
+            return Status_Acquire::DEVICE_BUSY;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
         const bool status = vjoy::device_acquire(id);
         if (!status) {
+            if (pool != nullptr) {
+                pool->set_external(uint8_t(id));
+            }
             return Status_Acquire::DEVICE_BUSY;
         }
 
         controller = std::make_unique<Controller>(id);
+        if (pool != nullptr) {
+            pool->set_taken(uint8_t(id));
+            pool->record_acquire(std::chrono::steady_clock::now() - start);
+        }
         return Status_Acquire::SUCCESS;
     }
+
+    // Take the lowest free device from the pool, only the acquire itself goes to the driver
+    Status_Acquire open_any_controller() {
+        if (controller != nullptr) {
+            return Status_Acquire::DEVICE_ALREADY_ACQUIRED;
+        }
+        if (pool == nullptr) {
+            return Status_Acquire::NO_FREE_DEVICES;
+        }
+
+        // NOTE: Another program can hold a device we think is free, those are skipped until nothing else is
+        //       Probing then also picks up devices added since the server started
+        if (pool->get_total_free() == 0) {
+            pool->probe();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        while (true) {
+            const uint8_t id = pool->peek_free();
+            if (id == 0) {
+                break;
+            }
+            if (!vjoy::device_acquire(vjoy::Device_ID(id))) {
+                pool->set_external(id);
+                continue;
+            }
+            controller = std::make_unique<Controller>(vjoy::Device_ID(id));
+            pool->set_taken(id);
+            pool->record_acquire(std::chrono::steady_clock::now() - start);
+            return Status_Acquire::SUCCESS;
+        }
+        return Status_Acquire::NO_FREE_DEVICES;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "device_capabilities.hpp"
+#include "packets.hpp"
+#include "utility/logger.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+static AxisBounds read_axis_bounds(vjoy::Device_ID id, vjoy::Axis vjd_axis) {
+    AxisBounds axis;
+    vjoy::device_get_axis_min(id, vjd_axis, &axis.min);
+    vjoy::device_get_axis_max(id, vjd_axis, &axis.max);
+    axis.center = (axis.min + axis.max)/2;
+    axis.range = (axis.max - axis.min)/2;
+    return axis;
+}
+
+static size_t write_device_axes(const vjoy::Device_Info& info, std::array<uint8_t, 16>& axes) {
+    size_t i = 0;
+    if (info.AxisX)         axes[i++] = uint8_t(Axis::X);
+    if (info.AxisY)         axes[i++] = uint8_t(Axis::Y);
+    if (info.AxisZ)         axes[i++] = uint8_t(Axis::Z);
+    if (info.AxisXRot)      axes[i++] = uint8_t(Axis::RX);
+    if (info.AxisYRot)      axes[i++] = uint8_t(Axis::RY);
+    if (info.AxisZRot)      axes[i++] = uint8_t(Axis::RZ);
+    if (info.Slider)        axes[i++] = uint8_t(Axis::SLIDER);
+    if (info.Dial)          axes[i++] = uint8_t(Axis::DIAL);
+    if (info.Wheel)         axes[i++] = uint8_t(Axis::WHEEL);
+    if (info.Accelerator)   axes[i++] = uint8_t(Axis::ACCELERATOR);
+    if (info.Brake)         axes[i++] = uint8_t(Axis::BRAKE);
+    if (info.Clutch)        axes[i++] = uint8_t(Axis::CLUTCH);
+    if (info.Steering)      axes[i++] = uint8_t(Axis::STEERING);
+    if (info.Aileron)       axes[i++] = uint8_t(Axis::AILERON);
+    if (info.Rudder)        axes[i++] = uint8_t(Axis::RUDDER);
+    if (info.Throttle)      axes[i++] = uint8_t(Axis::THROTTLE);
+    return i;
+}
+
+// Configuration tool changes show up in the device info and button count without reading every axis
+static bool get_is_same_config(const DeviceCapabilities& caps, int total_buttons, const vjoy::Device_Info& info) {
+    std::array<uint8_t, 16> axes;
+    const size_t total_axes = write_device_axes(info, axes);
+    const auto& prev = caps.device_info;
+    return (caps.total_buttons == total_buttons) &&
+           (caps.get_axes().size() == total_axes) &&
+           std::equal(axes.begin(), axes.begin()+total_axes, caps.get_axes().begin()) &&
+           (prev.nButtons == info.nButtons) &&
+           (prev.nDiscHats == info.nDiscHats) &&
+           (prev.nContHats == info.nContHats);
+}
+
+std::shared_ptr<const DeviceCapabilities> DeviceCapabilities::read(vjoy::Device_ID id, int total_buttons, const vjoy::Device_Info& info) {
+    auto caps = std::make_shared<DeviceCapabilities>();
+    caps->axis_x            = read_axis_bounds(id, vjoy::Axis::X);
+    caps->axis_y            = read_axis_bounds(id, vjoy::Axis::Y);
+    caps->axis_z            = read_axis_bounds(id, vjoy::Axis::Z);
+    caps->axis_rx           = read_axis_bounds(id, vjoy::Axis::RX);
+    caps->axis_ry           = read_axis_bounds(id, vjoy::Axis::RY);
+    caps->axis_rz           = read_axis_bounds(id, vjoy::Axis::RZ);
+    caps->axis_slider       = read_axis_bounds(id, vjoy::Axis::SLIDER);
+    caps->axis_dial         = read_axis_bounds(id, vjoy::Axis::DIAL);
+    caps->axis_wheel        = read_axis_bounds(id, vjoy::Axis::WHEEL);
+    caps->axis_accelerator  = read_axis_bounds(id, vjoy::Axis::ACCELERATOR);
+    caps->axis_brake        = read_axis_bounds(id, vjoy::Axis::BRAKE);
+    caps->axis_clutch       = read_axis_bounds(id, vjoy::Axis::CLUTCH);
+    caps->axis_steering     = read_axis_bounds(id, vjoy::Axis::STEERING);
+    caps->axis_rudder       = read_axis_bounds(id, vjoy::Axis::RUDDER);
+    caps->axis_aileron      = read_axis_bounds(id, vjoy::Axis::AILERON);
+    caps->axis_throttle     = read_axis_bounds(id, vjoy::Axis::THROTTLE);
+    caps->total_buttons = total_buttons;
+    caps->device_info = info;
+    caps->total_axes = uint8_t(write_device_axes(info, caps->axes));
+    const auto reply = GetDevInfoResponse::write(
+        caps->dev_info_reply, caps->get_axes(),
+        uint8_t(info.nButtons), uint8_t(info.nDiscHats), uint8_t(info.nContHats)
+    );
+    caps->dev_info_reply_length = uint8_t(reply.size());
+    return caps;
+}
+
+DeviceCapabilityCache::DeviceCapabilityCache()
+:   total_hits(0), total_misses(0), total_reloads(0)
+{
+
+}
+
+// NOTE: The driver is only read outside the lock so acquiring other devices doesn't wait on it
+std::shared_ptr<const DeviceCapabilities> DeviceCapabilityCache::get(vjoy::Device_ID id) {
+    const int total_buttons = vjoy::device_get_total_buttons(id);
+    const auto info = vjoy::device_get_info(id);
+    const size_t index = size_t(id);
+    if ((index == 0) || (index > MAX_DEVICES)) {
+        return DeviceCapabilities::read(id, total_buttons, info);
+    }
+
+    std::shared_ptr<const DeviceCapabilities> entry;
+    {
+        auto lock = std::scoped_lock(mutex);
+        entry = entries[index];
+        if ((entry != nullptr) && get_is_same_config(*entry, total_buttons, info)) {
+            total_hits++;
+            return entry;
+        }
+    }
+
+    auto caps = DeviceCapabilities::read(id, total_buttons, info);
+    auto lock = std::scoped_lock(mutex);
+    if (entry != nullptr) {
+        total_reloads++;
+        log_info("vJoy device {} configuration changed, reloaded its capabilities", unsigned(index));
+    } else {
+        total_misses++;
+    }
+    // NOTE: Another thread may have read it at the same time, either copy is current
+    entries[index] = caps;
+    return caps;
+}
+
+void DeviceCapabilityCache::preload() {
+    for (uint8_t i = 1; i <= MAX_DEVICES; i++) {
+        const auto id = vjoy::Device_ID(i);
+        if (vjoy::device_is_exists(id)) {
+            get(id);
+        }
+    }
+}
+
+void DeviceCapabilityCache::write_stats(std::string& dst) const {
+    auto lock = std::scoped_lock(mutex);
+    unsigned total_cached = 0;
+    for (const auto& entry: entries) {
+        if (entry != nullptr) total_cached++;
+    }
+    char buf[160];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"device_capabilities\":{\"cached\":%u,\"hits\":%llu,\"misses\":%llu,\"reloads\":%llu}",
+        total_cached,
+        (unsigned long long)total_hits,
+        (unsigned long long)total_misses,
+        (unsigned long long)total_reloads
+    );
+    dst.append(buf, size_t(N));
+}
+
+DeviceCapabilityCache& get_device_capability_cache() {
+    // NOTE: Never destroyed so it can still be used during static destruction
+    static auto* cache = new DeviceCapabilityCache();
+    return *cache;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "vjoy.hpp"
+#include "utility/span.hpp"
+
+struct AxisBounds {
+    int32_t min;
+    int32_t max;
+    int32_t center;
+    int32_t range;
+};
+
+// What a vJoy device supports, read from the driver once and shared by every controller on it
+struct DeviceCapabilities {
+    AxisBounds axis_x;
+    AxisBounds axis_y;
+    AxisBounds axis_z;
+    AxisBounds axis_rx;
+    AxisBounds axis_ry;
+    AxisBounds axis_rz;
+    AxisBounds axis_slider;
+    AxisBounds axis_dial;
+    AxisBounds axis_wheel;
+    AxisBounds axis_accelerator;
+    AxisBounds axis_brake;
+    AxisBounds axis_clutch;
+    AxisBounds axis_steering;
+    AxisBounds axis_rudder;
+    AxisBounds axis_aileron;
+    AxisBounds axis_throttle;
+    int total_buttons;
+    vjoy::Device_Info device_info;
+    // Protocol axis ids of the axes the device has
+    std::array<uint8_t, 16> axes;
+    uint8_t total_axes;
+    // Encoded GET_DEV_INFO reply since it only changes with the device configuration
+    std::array<uint8_t, 24> dev_info_reply;
+    uint8_t dev_info_reply_length;
+
+    // NOTE: Makes 32 axis bound calls to the driver
+    static std::shared_ptr<const DeviceCapabilities> read(vjoy::Device_ID id, int total_buttons, const vjoy::Device_Info& info);
+    tcb::span<const uint8_t> get_axes() const { return tcb::span(axes).first(total_axes); }
+    tcb::span<const uint8_t> get_dev_info_reply() const { return tcb::span(dev_info_reply).first(dev_info_reply_length); }
+};
+
+// Process wide so reacquiring a device or several servers in one process never read the same device twice
+// Entries are replaced rather than modified so controllers keep a consistent copy until they are reacquired
+// NOTE: Locked since the library api acquires devices from the host's threads
+class DeviceCapabilityCache
+{
+public:
+    static constexpr uint8_t MAX_DEVICES = 16;
+private:
+    mutable std::mutex mutex;
+    std::array<std::shared_ptr<const DeviceCapabilities>, MAX_DEVICES+1> entries;
+    uint64_t total_hits;
+    uint64_t total_misses;
+    uint64_t total_reloads;
+public:
+    DeviceCapabilityCache();
+    // Checks the cached entry against the device configuration and only reads the axes if it changed
+    // NOTE: Changes made in the vJoy configuration tool are picked up the next time a device is acquired
+    std::shared_ptr<const DeviceCapabilities> get(vjoy::Device_ID id);
+    // Reads every existing device so the first acquire is as fast as the rest
+    void preload();
+    void write_stats(std::string& dst) const;
+};
+
+DeviceCapabilityCache& get_device_capability_cache();
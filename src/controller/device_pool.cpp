@@ -0,0 +1,102 @@
+#include "device_pool.hpp"
+#include "vjoy.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+DevicePool::DevicePool()
+:   total_free(0), total_acquires(0), total_acquire_us(0), max_acquire_us(0)
+{
+    free_ids.fill(0);
+    free_index.fill(0);
+    states.fill(State::MISSING);
+}
+
+// vJoy ids start at 1
+void DevicePool::probe() {
+    for (uint8_t id = 1; id <= MAX_DEVICES; id++) {
+        const bool is_exists = vjoy::device_is_exists(vjoy::Device_ID(id));
+        if (states[id] == State::TAKEN) continue;
+        if (!is_exists) {
+            if (states[id] == State::FREE) remove_free(id);
+            states[id] = State::MISSING;
+            continue;
+        }
+        if (states[id] != State::FREE) push_free(id);
+    }
+}
+
+uint8_t DevicePool::peek_free() const {
+    if (total_free == 0) {
+        return 0;
+    }
+    // NOTE: Lowest ids are at the top so clients usually get the same device back
+    return free_ids[total_free-1];
+}
+
+void DevicePool::set_taken(uint8_t device_id) {
+    if ((device_id == 0) || (device_id > MAX_DEVICES)) return;
+    if (states[device_id] == State::FREE) remove_free(device_id);
+    states[device_id] = State::TAKEN;
+}
+
+void DevicePool::set_external(uint8_t device_id) {
+    if ((device_id == 0) || (device_id > MAX_DEVICES)) return;
+    if (states[device_id] == State::TAKEN) return;
+    if (states[device_id] == State::FREE) remove_free(device_id);
+    states[device_id] = State::EXTERNAL;
+}
+
+void DevicePool::release(uint8_t device_id) {
+    if ((device_id == 0) || (device_id > MAX_DEVICES)) return;
+    if (states[device_id] != State::TAKEN) return;
+    push_free(device_id);
+}
+
+void DevicePool::push_free(uint8_t device_id) {
+    // Keep the stack ordered from highest to lowest id, there are at most 16 entries
+    uint8_t i = total_free;
+    while ((i > 0) && (free_ids[i-1] < device_id)) {
+        free_ids[i] = free_ids[i-1];
+        free_index[free_ids[i]] = i;
+        i--;
+    }
+    free_ids[i] = device_id;
+    free_index[device_id] = i;
+    total_free++;
+    states[device_id] = State::FREE;
+}
+
+void DevicePool::remove_free(uint8_t device_id) {
+    for (uint8_t i = free_index[device_id]; i+1 < total_free; i++) {
+        free_ids[i] = free_ids[i+1];
+        free_index[free_ids[i]] = i;
+    }
+    total_free--;
+}
+
+void DevicePool::record_acquire(std::chrono::steady_clock::duration elapsed) {
+    const auto us = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    total_acquires++;
+    total_acquire_us += us;
+    max_acquire_us = std::max(max_acquire_us, us);
+}
+
+void DevicePool::write_stats(std::string& dst) const {
+    unsigned total_taken = 0;
+    unsigned total_external = 0;
+    for (const auto state: states) {
+        if (state == State::TAKEN) total_taken++;
+        if (state == State::EXTERNAL) total_external++;
+    }
+    const uint64_t avg_acquire_us = (total_acquires > 0) ? (total_acquire_us / total_acquires) : 0;
+    char buf[256];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"devices\":{\"free\":%u,\"taken\":%u,\"external\":%u,"
+        "\"acquires\":%llu,\"acquire_avg_us\":%llu,\"acquire_max_us\":%llu}",
+        unsigned(total_free), total_taken, total_external,
+        (unsigned long long)total_acquires,
+        (unsigned long long)avg_acquire_us,
+        (unsigned long long)max_acquire_us
+    );
+    dst.append(buf, size_t(N));
+}
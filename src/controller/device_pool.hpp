@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <chrono>
+#include <string>
+
+// Free list of existing vJoy devices so ACQUIRE_ANY can assign one without asking the driver
+// Probed when the server starts and again once nothing is free, sessions take and return devices as they acquire and release them
+// NOTE: Only used from the event loop thread
+class DevicePool
+{
+public:
+    static constexpr uint8_t MAX_DEVICES = 16;
+    enum class State: uint8_t {
+        MISSING,
+        FREE,
+        TAKEN,
+        // Held by another program when we last tried to acquire it
+        EXTERNAL,
+    };
+private:
+    // Stack of free ids, index is the position of each id in it
+    std::array<uint8_t, MAX_DEVICES> free_ids;
+    std::array<uint8_t, MAX_DEVICES+1> free_index;
+    std::array<State, MAX_DEVICES+1> states;
+    uint8_t total_free;
+    // Time from asking the driver for a device to having its controller ready
+    uint64_t total_acquires;
+    uint64_t total_acquire_us;
+    uint64_t max_acquire_us;
+public:
+    DevicePool();
+    void probe();
+    // Returns 0 if no device is free
+    // NOTE: The device stays free until the acquire marks it taken or external
+    uint8_t peek_free() const;
+    void set_taken(uint8_t device_id);
+    // NOTE: Devices we hold stay taken since only their release can free them
+    void set_external(uint8_t device_id);
+    void release(uint8_t device_id);
+    void record_acquire(std::chrono::steady_clock::duration elapsed);
+    uint8_t get_total_free() const { return total_free; }
+    State get_state(uint8_t device_id) const {
+        return ((device_id == 0) || (device_id > MAX_DEVICES)) ? State::MISSING : states[device_id];
+    }
+    void write_stats(std::string& dst) const;
+private:
+    void push_free(uint8_t device_id);
+    void remove_free(uint8_t device_id);
+};
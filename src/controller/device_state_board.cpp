@@ -0,0 +1,109 @@
+#include "device_state_board.hpp"
+#include "controller.hpp"
+#include "packets.hpp"
+#include <algorithm>
+
+void DeviceStateBoard::attach(uint8_t device_id, const Controller* controller) {
+    auto& slot = slots[device_id];
+    slot = {};
+    slot.controller = controller;
+}
+
+void DeviceStateBoard::detach(uint8_t device_id) {
+    auto& slot = slots[device_id];
+    slot = {};
+    slot.is_released = true;
+}
+
+void DeviceStateBoard::publish_changes(ObserverPublisher* publisher) {
+    for (size_t i = 0; i < MAX_DEVICES; i++) {
+        auto& slot = slots[i];
+        const uint8_t device_id = uint8_t(i);
+        if (slot.is_released) {
+            slot.is_released = false;
+            if (publisher->has_subscribers(device_id)) {
+                publisher->publish(device_id, encode_released(device_id));
+            }
+            continue;
+        }
+        if (slot.controller == nullptr) continue;
+        const uint32_t total_updates = slot.controller->get_total_updates();
+        if (slot.is_published && (total_updates == slot.published_updates)) continue;
+        // NOTE: New observers get a snapshot so nothing needs to be tracked without subscribers
+        if (!publisher->has_subscribers(device_id)) continue;
+
+        const auto snapshot = read_snapshot(slot.controller);
+        uint16_t axis_mask = 0;
+        uint8_t button_mask = 0;
+        for (size_t j = 0; j < TOTAL_AXES; j++) {
+            if (!slot.is_published || (snapshot.axes[j] != slot.published.axes[j])) {
+                axis_mask |= uint16_t(1u << j);
+            }
+        }
+        for (size_t j = 0; j < TOTAL_BUTTON_WORDS; j++) {
+            if (!slot.is_published || (snapshot.buttons[j] != slot.published.buttons[j])) {
+                button_mask |= uint8_t(1u << j);
+            }
+        }
+        slot.published = snapshot;
+        slot.published_updates = total_updates;
+        slot.is_published = true;
+        if ((axis_mask == 0) && (button_mask == 0)) continue;
+        publisher->publish(device_id, encode_state(device_id, snapshot, axis_mask, button_mask));
+    }
+}
+
+tcb::span<const uint8_t> DeviceStateBoard::get_snapshot(uint8_t device_id) {
+    const auto& slot = slots[device_id];
+    if (slot.controller == nullptr) {
+        return encode_released(device_id);
+    }
+    constexpr uint16_t ALL_AXES = 0xFFFF;
+    constexpr uint8_t ALL_BUTTONS = 0x0F;
+    return encode_state(device_id, read_snapshot(slot.controller), ALL_AXES, ALL_BUTTONS);
+}
+
+DeviceStateBoard::Snapshot DeviceStateBoard::read_snapshot(const Controller* controller) {
+    Snapshot snapshot;
+    for (size_t i = 0; i < TOTAL_AXES; i++) {
+        const float value = std::clamp(controller->get_axis(Axis(i)), -1.0f, 1.0f);
+        snapshot.axes[i] = int16_t(value*32767.0f);
+    }
+    const auto& state = controller->get_state();
+    snapshot.buttons[0] = uint32_t(state.lButtons);
+    snapshot.buttons[1] = uint32_t(state.lButtonsEx1);
+    snapshot.buttons[2] = uint32_t(state.lButtonsEx2);
+    snapshot.buttons[3] = uint32_t(state.lButtonsEx3);
+    return snapshot;
+}
+
+// Only fields in the masks are encoded, in order of their bit
+tcb::span<const uint8_t> DeviceStateBoard::encode_state(uint8_t device_id, const Snapshot& snapshot, uint16_t axis_mask, uint8_t button_mask) {
+    size_t i = 0;
+    encode_buf[i++] = uint8_t(Frame::STATE);
+    encode_buf[i++] = device_id;
+    encode_buf[i++] = uint8_t(axis_mask);
+    encode_buf[i++] = uint8_t(axis_mask >> 8);
+    encode_buf[i++] = button_mask;
+    for (size_t j = 0; j < TOTAL_AXES; j++) {
+        if (!(axis_mask & (1u << j))) continue;
+        const auto value = uint16_t(snapshot.axes[j]);
+        encode_buf[i++] = uint8_t(value);
+        encode_buf[i++] = uint8_t(value >> 8);
+    }
+    for (size_t j = 0; j < TOTAL_BUTTON_WORDS; j++) {
+        if (!(button_mask & (1u << j))) continue;
+        const uint32_t value = snapshot.buttons[j];
+        encode_buf[i++] = uint8_t(value);
+        encode_buf[i++] = uint8_t(value >> 8);
+        encode_buf[i++] = uint8_t(value >> 16);
+        encode_buf[i++] = uint8_t(value >> 24);
+    }
+    return tcb::span(encode_buf).first(i);
+}
+
+tcb::span<const uint8_t> DeviceStateBoard::encode_released(uint8_t device_id) {
+    encode_buf[0] = uint8_t(Frame::RELEASED);
+    encode_buf[1] = device_id;
+    return tcb::span(encode_buf).first(2);
+}
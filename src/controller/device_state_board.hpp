@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include "utility/span.hpp"
+#include "server/observer.hpp"
+
+class Controller;
+
+// Applied state of every acquired device for observers, the channel is the device id
+// Sessions only register their controller here, changes are detected from the update count
+// Refer to packets.txt for the frame layout
+class DeviceStateBoard: public ObserverSource
+{
+public:
+    static constexpr size_t MAX_DEVICES = 256;
+    static constexpr size_t TOTAL_AXES = 16;
+    static constexpr size_t TOTAL_BUTTON_WORDS = 4;
+    enum class Frame: uint8_t {
+        STATE    = 0x00,
+        RELEASED = 0x01,
+    };
+private:
+    struct Snapshot {
+        std::array<int16_t, TOTAL_AXES> axes;
+        std::array<uint32_t, TOTAL_BUTTON_WORDS> buttons;
+    };
+    struct Slot {
+        const Controller* controller = nullptr;
+        bool is_released = false;
+        bool is_published = false;
+        uint32_t published_updates = 0;
+        Snapshot published;
+    };
+    std::array<Slot, MAX_DEVICES> slots;
+    std::array<uint8_t, 5 + TOTAL_AXES*2 + TOTAL_BUTTON_WORDS*4> encode_buf;
+public:
+    void attach(uint8_t device_id, const Controller* controller);
+    void detach(uint8_t device_id);
+    void publish_changes(ObserverPublisher* publisher) override;
+    tcb::span<const uint8_t> get_snapshot(uint8_t device_id) override;
+private:
+    static Snapshot read_snapshot(const Controller* controller);
+    tcb::span<const uint8_t> encode_state(uint8_t device_id, const Snapshot& snapshot, uint16_t axis_mask, uint8_t button_mask);
+    tcb::span<const uint8_t> encode_released(uint8_t device_id);
+};
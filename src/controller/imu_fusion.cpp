@@ -0,0 +1,138 @@
+#include "imu_fusion.hpp"
+#include "packet_codec.hpp"
+#include <math.h>
+
+static constexpr float PI = 3.14159265358979f;
+static constexpr float DEG_TO_RAD = PI/180.0f;
+static constexpr size_t TOTAL_INPUT_AXES = 16;
+
+ImuFusion::ImuFusion()
+:   q0(1.0f), q1(0.0f), q2(0.0f), q3(0.0f),
+    r0(1.0f), r1(0.0f), r2(0.0f), r3(0.0f),
+    is_initialised(false), is_recenter(true)
+{
+
+}
+
+bool ImuFusion::configure(const Params& _params) {
+    for (const uint8_t axis: _params.axes) {
+        if ((axis != AXIS_DISABLED) && (size_t(axis) >= TOTAL_INPUT_AXES)) return false;
+    }
+    if ((_params.range_deg < 1.0f) || (_params.range_deg > 180.0f)) return false;
+    if ((_params.beta < 0.0f) || (_params.beta > 1.0f)) return false;
+    params = _params;
+    is_recenter = true;
+    return true;
+}
+
+bool ImuFusion::is_enabled() const {
+    for (const uint8_t axis: params.axes) {
+        if (axis != AXIS_DISABLED) return true;
+    }
+    return false;
+}
+
+bool ImuFusion::process(tcb::span<const uint8_t> samples, float interval_s) {
+    if ((samples.size() % SAMPLE_SIZE) != 0) return false;
+    if (samples.size() > SAMPLE_SIZE*MAX_SAMPLES) return false;
+
+    constexpr float GYRO_SCALE = 0.1f*DEG_TO_RAD;
+    constexpr float ACCEL_SCALE = 1e-3f;
+    for (size_t i = 0; i < samples.size(); i += SAMPLE_SIZE) {
+        const auto sample = samples.subspan(i, SAMPLE_SIZE);
+        float values[6];
+        for (size_t j = 0; j < 6; j++) {
+            values[j] = float(int16_t(read_packet_u16(sample.subspan(j*2))));
+        }
+        const float gx = values[0]*GYRO_SCALE, gy = values[1]*GYRO_SCALE, gz = values[2]*GYRO_SCALE;
+        const float ax = values[3]*ACCEL_SCALE, ay = values[4]*ACCEL_SCALE, az = values[5]*ACCEL_SCALE;
+        if (!is_initialised) {
+            initialise(ax, ay, az);
+            continue;
+        }
+        update(gx, gy, gz, ax, ay, az, interval_s);
+    }
+
+    if (is_initialised && is_recenter) {
+        r0 = q0; r1 = -q1; r2 = -q2; r3 = -q3;
+        is_recenter = false;
+    }
+    return true;
+}
+
+// Start from the tilt given by gravity instead of converging to it from level
+void ImuFusion::initialise(float ax, float ay, float az) {
+    if ((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f)) return;
+    const float roll = atan2f(ay, az);
+    const float pitch = atan2f(-ax, sqrtf(ay*ay + az*az));
+    const float cr = cosf(roll*0.5f), sr = sinf(roll*0.5f);
+    const float cp = cosf(pitch*0.5f), sp = sinf(pitch*0.5f);
+    q0 = cr*cp;
+    q1 = sr*cp;
+    q2 = cr*sp;
+    q3 = -sr*sp;
+    is_initialised = true;
+}
+
+// Refer to "An efficient orientation filter for inertial and inertial/magnetic sensor arrays", S. Madgwick 2010
+// Gyro integration is corrected by a gradient descent step towards the attitude the accelerometer gives
+void ImuFusion::update(float gx, float gy, float gz, float ax, float ay, float az, float dt) {
+    float qdot0 = 0.5f*(-q1*gx - q2*gy - q3*gz);
+    float qdot1 = 0.5f*( q0*gx + q2*gz - q3*gy);
+    float qdot2 = 0.5f*( q0*gy - q1*gz + q3*gx);
+    float qdot3 = 0.5f*( q0*gz + q1*gy - q2*gx);
+
+    // NOTE: Free fall or a dropped sample gives no gravity reference
+    const float accel_norm = sqrtf(ax*ax + ay*ay + az*az);
+    if (accel_norm > 0.0f) {
+        ax /= accel_norm;
+        ay /= accel_norm;
+        az /= accel_norm;
+
+        const float _2q0 = 2.0f*q0, _2q1 = 2.0f*q1, _2q2 = 2.0f*q2, _2q3 = 2.0f*q3;
+        const float _4q0 = 4.0f*q0, _4q1 = 4.0f*q1, _4q2 = 4.0f*q2;
+        const float _8q1 = 8.0f*q1, _8q2 = 8.0f*q2;
+        const float q0q0 = q0*q0, q1q1 = q1*q1, q2q2 = q2*q2, q3q3 = q3*q3;
+
+        float s0 = _4q0*q2q2 + _2q2*ax + _4q0*q1q1 - _2q1*ay;
+        float s1 = _4q1*q3q3 - _2q3*ax + 4.0f*q0q0*q1 - _2q0*ay - _4q1 + _8q1*q1q1 + _8q1*q2q2 + _4q1*az;
+        float s2 = 4.0f*q0q0*q2 + _2q0*ax + _4q2*q3q3 - _2q3*ay - _4q2 + _8q2*q1q1 + _8q2*q2q2 + _4q2*az;
+        float s3 = 4.0f*q1q1*q3 - _2q1*ax + 4.0f*q2q2*q3 - _2q2*ay;
+        const float step_norm = sqrtf(s0*s0 + s1*s1 + s2*s2 + s3*s3);
+        if (step_norm > 0.0f) {
+            const float k = params.beta/step_norm;
+            qdot0 -= k*s0;
+            qdot1 -= k*s1;
+            qdot2 -= k*s2;
+            qdot3 -= k*s3;
+        }
+    }
+
+    q0 += qdot0*dt;
+    q1 += qdot1*dt;
+    q2 += qdot2*dt;
+    q3 += qdot3*dt;
+    const float q_norm = sqrtf(q0*q0 + q1*q1 + q2*q2 + q3*q3);
+    q0 /= q_norm;
+    q1 /= q_norm;
+    q2 /= q_norm;
+    q3 /= q_norm;
+}
+
+float ImuFusion::get_output(Angle angle) const {
+    // Attitude relative to the centered one
+    const float w = r0*q0 - r1*q1 - r2*q2 - r3*q3;
+    const float x = r0*q1 + r1*q0 + r2*q3 - r3*q2;
+    const float y = r0*q2 - r1*q3 + r2*q0 + r3*q1;
+    const float z = r0*q3 + r1*q2 - r2*q1 + r3*q0;
+
+    float value = 0.0f;
+    switch (angle) {
+    case ROLL:  value = atan2f(2.0f*(w*x + y*z), 1.0f - 2.0f*(x*x + y*y)); break;
+    case PITCH: value = asinf(fminf(fmaxf(2.0f*(w*y - z*x), -1.0f), 1.0f)); break;
+    case YAW:   value = atan2f(2.0f*(w*z + x*y), 1.0f - 2.0f*(y*y + z*z)); break;
+    default:    break;
+    }
+    value /= params.range_deg*DEG_TO_RAD;
+    return fminf(fmaxf(value, -1.0f), 1.0f);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "utility/span.hpp"
+
+// Madgwick filter that fuses phone gyroscope and accelerometer samples into an attitude
+// Roll, pitch and yaw relative to the attitude when it was last centered are mapped onto input axes
+// NOTE: There is no magnetometer so yaw slowly drifts, clients recenter to correct it
+class ImuFusion
+{
+public:
+    // Packed sample from IMU_SAMPLES, all values are i16 little endian
+    // gyro is 0.1 deg/s around x, y, z and accel is mm/s^2 including gravity
+    static constexpr size_t SAMPLE_SIZE = 12;
+    static constexpr size_t MAX_SAMPLES = 32;
+    static constexpr uint8_t AXIS_DISABLED = 0xFF;
+    enum Angle {
+        ROLL, PITCH, YAW, TOTAL_ANGLES,
+    };
+
+    struct Params {
+        // Input axis id for each angle or AXIS_DISABLED
+        uint8_t axes[TOTAL_ANGLES] = { AXIS_DISABLED, AXIS_DISABLED, AXIS_DISABLED };
+        // Angle which gives full deflection
+        float range_deg = 45.0f;
+        // Filter gain, higher follows the accelerometer faster but lets more vibration through
+        float beta = 0.1f;
+    };
+private:
+    Params params;
+    // Attitude as a quaternion and the inverse of the centered attitude
+    float q0, q1, q2, q3;
+    float r0, r1, r2, r3;
+    bool is_initialised;
+    bool is_recenter;
+public:
+    ImuFusion();
+    // Returns false if the parameters are out of range
+    bool configure(const Params& params);
+    bool is_enabled() const;
+    uint8_t get_axis(Angle angle) const { return params.axes[angle]; }
+    // Returns false if the samples aren't a whole number of packed samples
+    bool process(tcb::span<const uint8_t> samples, float interval_s);
+    // Centers the axes on the next sample
+    void recenter() { is_recenter = true; }
+    // Normalised between -1 and 1 using the configured range
+    float get_output(Angle angle) const;
+private:
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    void initialise(float ax, float ay, float az);
+};
@@ -0,0 +1,383 @@
+#include "input_profile.hpp"
+#include "controller.hpp"
+#include "packets.hpp"
+#include "utility/logger.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static bool parse_axis(const std::string& str, uint8_t& axis_id) {
+    if (str == "none") {
+        axis_id = InputProfile::DROPPED;
+        return true;
+    }
+    for (size_t i = 0; i < InputProfile::TOTAL_AXES; i++) {
+        if (str == axis_names[i]) {
+            axis_id = uint8_t(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_button(const std::string& str, uint8_t& button_id) {
+    if (str == "none") {
+        button_id = InputProfile::DROPPED;
+        return true;
+    }
+    char* end = nullptr;
+    const long value = strtol(str.c_str(), &end, 10);
+    if (str.empty() || (*end != '\0') || (value < 0) || (value >= long(InputProfile::TOTAL_BUTTONS))) {
+        return false;
+    }
+    button_id = uint8_t(value);
+    return true;
+}
+
+// NOTE: Names are written into the stats json unescaped so they are limited to characters that don't need it
+static bool get_is_valid_name(const std::string& name) {
+    constexpr size_t MAX_NAME_LENGTH = 64;
+    if (name.empty() || (name.size() > MAX_NAME_LENGTH)) return false;
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return isalnum(static_cast<unsigned char>(c)) || (c == '_') || (c == '-') || (c == '.');
+    });
+}
+
+InputProfile::InputProfile() {
+    for (size_t i = 0; i < TOTAL_AXES; i++) {
+        axis_routes[i].total_targets = 1;
+        axis_routes[i].targets[0].output = uint8_t(i);
+        axis_sources[i] = uint16_t(1u << i);
+    }
+    for (size_t i = 0; i < TOTAL_BUTTONS; i++) {
+        button_routes[i] = uint8_t(i);
+    }
+}
+
+// Rules only list inputs that are remapped so the profile is compiled in two passes
+// Unlisted inputs pass through unless their output is used by a rule, then they are dropped
+struct ProfileBuilder {
+    InputProfile profile;
+    uint16_t listed_axes = 0;
+    uint16_t targeted_axes = 0;
+    std::array<bool, InputProfile::TOTAL_BUTTONS> listed_buttons = {};
+    std::array<bool, InputProfile::TOTAL_BUTTONS> targeted_buttons = {};
+
+    ProfileBuilder(const std::string& name) {
+        profile.name = name;
+        for (auto& route: profile.axis_routes) {
+            route.total_targets = 0;
+        }
+    }
+
+    bool add_axis_target(uint8_t input, InputProfile::AxisTarget target) {
+        auto& route = profile.axis_routes[input];
+        listed_axes |= uint16_t(1u << input);
+        if (target.output == InputProfile::DROPPED) return true;
+        if (route.total_targets >= route.targets.size()) return false;
+        route.targets[route.total_targets++] = target;
+        targeted_axes |= uint16_t(1u << target.output);
+        return true;
+    }
+
+    bool add_button(uint8_t input, uint8_t output) {
+        if (listed_buttons[input]) return false;
+        listed_buttons[input] = true;
+        profile.button_routes[input] = output;
+        if (output != InputProfile::DROPPED) {
+            targeted_buttons[output] = true;
+        }
+        return true;
+    }
+
+    std::shared_ptr<const InputProfile> build() {
+        targeted_axes |= profile.mixer.get_output_mask();
+        for (uint8_t i = 0; i < InputProfile::TOTAL_AXES; i++) {
+            const uint16_t mask = uint16_t(1u << i);
+            if ((listed_axes & mask) || (targeted_axes & mask)) continue;
+            auto& route = profile.axis_routes[i];
+            route.total_targets = 1;
+            route.targets[0] = {};
+            route.targets[0].output = i;
+        }
+        profile.axis_sources.fill(0);
+        for (uint8_t i = 0; i < InputProfile::TOTAL_AXES; i++) {
+            const auto& route = profile.axis_routes[i];
+            for (uint8_t j = 0; j < route.total_targets; j++) {
+                profile.axis_sources[route.targets[j].output] |= uint16_t(1u << i);
+            }
+        }
+        for (uint8_t i = 0; i < InputProfile::TOTAL_AXES; i++) {
+            if (profile.mixer.get_output_mask() & (1u << i)) {
+                profile.axis_sources[i] = 0;
+            }
+        }
+        for (size_t i = 0; i < InputProfile::TOTAL_BUTTONS; i++) {
+            if (listed_buttons[i]) continue;
+            profile.button_routes[i] = targeted_buttons[i] ? InputProfile::DROPPED : uint8_t(i);
+        }
+        return std::make_shared<const InputProfile>(profile);
+    }
+};
+
+ProfileRegistry::ProfileRegistry()
+:   generation(0)
+{
+
+}
+
+bool ProfileRegistry::load(const char* _filepath, std::string& error) {
+    filepath = std::filesystem::path(_filepath);
+    return reload(error);
+}
+
+bool ProfileRegistry::reload(std::string& error) {
+    std::error_code ec;
+    const auto write_time = std::filesystem::last_write_time(filepath, ec);
+    std::ifstream file(filepath);
+    if (ec || !file.is_open()) {
+        error = "Failed to open file";
+        return false;
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<const InputProfile>> new_profiles;
+    std::vector<std::pair<uint8_t, std::string>> new_devices;
+    std::unique_ptr<ProfileBuilder> builder = nullptr;
+    auto finish_profile = [&]() {
+        if (builder == nullptr) return;
+        new_profiles[builder->profile.name] = builder->build();
+        builder = nullptr;
+    };
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        std::vector<std::string> args;
+        for (std::string arg; stream >> arg;) {
+            args.push_back(arg);
+        }
+        if (args.empty()) continue;
+
+        const auto& command = args[0];
+        bool is_valid = false;
+        if ((command == "profile") && (args.size() == 2)) {
+            finish_profile();
+            builder = std::make_unique<ProfileBuilder>(args[1]);
+            is_valid = get_is_valid_name(args[1]);
+        } else if ((command == "device") && (args.size() == 3)) {
+            const int device_id = atoi(args[1].c_str());
+            is_valid = (device_id >= 1) && (device_id <= 255);
+            new_devices.push_back({uint8_t(device_id), args[2]});
+        } else if (builder == nullptr) {
+            is_valid = false;
+        } else if ((command == "axis") && ((args.size() == 3) || ((args.size() == 4) && (args[3] == "invert")))) {
+            uint8_t input, output;
+            InputProfile::AxisTarget target;
+            is_valid = parse_axis(args[1], input) && parse_axis(args[2], output) && (input != InputProfile::DROPPED);
+            target.output = output;
+            target.scale = (args.size() == 4) ? -1.0f : 1.0f;
+            is_valid = is_valid && builder->add_axis_target(input, target);
+        } else if ((command == "split") && (args.size() == 4)) {
+            // Negative half drives the first output and positive half the second, each over their full range
+            uint8_t input, negative, positive;
+            is_valid = parse_axis(args[1], input) && parse_axis(args[2], negative) && parse_axis(args[3], positive);
+            is_valid = is_valid && (input != InputProfile::DROPPED);
+            if (is_valid) {
+                InputProfile::AxisTarget target;
+                target.output = negative;
+                target.in_min = -1.0f; target.in_max = 0.0f; target.scale = -2.0f; target.offset = -1.0f;
+                is_valid = builder->add_axis_target(input, target);
+                target.output = positive;
+                target.in_min = 0.0f; target.in_max = 1.0f; target.scale = 2.0f; target.offset = -1.0f;
+                is_valid = is_valid && builder->add_axis_target(input, target);
+            }
+        } else if ((command == "merge") && (args.size() == 4)) {
+            // output = (a-b)/2, e.g. two pedals into one rudder axis
+            uint8_t input_a, input_b, output;
+            is_valid = parse_axis(args[1], input_a) && parse_axis(args[2], input_b) && parse_axis(args[3], output);
+            is_valid = is_valid && (input_a != InputProfile::DROPPED) && (input_b != InputProfile::DROPPED) && (input_a != input_b);
+            if (is_valid) {
+                InputProfile::AxisTarget target;
+                target.output = output;
+                target.scale = 0.5f;
+                is_valid = builder->add_axis_target(input_a, target);
+                target.scale = -0.5f;
+                is_valid = is_valid && builder->add_axis_target(input_b, target);
+            }
+        } else if ((command == "mix") && (args.size() >= 4) && (args[2] == "=")) {
+            uint8_t output;
+            const auto expression = line.substr(line.find_first_not_of(" \t", line.find('=')+1));
+            is_valid = parse_axis(args[1], output) && (output != InputProfile::DROPPED);
+            if (is_valid && !builder->profile.mixer.add(output, expression, error)) {
+                error = "Line " + std::to_string(line_number) + ": " + error + " in '" + expression + "'";
+                return false;
+            }
+        } else if ((command == "button") && (args.size() == 3)) {
+            uint8_t input, output;
+            is_valid = parse_button(args[1], input) && parse_button(args[2], output) && (input != InputProfile::DROPPED);
+            is_valid = is_valid && builder->add_button(input, output);
+        }
+
+        if (!is_valid) {
+            error = "Line " + std::to_string(line_number) + ": Invalid profile rule '" + line + "'";
+            return false;
+        }
+    }
+    finish_profile();
+
+    std::array<std::string, 256> new_device_profiles;
+    for (const auto& [device_id, name]: new_devices) {
+        if (new_profiles.find(name) == new_profiles.end()) {
+            error = "Device " + std::to_string(device_id) + " uses unknown profile '" + name + "'";
+            return false;
+        }
+        new_device_profiles[device_id] = name;
+    }
+
+    profiles = std::move(new_profiles);
+    device_profiles = std::move(new_device_profiles);
+    last_write_time = write_time;
+    generation++;
+    log_info("Loaded {} profiles from {}", profiles.size(), filepath.filename().string());
+    return true;
+}
+
+void ProfileRegistry::check_for_changes() {
+    if (filepath.empty()) return;
+    std::error_code ec;
+    const auto write_time = std::filesystem::last_write_time(filepath, ec);
+    if (ec || (write_time == last_write_time)) return;
+    // NOTE: Only retried once the file changes again
+    last_write_time = write_time;
+    std::string error;
+    if (!reload(error)) {
+        log_error("Kept the current profiles, reload failed: {}", error);
+    }
+}
+
+std::shared_ptr<const InputProfile> ProfileRegistry::find(const std::string& name) const {
+    auto it = profiles.find(name);
+    if (it == profiles.end()) return nullptr;
+    return it->second;
+}
+
+ProfileMapper::ProfileMapper()
+:   profile(nullptr)
+{
+    reset();
+}
+
+void ProfileMapper::reset() {
+    input_axes.fill(0.0f);
+    input_buttons.fill(0);
+    output_presses.fill(0);
+}
+
+void ProfileMapper::set_profile(std::shared_ptr<const InputProfile> _profile, Controller* controller) {
+    profile = std::move(_profile);
+    output_presses.fill(0);
+    if (controller == nullptr) return;
+
+    for (uint8_t i = 0; i < InputProfile::TOTAL_AXES; i++) {
+        if (profile == nullptr) {
+            controller->set_axis(Axis(i), input_axes[i]);
+        } else {
+            update_axis_output(controller, i);
+        }
+    }
+    for (size_t i = 0; i < InputProfile::TOTAL_BUTTONS; i++) {
+        controller->set_button(uint8_t(i), false);
+    }
+    for (size_t i = 0; i < InputProfile::TOTAL_BUTTONS; i++) {
+        const bool is_pressed = (input_buttons[i/32] >> (i%32)) & 0b1;
+        if (!is_pressed) continue;
+        const uint8_t output = (profile == nullptr) ? uint8_t(i) : profile->button_routes[i];
+        if (output == InputProfile::DROPPED) continue;
+        output_presses[output]++;
+        controller->set_button(output, true);
+    }
+    if (profile != nullptr) {
+        update_mixer_outputs(controller);
+    }
+}
+
+bool ProfileMapper::set_axis(Controller* controller, uint8_t axis_id, float value) {
+    if (axis_id >= InputProfile::TOTAL_AXES) {
+        return false;
+    }
+    input_axes[axis_id] = value;
+    if (profile == nullptr) {
+        return controller->set_axis(Axis(axis_id), value);
+    }
+    const auto& route = profile->axis_routes[axis_id];
+    for (uint8_t i = 0; i < route.total_targets; i++) {
+        update_axis_output(controller, route.targets[i].output);
+    }
+    update_mixer_outputs(controller);
+    return true;
+}
+
+void ProfileMapper::update_mixer_outputs(Controller* controller) {
+    const auto& mixer = profile->mixer;
+    if (mixer.is_empty()) {
+        return;
+    }
+    float results[InputProfile::TOTAL_AXES];
+    mixer.evaluate(input_axes.data(), input_buttons.data(), results);
+    for (uint8_t i = 0; i < InputProfile::TOTAL_AXES; i++) {
+        if (mixer.get_output_mask() & (1u << i)) {
+            controller->set_axis(Axis(i), results[i]);
+        }
+    }
+}
+
+// Sum of the contribution of every input routed to this output
+void ProfileMapper::update_axis_output(Controller* controller, uint8_t output) {
+    const uint16_t sources = profile->axis_sources[output];
+    if (sources == 0) {
+        return;
+    }
+    float value = 0.0f;
+    for (uint8_t input = 0; input < InputProfile::TOTAL_AXES; input++) {
+        if (!(sources & (1u << input))) continue;
+        const auto& route = profile->axis_routes[input];
+        for (uint8_t i = 0; i < route.total_targets; i++) {
+            const auto& target = route.targets[i];
+            if (target.output != output) continue;
+            value += std::clamp(input_axes[input], target.in_min, target.in_max)*target.scale + target.offset;
+        }
+    }
+    controller->set_axis(Axis(output), std::clamp(value, -1.0f, 1.0f));
+}
+
+void ProfileMapper::set_button(Controller* controller, uint8_t button_id, bool is_pressed) {
+    if (button_id >= InputProfile::TOTAL_BUTTONS) {
+        return;
+    }
+    auto& word = input_buttons[button_id/32];
+    const uint32_t mask = uint32_t(1) << (button_id%32);
+    const bool was_pressed = (word & mask) != 0;
+    word = is_pressed ? (word | mask) : (word & ~mask);
+    if (profile == nullptr) {
+        controller->set_button(button_id, is_pressed);
+        return;
+    }
+    if (was_pressed == is_pressed) {
+        return;
+    }
+    update_mixer_outputs(controller);
+    const uint8_t output = profile->button_routes[button_id];
+    if (output == InputProfile::DROPPED) {
+        return;
+    }
+    auto& presses = output_presses[output];
+    presses = is_pressed ? presses+1 : presses-1;
+    controller->set_button(output, presses > 0);
+}
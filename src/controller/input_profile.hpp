@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <filesystem>
+#include "mixer.hpp"
+
+class Controller;
+
+// Remapping profile compiled into flat tables indexed by input id
+// Refer to docs/profiles_example.txt for the file format
+struct InputProfile {
+    static constexpr size_t TOTAL_AXES = 16;
+    static constexpr size_t TOTAL_BUTTONS = 128;
+    static constexpr uint8_t DROPPED = 0xFF;
+
+    // output = clamp(input, in_min, in_max)*scale + offset
+    struct AxisTarget {
+        uint8_t output = DROPPED;
+        float in_min = -1.0f;
+        float in_max = 1.0f;
+        float scale = 1.0f;
+        float offset = 0.0f;
+    };
+    // An input can be split into 2 outputs
+    struct AxisRoute {
+        uint8_t total_targets = 0;
+        std::array<AxisTarget, 2> targets;
+    };
+
+    std::string name;
+    std::array<AxisRoute, TOTAL_AXES> axis_routes;
+    // Mask of inputs that contribute to each output, more than one is a merge
+    std::array<uint16_t, TOTAL_AXES> axis_sources;
+    std::array<uint8_t, TOTAL_BUTTONS> button_routes;
+    // Mixed outputs replace any routes to them
+    Mixer mixer;
+
+    // Identity mapping
+    InputProfile();
+};
+
+// Profiles loaded from a file which is reloaded when it changes
+// NOTE: Sessions compare the generation on each packet so they pick up reloads without reconnecting
+class ProfileRegistry
+{
+private:
+    std::filesystem::path filepath;
+    std::filesystem::file_time_type last_write_time;
+    std::unordered_map<std::string, std::shared_ptr<const InputProfile>> profiles;
+    std::array<std::string, 256> device_profiles;
+    uint32_t generation;
+public:
+    ProfileRegistry();
+    ProfileRegistry(const ProfileRegistry&) = delete;
+    ProfileRegistry(ProfileRegistry&&) = delete;
+    ProfileRegistry& operator=(const ProfileRegistry&) = delete;
+    ProfileRegistry& operator=(ProfileRegistry&&) = delete;
+
+    // Error is set to the line that failed and why
+    bool load(const char* _filepath, std::string& error);
+    // Reloads the file if it changed, the current profiles are kept if it's invalid
+    void check_for_changes();
+    uint32_t get_generation() const { return generation; }
+    // Returns nullptr if the profile doesn't exist
+    std::shared_ptr<const InputProfile> find(const std::string& name) const;
+    const std::string& get_device_profile(uint8_t device_id) const { return device_profiles[device_id]; }
+private:
+    bool reload(std::string& error);
+};
+
+// Applies a profile to a session's input
+// Keeps the unmapped input so outputs can be rebuilt when the profile changes
+class ProfileMapper
+{
+private:
+    std::shared_ptr<const InputProfile> profile;
+    std::array<float, InputProfile::TOTAL_AXES> input_axes;
+    std::array<uint32_t, InputProfile::TOTAL_BUTTONS/32> input_buttons;
+    // Buttons merged into one output are pressed while any input is pressed
+    std::array<uint8_t, InputProfile::TOTAL_BUTTONS> output_presses;
+public:
+    ProfileMapper();
+    // Rebuilds every output of the controller from the input
+    void set_profile(std::shared_ptr<const InputProfile> _profile, Controller* controller);
+    const InputProfile* get_profile() const { return profile.get(); }
+    bool set_axis(Controller* controller, uint8_t axis_id, float value);
+    void set_button(Controller* controller, uint8_t button_id, bool is_pressed);
+    void reset();
+private:
+    void update_axis_output(Controller* controller, uint8_t output);
+    void update_mixer_outputs(Controller* controller);
+};
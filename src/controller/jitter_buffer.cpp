@@ -0,0 +1,140 @@
+#include "jitter_buffer.hpp"
+#include <stdlib.h>
+#include <algorithm>
+
+using std::chrono::microseconds;
+using std::chrono::duration_cast;
+
+JitterBuffer::JitterBuffer(TaskScheduler* _scheduler, Callback _on_playout)
+:   scheduler(_scheduler), on_playout(std::move(_on_playout)),
+    task(TaskScheduler::INVALID_TASK),
+    is_enabled(true), min_delay_us(0), max_delay_us(40*1000),
+    epoch(Clock::now()), is_synced(false), last_client_time(0), client_time_us(0),
+    last_transit_us(0), jitter_us(0.0f),
+    window_min_transit_us(0), prev_window_min_transit_us(0)
+{
+
+}
+
+JitterBuffer::~JitterBuffer() {
+    if (task != TaskScheduler::INVALID_TASK) {
+        scheduler->cancel(task);
+    }
+}
+
+bool JitterBuffer::configure(bool _is_enabled, uint16_t min_delay_ms, uint16_t max_delay_ms) {
+    if (min_delay_ms > max_delay_ms) {
+        return false;
+    }
+    is_enabled = _is_enabled;
+    min_delay_us = int64_t(min_delay_ms)*1000;
+    max_delay_us = int64_t(max_delay_ms)*1000;
+    if (!is_enabled) {
+        flush();
+    }
+    return true;
+}
+
+bool JitterBuffer::push(uint32_t client_time, tcb::span<const uint8_t> packet) {
+    const auto now = Clock::now();
+    update_estimate(client_time, now);
+    if (!is_enabled || (scheduler == nullptr) || (packet.size() > MAX_PACKET_SIZE)) {
+        return false;
+    }
+
+    const int64_t min_transit_us = std::min(window_min_transit_us, prev_window_min_transit_us);
+    auto playout = epoch + microseconds(client_time_us + min_transit_us + get_delay_us());
+    // NOTE: Packets are never reordered even if the estimate moves backwards
+    if (!queue.empty()) {
+        playout = std::max(playout, queue.back().playout);
+    }
+    if (queue.empty() && (playout <= now)) {
+        return false;
+    }
+
+    if (queue.full()) {
+        pop_front();
+    }
+    Entry entry;
+    entry.playout = playout;
+    entry.length = uint8_t(packet.size());
+    std::copy(packet.begin(), packet.end(), entry.data.begin());
+    queue.push_back(entry);
+    if (task == TaskScheduler::INVALID_TASK) {
+        schedule_front();
+    }
+    return true;
+}
+
+void JitterBuffer::flush() {
+    if (task != TaskScheduler::INVALID_TASK) {
+        scheduler->cancel(task);
+        task = TaskScheduler::INVALID_TASK;
+    }
+    while (!queue.empty()) {
+        pop_front();
+    }
+}
+
+int64_t JitterBuffer::get_delay_us() const {
+    const int64_t delay_us = int64_t(jitter_us*JITTER_MULTIPLIER);
+    return std::clamp(delay_us, min_delay_us, max_delay_us);
+}
+
+// Interarrival jitter estimate from RFC 3550 section 6.4.1
+void JitterBuffer::update_estimate(uint32_t client_time, Clock::time_point now) {
+    // NOTE: Client time is a wrapping u32 in microseconds so we unwrap it with the signed difference
+    if (is_synced) {
+        client_time_us += int32_t(client_time - last_client_time);
+    } else {
+        client_time_us = int64_t(client_time);
+    }
+    last_client_time = client_time;
+
+    const int64_t now_us = duration_cast<microseconds>(now - epoch).count();
+    const int64_t transit_us = now_us - client_time_us;
+    if (!is_synced) {
+        is_synced = true;
+        last_transit_us = transit_us;
+        window_min_transit_us = transit_us;
+        prev_window_min_transit_us = transit_us;
+        window_start = now;
+        return;
+    }
+
+    const int64_t D = transit_us - last_transit_us;
+    last_transit_us = transit_us;
+    jitter_us += (float(llabs(D)) - jitter_us) / 16.0f;
+
+    if (now - window_start >= std::chrono::milliseconds(TRANSIT_WINDOW_MS)) {
+        prev_window_min_transit_us = window_min_transit_us;
+        window_min_transit_us = transit_us;
+        window_start = now;
+    } else {
+        window_min_transit_us = std::min(window_min_transit_us, transit_us);
+    }
+}
+
+void JitterBuffer::on_timer() {
+    task = TaskScheduler::INVALID_TASK;
+    const auto now = Clock::now();
+    // NOTE: Front is due since the timer was set for it
+    pop_front();
+    while (!queue.empty() && (queue.front().playout <= now)) {
+        pop_front();
+    }
+    schedule_front();
+}
+
+void JitterBuffer::schedule_front() {
+    if (queue.empty()) return;
+    task = scheduler->schedule(queue.front().playout, [this]() {
+        on_timer();
+    });
+}
+
+void JitterBuffer::pop_front() {
+    const Entry entry = queue.front();
+    queue.pop_front();
+    on_playout(tcb::span<const uint8_t>(entry.data.data(), entry.length));
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <functional>
+#include "utility/span.hpp"
+#include "utility/fixed_queue.hpp"
+#include "utility/object_pool.hpp"
+#include "server/task_scheduler.hpp"
+
+// Plays out timestamped packets with the spacing they were sent with
+// Clients on congested wifi deliver packets in clumps, so we delay each packet to
+//     playout = client_time + min_transit + delay
+// where min_transit is the fastest observed one way trip (includes the clock offset)
+// and delay adapts to the observed jitter within the configured bounds
+class JitterBuffer: public Pooled<JitterBuffer, 64>
+{
+public:
+    using Clock = TaskScheduler::Clock;
+    using Callback = std::function<void(tcb::span<const uint8_t>)>;
+    static constexpr size_t MAX_PACKET_SIZE = 16;
+    static constexpr size_t MAX_QUEUED = 64;
+    // Delay is a multiple of the mean jitter so most packets arrive before their playout
+    static constexpr float JITTER_MULTIPLIER = 4.0f;
+    // Minimum transit is tracked over two windows so clock drift is followed
+    static constexpr int TRANSIT_WINDOW_MS = 2000;
+private:
+    struct Entry {
+        Clock::time_point playout;
+        uint8_t length;
+        std::array<uint8_t, MAX_PACKET_SIZE> data;
+    };
+    TaskScheduler* const scheduler;
+    const Callback on_playout;
+    FixedQueue<Entry, MAX_QUEUED> queue;
+    TaskScheduler::TaskID task;
+    bool is_enabled;
+    int64_t min_delay_us;
+    int64_t max_delay_us;
+    // clock estimation
+    const Clock::time_point epoch;
+    bool is_synced;
+    uint32_t last_client_time;
+    int64_t client_time_us;
+    int64_t last_transit_us;
+    float jitter_us;
+    int64_t window_min_transit_us;
+    int64_t prev_window_min_transit_us;
+    Clock::time_point window_start;
+public:
+    JitterBuffer(TaskScheduler* _scheduler, Callback _on_playout);
+    ~JitterBuffer();
+    JitterBuffer(const JitterBuffer&) = delete;
+    JitterBuffer(JitterBuffer&&) = delete;
+    JitterBuffer& operator=(const JitterBuffer&) = delete;
+    JitterBuffer& operator=(JitterBuffer&&) = delete;
+
+    bool configure(bool _is_enabled, uint16_t min_delay_ms, uint16_t max_delay_ms);
+    // Returns false if the packet should be applied immediately instead
+    bool push(uint32_t client_time, tcb::span<const uint8_t> packet);
+    // Applies everything that is queued
+    void flush();
+    bool get_is_empty() const { return queue.empty(); }
+private:
+    int64_t get_delay_us() const;
+    void update_estimate(uint32_t client_time, Clock::time_point now);
+    void on_timer();
+    void schedule_front();
+    void pop_front();
+};
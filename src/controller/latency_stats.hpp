@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <chrono>
+
+// Server monotonic clock sent in clock sync replies, wraps every ~71 minutes
+inline uint32_t get_server_time_us() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+// Per session latency telemetry
+// Network latency comes from the client's clock sync estimate and timestamped packets
+// Processing latency is the time spent inside the packet handler
+struct LatencyStats {
+    struct Summary {
+        uint64_t total = 0;
+        uint32_t last_us = 0;
+        uint32_t max_us = 0;
+        // Exponential moving average that follows recent conditions
+        float mean_us = 0.0f;
+
+        void add(uint32_t value_us) {
+            constexpr float alpha = 1.0f/16.0f;
+            mean_us = (total == 0) ? float(value_us) : mean_us + (float(value_us)-mean_us)*alpha;
+            last_us = value_us;
+            max_us = (value_us > max_us) ? value_us : max_us;
+            total++;
+        }
+
+        void write_stats(std::string& dst, const char* name) const {
+            char buf[256];
+            const int N = snprintf(buf, sizeof(buf),
+                "\"%s\":{\"samples\":%llu,\"last_us\":%u,\"mean_us\":%.0f,\"max_us\":%u}",
+                name, (unsigned long long)total, last_us, mean_us, max_us
+            );
+            dst.append(buf, size_t(N));
+        }
+    };
+
+    Summary rtt;
+    Summary one_way;
+    Summary processing;
+    // server_time - client_time reported by the client, only differences are meaningful due to wrapping
+    bool is_clock_synced = false;
+    uint32_t clock_offset_us = 0;
+
+    // One way latency of a timestamped packet using the reported clock offset
+    void add_client_time(uint32_t client_time_us, uint32_t server_time_us) {
+        if (!is_clock_synced) return;
+        const int32_t latency_us = int32_t(server_time_us - (client_time_us + clock_offset_us));
+        // NOTE: Clock offset estimate has an error of up to rtt/2 so small negative values are clipped
+        one_way.add(uint32_t((latency_us > 0) ? latency_us : 0));
+    }
+
+    void write_stats(std::string& dst) const {
+        dst.append("\"latency\":{");
+        rtt.write_stats(dst, "rtt");
+        dst.append(",");
+        one_way.write_stats(dst, "one_way");
+        dst.append(",");
+        processing.write_stats(dst, "processing");
+        dst.append("}");
+    }
+};
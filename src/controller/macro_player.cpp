@@ -0,0 +1,227 @@
+#include "macro_player.hpp"
+#include "controller.hpp"
+#include <algorithm>
+
+static uint16_t read_u16(tcb::span<const uint8_t> buf) {
+    return uint16_t(buf[0]) | uint16_t(buf[1]) << 8;
+}
+
+// Axis values use the same encoding as SET_AXIS
+static float get_axis_value(uint8_t norm_value) {
+    constexpr float range = 100.0f;
+    return (float(norm_value) - range) / range;
+}
+
+MacroPlayer::MacroPlayer(TaskScheduler* _scheduler, Callback _on_update)
+:   scheduler(_scheduler), on_update(std::move(_on_update)), controller(nullptr)
+{
+
+}
+
+MacroPlayer::~MacroPlayer() {
+    stop_all();
+}
+
+Status_Macro MacroPlayer::upload(uint8_t id, tcb::span<const uint8_t> buf) {
+    if (id >= MAX_MACROS) {
+        return Status_Macro::ERROR_INVALID_MACRO;
+    }
+
+    constexpr uint8_t MAX_AXIS_VALUE = 200;
+    std::vector<Step> steps;
+    while (!buf.empty()) {
+        if (steps.size() >= MAX_STEPS) {
+            return Status_Macro::ERROR_TOO_MANY_STEPS;
+        }
+        Step step = {};
+        step.type = MacroStep(buf[0]);
+        auto data = buf.subspan(1);
+        size_t N = 0;
+        bool is_valid = false;
+        switch (step.type) {
+        case MacroStep::BUTTON:
+            N = 2;
+            if (data.size() < N) break;
+            step.id = data[0];
+            step.start = data[1];
+            is_valid = (step.start <= 1);
+            break;
+        case MacroStep::AXIS:
+            N = 2;
+            if (data.size() < N) break;
+            step.id = data[0];
+            step.start = data[1];
+            is_valid = (step.id < 16) && (step.start <= MAX_AXIS_VALUE);
+            break;
+        case MacroStep::WAIT:
+            N = 2;
+            if (data.size() < N) break;
+            step.duration_ms = read_u16(data);
+            is_valid = true;
+            break;
+        case MacroStep::RAMP:
+            N = 5;
+            if (data.size() < N) break;
+            step.id = data[0];
+            step.start = data[1];
+            step.end = data[2];
+            step.duration_ms = read_u16(data.subspan(3));
+            is_valid = (step.id < 16) && (step.start <= MAX_AXIS_VALUE) && (step.end <= MAX_AXIS_VALUE);
+            break;
+        case MacroStep::PULSE:
+            N = 5;
+            if (data.size() < N) break;
+            step.id = data[0];
+            step.duration_ms = read_u16(data.subspan(1));
+            step.count = read_u16(data.subspan(3));
+            // NOTE: Period is split evenly between press and release
+            is_valid = (step.duration_ms >= 2) && (step.count > 0);
+            break;
+        default:
+            break;
+        }
+        if (!is_valid) {
+            return Status_Macro::ERROR_INVALID_STEP;
+        }
+        steps.push_back(step);
+        buf = data.subspan(N);
+    }
+
+    // NOTE: Playback refers to the steps by index so it can't continue with a new macro
+    stop(id);
+    macros[id] = std::move(steps);
+    return Status_Macro::SUCCESS;
+}
+
+Status_Macro MacroPlayer::trigger(uint8_t id, Controller* _controller) {
+    if (id >= MAX_MACROS) {
+        return Status_Macro::ERROR_INVALID_MACRO;
+    }
+    if (scheduler == nullptr) {
+        return Status_Macro::ERROR_SCHEDULER_DISABLED;
+    }
+    if (macros[id].empty()) {
+        return Status_Macro::ERROR_MACRO_NOT_EXISTS;
+    }
+    // Buttons can only be checked once we know which device is used
+    const int total_buttons = _controller->device_info.nButtons;
+    for (const auto& step: macros[id]) {
+        const bool is_button = (step.type == MacroStep::BUTTON) || (step.type == MacroStep::PULSE);
+        if (is_button && (step.id > total_buttons)) {
+            return Status_Macro::ERROR_INVALID_STEP;
+        }
+    }
+
+    stop(id);
+    controller = _controller;
+    run(id, Clock::now());
+    return Status_Macro::SUCCESS;
+}
+
+Status_Macro MacroPlayer::stop(uint8_t id) {
+    if (id >= MAX_MACROS) {
+        return Status_Macro::ERROR_INVALID_MACRO;
+    }
+    auto& playback = playbacks[id];
+    if (playback.task != TaskScheduler::INVALID_TASK) {
+        scheduler->cancel(playback.task);
+    }
+    playback = {};
+    return Status_Macro::SUCCESS;
+}
+
+void MacroPlayer::stop_all() {
+    for (size_t i = 0; i < MAX_MACROS; i++) {
+        stop(uint8_t(i));
+    }
+}
+
+// Executes steps until one needs to wait, then schedules the rest
+// NOTE: now is the deadline of the previous step rather than the actual time so timing doesn't drift
+void MacroPlayer::run(uint8_t id, Clock::time_point now) {
+    auto& playback = playbacks[id];
+    const auto& steps = macros[id];
+    playback.task = TaskScheduler::INVALID_TASK;
+
+    bool is_changed = false;
+    while (playback.step < steps.size()) {
+        const auto& step = steps[playback.step];
+        const auto duration = std::chrono::milliseconds(step.duration_ms);
+        if (playback.tick == 0) {
+            playback.step_start = now;
+        }
+
+        bool is_waiting = false;
+        Clock::time_point deadline = now;
+        switch (step.type) {
+        case MacroStep::BUTTON:
+            controller->set_button(step.id, step.start != 0);
+            is_changed = true;
+            break;
+        case MacroStep::AXIS:
+            controller->set_axis(Axis(step.id), get_axis_value(step.start));
+            is_changed = true;
+            break;
+        case MacroStep::WAIT:
+            if (playback.tick == 0) {
+                playback.tick = 1;
+                deadline = playback.step_start + duration;
+                is_waiting = true;
+            }
+            break;
+        case MacroStep::RAMP:
+            {
+                const uint32_t total_ticks = std::max<uint32_t>(1, (step.duration_ms + RAMP_INTERVAL_MS - 1) / RAMP_INTERVAL_MS);
+                const float t = float(playback.tick) / float(total_ticks);
+                const float start = get_axis_value(step.start);
+                const float end = get_axis_value(step.end);
+                controller->set_axis(Axis(step.id), start + (end-start)*t);
+                is_changed = true;
+                if (playback.tick < total_ticks) {
+                    playback.tick++;
+                    deadline = playback.step_start + duration*playback.tick/total_ticks;
+                    is_waiting = true;
+                }
+            }
+            break;
+        case MacroStep::PULSE:
+            {
+                const uint32_t total_ticks = 2*uint32_t(step.count);
+                if (playback.tick < total_ticks) {
+                    controller->set_button(step.id, (playback.tick % 2) == 0);
+                    is_changed = true;
+                    playback.tick++;
+                    deadline = playback.step_start + duration*playback.tick/2;
+                    is_waiting = true;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (is_waiting) {
+            playback.task = scheduler->schedule(deadline, [this, id, deadline]() {
+                run(id, deadline);
+            });
+            // NOTE: Stopped if the scheduler is full rather than left waiting on a task that never runs
+            if (playback.task == TaskScheduler::INVALID_TASK) {
+                playback.step = steps.size();
+            }
+            break;
+        }
+        playback.step++;
+        playback.tick = 0;
+    }
+
+    // NOTE: All steps that are due at the same time are sent in one driver update
+    if (is_changed) {
+        controller->update();
+        if (on_update != nullptr) {
+            on_update();
+        }
+    }
+    if (playback.step >= steps.size()) {
+        playback = {};
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <functional>
+#include <vector>
+#include "utility/span.hpp"
+#include "server/task_scheduler.hpp"
+#include "packets.hpp"
+#include "utility/object_pool.hpp"
+
+class Controller;
+
+// Plays uploaded input sequences on the server with the task scheduler
+// This keeps press durations exact regardless of browser timer clamping or network jitter
+// Refer to packets.txt for the step encoding
+class MacroPlayer: public Pooled<MacroPlayer, 64>
+{
+public:
+    static constexpr size_t MAX_MACROS = 32;
+    static constexpr size_t MAX_STEPS = 256;
+    // Interval between axis updates during a ramp
+    static constexpr int RAMP_INTERVAL_MS = 10;
+    // Called after each driver update, e.g. to keep smoothed axes settling
+    using Callback = std::function<void()>;
+private:
+    using Clock = TaskScheduler::Clock;
+    struct Step {
+        MacroStep type;
+        uint8_t id;
+        uint8_t start;
+        uint8_t end;
+        uint16_t duration_ms;
+        uint16_t count;
+    };
+    struct Playback {
+        size_t step = 0;
+        uint32_t tick = 0;
+        Clock::time_point step_start;
+        TaskScheduler::TaskID task = TaskScheduler::INVALID_TASK;
+    };
+    TaskScheduler* const scheduler;
+    const Callback on_update;
+    Controller* controller;
+    std::array<std::vector<Step>, MAX_MACROS> macros;
+    std::array<Playback, MAX_MACROS> playbacks;
+public:
+    MacroPlayer(TaskScheduler* _scheduler, Callback _on_update);
+    ~MacroPlayer();
+    MacroPlayer(const MacroPlayer&) = delete;
+    MacroPlayer(MacroPlayer&&) = delete;
+    MacroPlayer& operator=(const MacroPlayer&) = delete;
+    MacroPlayer& operator=(MacroPlayer&&) = delete;
+
+    Status_Macro upload(uint8_t id, tcb::span<const uint8_t> buf);
+    // Restarts the macro if it is already playing
+    Status_Macro trigger(uint8_t id, Controller* controller);
+    Status_Macro stop(uint8_t id);
+    void stop_all();
+private:
+    void run(uint8_t id, Clock::time_point now);
+};
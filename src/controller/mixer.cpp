@@ -0,0 +1,197 @@
+#include "mixer.hpp"
+#include "packets.hpp"
+#include <ctype.h>
+#include <stdlib.h>
+#include <algorithm>
+
+// Recursive descent parser that emits an instruction per operator
+//     expr    := term (('+' | '-') term)*
+//     term    := unary (('*' | '/') unary)*
+//     unary   := '-' unary | primary
+//     primary := number | axis | B<button> | function '(' expr (',' expr)* ')' | '(' expr ')'
+// Functions are min, max, abs and clamp
+// Every result gets a new register so no allocation is needed
+struct ExpressionCompiler {
+    using Op = Mixer::Op;
+    static constexpr int INVALID = -1;
+    std::vector<float>& registers;
+    std::vector<Mixer::Instruction>& code;
+    std::string& error;
+    const char* cursor;
+
+    void skip_space() {
+        while (isspace(uint8_t(*cursor))) cursor++;
+    }
+
+    bool accept(char c) {
+        skip_space();
+        if (*cursor != c) return false;
+        cursor++;
+        return true;
+    }
+
+    int fail(const char* message) {
+        if (error.empty()) error = message;
+        return INVALID;
+    }
+
+    int allocate(float value = 0.0f) {
+        if (registers.size() >= Mixer::MAX_REGISTERS) {
+            return fail("Expression is too long");
+        }
+        registers.push_back(value);
+        return int(registers.size()-1);
+    }
+
+    int emit(Op op, int a, int b = 0) {
+        if ((a == INVALID) || (b == INVALID)) return INVALID;
+        const int dst = allocate();
+        if (dst == INVALID) return INVALID;
+        code.push_back({op, uint8_t(dst), uint8_t(a), uint8_t(b)});
+        return dst;
+    }
+
+    int parse_expression() {
+        int lhs = parse_term();
+        while (lhs != INVALID) {
+            if (accept('+'))        lhs = emit(Op::ADD, lhs, parse_term());
+            else if (accept('-'))   lhs = emit(Op::SUB, lhs, parse_term());
+            else                    break;
+        }
+        return lhs;
+    }
+
+    int parse_term() {
+        int lhs = parse_unary();
+        while (lhs != INVALID) {
+            if (accept('*'))        lhs = emit(Op::MUL, lhs, parse_unary());
+            else if (accept('/'))   lhs = emit(Op::DIV, lhs, parse_unary());
+            else                    break;
+        }
+        return lhs;
+    }
+
+    int parse_unary() {
+        if (accept('-')) {
+            return emit(Op::NEG, parse_unary());
+        }
+        return parse_primary();
+    }
+
+    int parse_primary() {
+        skip_space();
+        if (accept('(')) {
+            const int value = parse_expression();
+            if (!accept(')')) return fail("Expected ')'");
+            return value;
+        }
+        if (isdigit(uint8_t(*cursor)) || (*cursor == '.')) {
+            char* end = nullptr;
+            const float value = strtof(cursor, &end);
+            if (end == cursor) return fail("Invalid number");
+            cursor = end;
+            return allocate(value);
+        }
+        if (!isalpha(uint8_t(*cursor))) {
+            return fail("Expected a value");
+        }
+
+        const char* start = cursor;
+        while (isalnum(uint8_t(*cursor)) || (*cursor == '_')) cursor++;
+        const std::string name(start, size_t(cursor-start));
+        for (size_t i = 0; i < Mixer::TOTAL_AXES; i++) {
+            if (name == axis_names[i]) return int(i);
+        }
+        if ((name.size() > 1) && (name[0] == 'B') && std::all_of(name.begin()+1, name.end(), [](char c) { return isdigit(uint8_t(c)); })) {
+            const int button_id = atoi(name.c_str()+1);
+            if (button_id >= int(Mixer::TOTAL_BUTTONS)) return fail("Invalid button");
+            const int dst = allocate();
+            if (dst == INVALID) return INVALID;
+            code.push_back({Op::BUTTON, uint8_t(dst), uint8_t(button_id), 0});
+            return dst;
+        }
+        return parse_function(name);
+    }
+
+    int parse_function(const std::string& name) {
+        int args[3];
+        int total_args = 0;
+        if (!accept('(')) return fail("Unknown axis or function");
+        do {
+            if (total_args == 3) return fail("Too many arguments");
+            args[total_args] = parse_expression();
+            if (args[total_args] == INVALID) return INVALID;
+            total_args++;
+        } while (accept(','));
+        if (!accept(')')) return fail("Expected ')'");
+
+        if ((name == "min") && (total_args == 2))   return emit(Op::MIN, args[0], args[1]);
+        if ((name == "max") && (total_args == 2))   return emit(Op::MAX, args[0], args[1]);
+        if ((name == "abs") && (total_args == 1))   return emit(Op::ABS, args[0]);
+        if ((name == "clamp") && (total_args == 3)) return emit(Op::MIN, emit(Op::MAX, args[0], args[1]), args[2]);
+        return fail("Unknown function or wrong number of arguments");
+    }
+};
+
+Mixer::Mixer() {
+    initial_registers.resize(TOTAL_AXES, 0.0f);
+}
+
+bool Mixer::add(uint8_t axis, const std::string& expression, std::string& error) {
+    if (axis >= TOTAL_AXES) {
+        error = "Invalid output axis";
+        return false;
+    }
+    if (output_mask & (1u << axis)) {
+        error = "Output axis is already mixed";
+        return false;
+    }
+
+    const size_t prev_total_registers = initial_registers.size();
+    const size_t prev_code_size = code.size();
+    ExpressionCompiler compiler{initial_registers, code, error, expression.c_str()};
+    int result = compiler.parse_expression();
+    compiler.skip_space();
+    if ((result != ExpressionCompiler::INVALID) && (*compiler.cursor != '\0')) {
+        result = compiler.fail("Unexpected character");
+    }
+    if (result == ExpressionCompiler::INVALID) {
+        initial_registers.resize(prev_total_registers);
+        code.resize(prev_code_size);
+        return false;
+    }
+
+    outputs.push_back({axis, uint8_t(result)});
+    output_mask |= uint16_t(1u << axis);
+    return true;
+}
+
+void Mixer::evaluate(const float* axes, const uint32_t* buttons, float* results) const {
+    float registers[MAX_REGISTERS];
+    std::copy(initial_registers.begin(), initial_registers.end(), registers);
+    std::copy(axes, axes+TOTAL_AXES, registers);
+    for (const auto& ins: code) {
+        // NOTE: The operand is a button id instead of a register
+        if (ins.op == Op::BUTTON) {
+            registers[ins.dst] = float((buttons[ins.a/32] >> (ins.a%32)) & 0b1);
+            continue;
+        }
+        const float a = registers[ins.a];
+        const float b = registers[ins.b];
+        float& dst = registers[ins.dst];
+        switch (ins.op) {
+        case Op::ADD:       dst = a + b; break;
+        case Op::SUB:       dst = a - b; break;
+        case Op::MUL:       dst = a * b; break;
+        case Op::DIV:       dst = (b != 0.0f) ? a / b : 0.0f; break;
+        case Op::NEG:       dst = -a; break;
+        case Op::MIN:       dst = std::min(a, b); break;
+        case Op::MAX:       dst = std::max(a, b); break;
+        case Op::ABS:       dst = (a < 0.0f) ? -a : a; break;
+        default:            break;
+        }
+    }
+    for (const auto& output: outputs) {
+        results[output.axis] = std::clamp(registers[output.reg], -1.0f, 1.0f);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Derived axes defined as expressions over the input axes and buttons, e.g.
+//     AILERON = 0.5*X + 0.5*RX
+//     BRAKE   = max(0, -RUDDER) + B3
+// Expressions are compiled once into register bytecode so evaluating is a flat loop
+// Registers start with the input axes followed by constants and temporaries
+class Mixer
+{
+public:
+    static constexpr size_t TOTAL_AXES = 16;
+    static constexpr size_t TOTAL_BUTTONS = 128;
+    static constexpr size_t MAX_REGISTERS = 128;
+    enum class Op: uint8_t {
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        NEG,
+        MIN,
+        MAX,
+        ABS,
+        // dst = button a is pressed
+        BUTTON,
+    };
+    struct Instruction {
+        Op op;
+        uint8_t dst;
+        uint8_t a;
+        uint8_t b;
+    };
+private:
+    struct Output {
+        uint8_t axis;
+        uint8_t reg;
+    };
+    // Constants are preloaded, everything else is overwritten while evaluating
+    std::vector<float> initial_registers;
+    std::vector<Instruction> code;
+    std::vector<Output> outputs;
+    uint16_t output_mask = 0;
+public:
+    Mixer();
+    // Returns false with the reason if the expression is invalid
+    bool add(uint8_t axis, const std::string& expression, std::string& error);
+    bool is_empty() const { return outputs.empty(); }
+    // Mask of axes that are driven by an expression
+    uint16_t get_output_mask() const { return output_mask; }
+    size_t get_code_size() const { return code.size(); }
+    // Results are clamped between -1 and +1 and written only for the output axes
+    void evaluate(const float* axes, const uint32_t* buttons, float* results) const;
+};
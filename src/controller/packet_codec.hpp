@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include "utility/span.hpp"
+
+// Helpers for the packet views in packets_generated.hpp, values are little endian
+constexpr size_t PACKET_UNBOUNDED_SIZE = SIZE_MAX;
+
+inline uint16_t read_packet_u16(tcb::span<const uint8_t> buf) {
+    return uint16_t(buf[0]) | uint16_t(buf[1]) << 8;
+}
+
+inline uint32_t read_packet_u32(tcb::span<const uint8_t> buf) {
+    return
+        uint32_t(buf[0])       | uint32_t(buf[1]) << 8 |
+        uint32_t(buf[2]) << 16 | uint32_t(buf[3]) << 24;
+}
+
+inline void write_packet_u16(tcb::span<uint8_t> buf, uint16_t value) {
+    buf[0] = uint8_t(value);
+    buf[1] = uint8_t(value >> 8);
+}
+
+inline void write_packet_u32(tcb::span<uint8_t> buf, uint32_t value) {
+    buf[0] = uint8_t(value);
+    buf[1] = uint8_t(value >> 8);
+    buf[2] = uint8_t(value >> 16);
+    buf[3] = uint8_t(value >> 24);
+}
+
+// Returns the offset after the copied bytes
+inline size_t write_packet_bytes(tcb::span<uint8_t> dst, size_t offset, tcb::span<const uint8_t> src) {
+    std::copy(src.begin(), src.end(), dst.begin()+offset);
+    return offset + src.size();
+}
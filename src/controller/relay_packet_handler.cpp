@@ -0,0 +1,101 @@
+#include "relay_packet_handler.hpp"
+#include "controller_packet_handler.hpp"
+#include "packets.hpp"
+
+RelayPacketHandler::RelayPacketHandler(RelayRouter* _router)
+:   router(_router), sink(nullptr), stream(nullptr), acquired_id(0)
+{}
+
+tcb::span<const uint8_t> RelayPacketHandler::on_packet(tcb::span<const uint8_t> buf) {
+    if (buf.size() == 0) {
+        return InvalidRequestResponse::write(encode_buf, Status_Error::EMPTY_REQUEST);
+    }
+
+    // Backend disconnected so client needs to acquire the device again
+    if ((stream != nullptr) && !stream->get_is_open()) {
+        close_stream();
+    }
+
+    // Acquiring a device owned by another backend moves the session there if it doesn't hold one
+    // NOTE: Same reply as the backend would give so the held device isn't released behind the client's back
+    if ((stream != nullptr) && (Command(buf[0]) == AcquireDeviceRequest::COMMAND)) {
+        const AcquireDeviceRequest req{buf};
+        if (req.get_is_valid() && !router->get_is_routed(*stream, req.get_vjoy_id())) {
+            if (acquired_id != 0) {
+                return AcquireDeviceResponse::write(encode_buf, Status_Acquire::ERROR_DEVICE_ALREADY_ACQUIRED, acquired_id);
+            }
+            close_stream();
+        }
+    }
+
+    // NOTE: The backend's free device pool picks the device
+    if ((stream == nullptr) && (Command(buf[0]) == AcquireAnyRequest::COMMAND)) {
+        if (!AcquireAnyRequest{buf}.get_is_valid()) {
+            return InvalidRequestResponse::write(encode_buf, Status_Error::INCORRECT_LENGTH);
+        }
+        stream = router->open_any_stream(this);
+        if (stream == nullptr) {
+            return AcquireAnyResponse::write(encode_buf, Status_Acquire::ERROR_NO_FREE_DEVICES, 0, 0, 0, 0, {});
+        }
+    }
+
+    if (stream == nullptr) {
+        const AcquireDeviceRequest req{buf};
+        if (Command(buf[0]) != req.COMMAND) {
+            return InvalidRequestResponse::write(encode_buf, Status_Error::DEVICE_NOT_ACQUIRED);
+        }
+        if (!req.get_is_valid()) {
+            return InvalidRequestResponse::write(encode_buf, Status_Error::INCORRECT_LENGTH);
+        }
+        const uint8_t device_id = req.get_vjoy_id();
+        stream = router->open_stream(device_id, this);
+        if (stream == nullptr) {
+            return AcquireDeviceResponse::write(encode_buf, Status_Acquire::ERROR_DEVICE_NOT_EXISTS, device_id);
+        }
+    }
+
+    // NOTE: Response from the backend is sent asynchronously through the sink
+    stream->send_packet(buf);
+    return {};
+}
+
+void RelayPacketHandler::send_packet(tcb::span<const uint8_t> buf) {
+    if (buf.size() > 0) {
+        if (Command(buf[0]) == AcquireDeviceResponse::COMMAND) {
+            const AcquireDeviceResponse res{buf};
+            if (res.get_is_valid() && (res.get_status() == Status_Acquire::SUCCESS)) {
+                acquired_id = res.get_vjoy_id();
+            }
+        } else if (Command(buf[0]) == AcquireAnyResponse::COMMAND) {
+            const AcquireAnyResponse res{buf};
+            if (res.get_is_valid() && (res.get_status() == Status_Acquire::SUCCESS)) {
+                acquired_id = res.get_vjoy_id();
+            }
+        }
+    }
+    if (sink != nullptr) {
+        sink->send_packet(buf);
+    }
+}
+
+void RelayPacketHandler::close_stream() {
+    stream = nullptr;
+    acquired_id = 0;
+}
+
+PacketInfo RelayPacketHandler::get_packet_info(tcb::span<const uint8_t> buf) {
+    return get_controller_packet_info(buf);
+}
+
+bool RelayPacketHandler::get_is_droppable(tcb::span<const uint8_t> response) const {
+    return get_is_controller_ack(response);
+}
+
+tcb::span<const uint8_t> RelayPacketHandler::on_rate_limited(tcb::span<const uint8_t> buf) {
+    return InvalidRequestResponse::write(encode_buf, Status_Error::RATE_LIMITED);
+}
+
+// NOTE: The gateway's own load and backpressure are what the client is sending into
+tcb::span<const uint8_t> RelayPacketHandler::on_flow_control(const FlowControl& flow) {
+    return FlowControlResponse::write(encode_buf, flow.max_rate_hz, flow.batch_ms);
+}
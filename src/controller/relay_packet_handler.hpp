@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <memory>
+#include "utility/span.hpp"
+#include "server/packet_handler.hpp"
+#include "server/relay_router.hpp"
+
+// Forwards a client session to the backend that owns the requested device
+// The stream is opened on the first acquire, or reopened if a later acquire is for another backend's device while nothing is held
+// Responses come back through this handler to the sink
+// Acquiring any device goes to the backend with the fewest sessions
+class RelayPacketHandler: public PacketHandler, public PacketSink
+{
+private:
+    RelayRouter* const router;
+    PacketSink* sink;
+    std::unique_ptr<RelayStream> stream;
+    // Device the backend confirmed for this stream, 0 if none
+    uint8_t acquired_id;
+    std::array<uint8_t, 8> encode_buf;
+public:
+    RelayPacketHandler(RelayRouter* _router);
+    tcb::span<const uint8_t> on_packet(tcb::span<const uint8_t> buf) override;
+    PacketInfo get_packet_info(tcb::span<const uint8_t> buf) override;
+    tcb::span<const uint8_t> on_rate_limited(tcb::span<const uint8_t> buf) override;
+    tcb::span<const uint8_t> on_flow_control(const FlowControl& flow) override;
+    bool get_is_droppable(tcb::span<const uint8_t> response) const override;
+    void attach_sink(PacketSink* _sink) override { sink = _sink; }
+    // Responses from the backend
+    void send_packet(tcb::span<const uint8_t> buf) override;
+private:
+    void close_stream();
+};
+
+class RelayPacketHandlerFactory: public PacketHandlerFactory 
+{
+private:
+    RelayRouter* const router;
+public:
+    RelayPacketHandlerFactory(RelayRouter* _router): router(_router) {}
+    std::unique_ptr<PacketHandler> create_handler(void) override {
+        return std::make_unique<RelayPacketHandler>(router);
+    }
+};
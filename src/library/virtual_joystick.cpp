@@ -0,0 +1,190 @@
+#include "virtual_joystick.h"
+#include <stdio.h>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "vjoy.hpp"
+#include "server/run_server.hpp"
+#include "controller/controller.hpp"
+#include "controller/controller_session.hpp"
+#include "controller/controller_packet_handler.hpp"
+
+struct vjc_device {
+    ControllerSession session;
+};
+
+// Only one server can run since it shares the default event loop
+struct ServerInstance {
+    std::mutex mutex;
+    std::thread thread;
+    std::unique_ptr<ServerControl> control = nullptr;
+    ControllerPacketHandlerFactory factory;
+    std::string static_filepath;
+};
+
+static ServerInstance server_instance;
+
+// Ordered by websocket protocol axis id
+using AxisSetter = void (Controller::*)(const float);
+static const AxisSetter AXIS_SETTERS[VJC_TOTAL_AXES] = {
+    &Controller::set_x,
+    &Controller::set_y,
+    &Controller::set_z,
+    &Controller::set_rx,
+    &Controller::set_ry,
+    &Controller::set_rz,
+    &Controller::set_slider,
+    &Controller::set_dial,
+    &Controller::set_wheel,
+    &Controller::set_accelerator,
+    &Controller::set_brake,
+    &Controller::set_clutch,
+    &Controller::set_steering,
+    &Controller::set_aileron,
+    &Controller::set_rudder,
+    &Controller::set_throttle,
+};
+
+int vjc_api_is_enabled(void) {
+    return vjoy::api_is_enabled() ? 1 : 0;
+}
+
+int vjc_server_start(const vjc_server_config* config) {
+    auto& instance = server_instance;
+    auto lock = std::scoped_lock(instance.mutex);
+    if (instance.control != nullptr) {
+        return VJC_ERROR_SERVER_RUNNING;
+    }
+    if (!vjoy::api_is_enabled()) {
+        return VJC_ERROR_API_DISABLED;
+    }
+
+    ServerConfig server_config;
+    if (config != nullptr) {
+        if ((config->port < 0) || (config->port > 65535)) return VJC_ERROR_INVALID_ARGUMENT;
+        if ((config->udp_port < 0) || (config->udp_port > 65535)) return VJC_ERROR_INVALID_ARGUMENT;
+        if (config->port != 0) server_config.port = config->port;
+        if (config->static_filepath != nullptr) instance.static_filepath = config->static_filepath;
+        server_config.udp.is_enabled = (config->udp_port != 0);
+        server_config.udp.port = config->udp_port;
+        server_config.shm.is_enabled = (config->is_shm != 0);
+    }
+    if (instance.static_filepath.empty()) {
+        instance.static_filepath = server_config.static_filepath;
+    }
+    server_config.static_filepath = instance.static_filepath.c_str();
+    std::error_code ec;
+    if (!std::filesystem::is_directory(instance.static_filepath, ec)) {
+        fprintf(stderr, "Static filepath is not a directory: '%s'\n", server_config.static_filepath);
+        return VJC_ERROR_INVALID_ARGUMENT;
+    }
+
+    auto control = std::make_unique<ServerControl>();
+    auto is_listening = std::make_shared<std::promise<bool>>();
+    auto is_listening_future = is_listening->get_future();
+    control->on_listen = [is_listening](bool status) {
+        is_listening->set_value(status);
+    };
+
+    instance.thread = std::thread([server_config, control = control.get(), &instance]() {
+        run_server(server_config, &instance.factory, control);
+    });
+
+    if (!is_listening_future.get()) {
+        instance.thread.join();
+        return VJC_ERROR_SERVER_FAILED;
+    }
+    instance.control = std::move(control);
+    return VJC_SUCCESS;
+}
+
+int vjc_server_stop(void) {
+    auto& instance = server_instance;
+    auto lock = std::scoped_lock(instance.mutex);
+    if (instance.control == nullptr) {
+        return VJC_ERROR_SERVER_NOT_RUNNING;
+    }
+    instance.control->stop();
+    instance.thread.join();
+    instance.control = nullptr;
+    return VJC_SUCCESS;
+}
+
+int vjc_device_acquire(uint8_t device_id, vjc_device** device) {
+    if (device == nullptr) {
+        return VJC_ERROR_INVALID_ARGUMENT;
+    }
+    *device = nullptr;
+    if (!vjoy::api_is_enabled()) {
+        return VJC_ERROR_API_DISABLED;
+    }
+
+    auto handle = std::make_unique<vjc_device>();
+    const auto status = handle->session.open_controller(vjoy::Device_ID(device_id));
+    switch (status) {
+    case ControllerSession::Status_Acquire::SUCCESS:
+        *device = handle.release();
+        return VJC_SUCCESS;
+    case ControllerSession::Status_Acquire::DEVICE_ALREADY_ACQUIRED:
+        return VJC_ERROR_DEVICE_ALREADY_ACQUIRED;
+    case ControllerSession::Status_Acquire::DEVICE_NOT_EXISTS:
+        return VJC_ERROR_DEVICE_NOT_EXISTS;
+    case ControllerSession::Status_Acquire::DEVICE_BUSY:
+    default:
+        return VJC_ERROR_DEVICE_BUSY;
+    }
+}
+
+void vjc_device_release(vjc_device* device) {
+    // NOTE: Session releases the vjoy device when destroyed
+    delete device;
+}
+
+int vjc_device_set_state(vjc_device* device, const vjc_device_state* state) {
+    if ((device == nullptr) || (state == nullptr)) {
+        return VJC_ERROR_INVALID_ARGUMENT;
+    }
+    auto* controller = device->session.get_controller();
+    for (int i = 0; i < VJC_TOTAL_AXES; i++) {
+        (controller->*AXIS_SETTERS[i])(state->axes[i]);
+    }
+    for (int i = 0; i < VJC_TOTAL_BUTTONS; i++) {
+        const bool is_pressed = (state->buttons[i/32] >> (i%32)) & 0b1;
+        controller->set_button(uint8_t(i), is_pressed);
+    }
+    controller->update();
+    return VJC_SUCCESS;
+}
+
+int vjc_device_set_axis(vjc_device* device, uint8_t axis, float value) {
+    if ((device == nullptr) || (axis >= VJC_TOTAL_AXES)) {
+        return VJC_ERROR_INVALID_ARGUMENT;
+    }
+    auto* controller = device->session.get_controller();
+    (controller->*AXIS_SETTERS[axis])(value);
+    controller->update();
+    return VJC_SUCCESS;
+}
+
+int vjc_device_set_button(vjc_device* device, uint8_t button, int is_pressed) {
+    if ((device == nullptr) || (button >= VJC_TOTAL_BUTTONS)) {
+        return VJC_ERROR_INVALID_ARGUMENT;
+    }
+    auto* controller = device->session.get_controller();
+    controller->set_button(button, is_pressed != 0);
+    controller->update();
+    return VJC_SUCCESS;
+}
+
+int vjc_device_reset(vjc_device* device) {
+    if (device == nullptr) {
+        return VJC_ERROR_INVALID_ARGUMENT;
+    }
+    auto* controller = device->session.get_controller();
+    controller->reset();
+    controller->update();
+    return VJC_SUCCESS;
+}
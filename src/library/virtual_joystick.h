@@ -0,0 +1,78 @@
+/* C interface for embedding the virtual joystick server into another process
+ * This lets a host application serve the web UI and inject input directly
+ * without going through the websocket for its own input
+ *
+ * All functions are thread safe with respect to the server thread
+ * A device handle should only be used from one thread at a time
+ */
+#ifndef VIRTUAL_JOYSTICK_H
+#define VIRTUAL_JOYSTICK_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+    #ifdef VJC_BUILD_DLL
+        #define VJC_API __declspec(dllexport)
+    #else
+        #define VJC_API __declspec(dllimport)
+    #endif
+#else
+    #define VJC_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Status codes match the acquire status of the websocket protocol */
+#define VJC_SUCCESS                         0
+#define VJC_ERROR_DEVICE_ALREADY_ACQUIRED   1
+#define VJC_ERROR_DEVICE_NOT_EXISTS         2
+#define VJC_ERROR_DEVICE_BUSY               3
+#define VJC_ERROR_API_DISABLED              4
+#define VJC_ERROR_INVALID_ARGUMENT          5
+#define VJC_ERROR_SERVER_RUNNING            6
+#define VJC_ERROR_SERVER_NOT_RUNNING        7
+#define VJC_ERROR_SERVER_FAILED             8
+
+/* Axis indices match the websocket protocol, refer to src/controller/packets.txt */
+#define VJC_TOTAL_AXES      16
+#define VJC_TOTAL_BUTTONS   128
+
+typedef struct {
+    int port;                       /* 0 uses the default of 3000 */
+    const char* static_filepath;    /* NULL uses the default of "./static" */
+    int udp_port;                   /* 0 disables the udp transport */
+    int is_shm;                     /* Non-zero enables the shared memory transport */
+} vjc_server_config;
+
+typedef struct {
+    /* Normalised between -1 and +1 */
+    float axes[VJC_TOTAL_AXES];
+    /* Bit i of buttons[i/32] is button i */
+    uint32_t buttons[VJC_TOTAL_BUTTONS/32];
+} vjc_device_state;
+
+typedef struct vjc_device vjc_device;
+
+VJC_API int vjc_api_is_enabled(void);
+
+/* Starts the server on a background thread and waits until it is listening */
+VJC_API int vjc_server_start(const vjc_server_config* config);
+/* Stops the server and waits for its thread to exit */
+VJC_API int vjc_server_stop(void);
+
+/* Acquire a vJoy device for direct input injection */
+VJC_API int vjc_device_acquire(uint8_t device_id, vjc_device** device);
+VJC_API void vjc_device_release(vjc_device* device);
+/* Writes the entire device state with a single driver update */
+VJC_API int vjc_device_set_state(vjc_device* device, const vjc_device_state* state);
+VJC_API int vjc_device_set_axis(vjc_device* device, uint8_t axis, float value);
+VJC_API int vjc_device_set_button(vjc_device* device, uint8_t button, int is_pressed);
+VJC_API int vjc_device_reset(vjc_device* device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
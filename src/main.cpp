@@ -1,38 +1,109 @@
 #include <stdio.h>
 #include <filesystem>
+#include <algorithm>
 #include <string_view>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
 #include "vjoy.hpp"
 #include "server/run_server.hpp"
+#include "server/relay_router.hpp"
 #include "controller/controller_packet_handler.hpp"
+#include "controller/relay_packet_handler.hpp"
 #define OPTPARSE_IMPLEMENTATION
 #include "utility/optparse.h"
 
 struct ArgumentParser {
     int port;
     const char* static_filepath;
-};
-
-class HandlerFactory: public PacketHandlerFactory {
-public:
-    std::unique_ptr<PacketHandler> create_handler(void) override {
-        return std::make_unique<ControllerPacketHandler>();
-    }
+    int static_cache_mb;
+    bool is_bundle_static;
+    bool is_rate_limit;
+    float rate_limit_messages;
+    float rate_limit_bytes;
+    int udp_port;
+    bool is_shm;
+    const char* shm_name;
+    int relay_listen_port;
+    int observer_rate;
+    int input_rate;
+    const char* profiles_filepath;
+    LogLevel log_level;
+    const char* log_filepath;
+    bool is_low_latency;
+    bool is_busy_poll;
+    int loop_cpu;
+    int worker_cpu;
+    std::vector<RelayBackendConfig> relay_backends;
 };
 
 void vjoy_api_print_info(void);
 void convert_utf16_to_ascii(const char16_t* src, char* dst, const int N);
 void print_usage(void);
+bool parse_relay_backend(const char* arg, RelayBackendConfig& backend);
 ArgumentParser parse_arguments(int argc, char** argv);
 
 int main(int argc, char** argv) {
     const auto args = parse_arguments(argc, argv);
-    if (!vjoy::api_is_enabled()) {
-        printf("vjoy is not enabled\n");
-        return 1;
+    // NOTE: A relay gateway forwards input to backends so it doesn't need vjoy
+    const bool is_relay = !args.relay_backends.empty();
+    if (!is_relay) {
+        if (!vjoy::api_is_enabled()) {
+            printf("vjoy is not enabled\n");
+            return 1;
+        }
+        vjoy_api_print_info();
+    }
+    ServerConfig config;
+    config.port = args.port;
+    config.static_filepath = args.static_filepath;
+    config.static_cache_size = size_t(args.static_cache_mb)*1024*1024;
+    config.is_bundle_static = args.is_bundle_static;
+    config.log.level = args.log_level;
+    config.log.filepath = args.log_filepath;
+    auto& rate_limit = config.websocket.rate_limit;
+    rate_limit.is_enabled = args.is_rate_limit;
+    rate_limit.messages.rate = args.rate_limit_messages;
+    // NOTE: Burst must fit at least one message
+    rate_limit.messages.burst = std::max(1.0f, args.rate_limit_messages*0.2f);
+    rate_limit.bytes.rate = args.rate_limit_bytes;
+    // NOTE: Burst must fit the largest websocket message
+    rate_limit.bytes.burst = std::max(16.0f*1024.0f, args.rate_limit_bytes*0.5f);
+    config.udp.is_enabled = (args.udp_port > 0);
+    config.udp.port = args.udp_port;
+    config.shm.is_enabled = args.is_shm;
+    config.shm.name = args.shm_name;
+    config.relay.listen_port = args.relay_listen_port;
+    config.observer.max_rate_hz = args.observer_rate;
+    config.websocket.flow_control.is_enabled = (args.input_rate > 0);
+    config.websocket.flow_control.max_rate_hz = args.input_rate;
+    config.low_latency.loop_cpu = args.loop_cpu;
+    config.low_latency.is_busy_poll = args.is_busy_poll;
+    config.log.cpu = args.worker_cpu;
+    if (args.is_low_latency) {
+        config.low_latency.is_high_priority = true;
+        SocketConfig socket;
+        socket.is_no_delay = true;
+        socket.busy_poll_us = 50;
+        config.websocket.socket = socket;
+        config.udp.socket = socket;
+    }
+
+    if (is_relay) {
+        auto relay_router = create_relay_router(args.relay_backends);
+        config.relay.router = relay_router.get();
+        RelayPacketHandlerFactory handler_factory(relay_router.get());
+        run_server(config, &handler_factory);
+    } else {
+        ControllerPacketHandlerFactory handler_factory;
+        std::string error;
+        if ((args.profiles_filepath != nullptr) && !handler_factory.load_profiles(args.profiles_filepath, error)) {
+            fprintf(stderr, "Failed to load profiles '%s': %s\n", args.profiles_filepath, error.c_str());
+            return 1;
+        }
+        run_server(config, &handler_factory);
     }
-    vjoy_api_print_info();
-    HandlerFactory handler_factory;
-    run_server(args.port, args.static_filepath, &handler_factory);
 
     // NOTE: run_server is blocking if the server starts correctly
     fprintf(
@@ -48,6 +119,25 @@ void print_usage(void) {
         "main, Launch a http server with websocket vJoy interface\n\n"
         "\t[--port <port>                (default: 3000)]\n"
         "\t[--static-filepath <filepath> (default: './static')]\n"
+        "\t[--static-cache <mb>          (default: 8MB memory for cached static files)]\n"
+        "\t[--no-bundle                  (serve layouts with their original scripts and stylesheets)]\n"
+        "\t[--rate-limit-msgs <n>        (default: 1000 messages/second per client)]\n"
+        "\t[--rate-limit-bytes <n>       (default: 32768 bytes/second per client)]\n"
+        "\t[--no-rate-limit              (disable per client rate limiting)]\n"
+        "\t[--udp-port <port>            (default: disabled)]\n"
+        "\t[--shm                        (accept input from local producers over shared memory)]\n"
+        "\t[--shm-name <name>            (default: refer to src/shm/input_ring.h)]\n"
+        "\t[--relay <ip:port=ids>        (run as relay gateway, forward devices to backend, e.g. 192.168.1.2:4000=1-4,6)]\n"
+        "\t[--relay-listen <port>        (accept connections from a relay gateway, default: disabled)]\n"
+        "\t[--observer-rate <hz>         (default: 30 device state updates/second to observers, 0 to disable)]\n"
+        "\t[--input-rate <hz>            (default: 125 input updates/second recommended to clients, 0 to disable)]\n"
+        "\t[--profiles <filepath>        (remapping profiles reloaded on change, refer to docs/profiles_example.txt)]\n"
+        "\t[--log-level <level>          (default: info, one of debug/info/warn/error)]\n"
+        "\t[--log-file <filepath>        (default: stderr, rotated at 8MB keeping 3 old files)]\n"
+        "\t[--low-latency                (raise the event loop's priority and busy poll client sockets where permitted)]\n"
+        "\t[--loop-cpu <n>               (pin the event loop, which also updates the devices, to a core)]\n"
+        "\t[--worker-cpu <n>             (pin background threads to a core other than the event loop's)]\n"
+        "\t[--busy-poll                  (spin on the event loop instead of sleeping, uses the whole core)]\n"
         "\t[--help                       (show usage)]\n"
     );
 }
@@ -56,13 +146,51 @@ ArgumentParser parse_arguments(int argc, char** argv) {
     ArgumentParser parser;
     parser.port = 3000;
     parser.static_filepath = "./static";
+    parser.static_cache_mb = 8;
+    parser.is_bundle_static = true;
+    parser.is_rate_limit = true;
+    parser.rate_limit_messages = 1000.0f;
+    parser.rate_limit_bytes = 32.0f*1024.0f;
+    parser.udp_port = 0;
+    parser.is_shm = false;
+    parser.shm_name = nullptr;
+    parser.relay_listen_port = 0;
+    parser.observer_rate = 30;
+    parser.input_rate = 125;
+    parser.profiles_filepath = nullptr;
+    parser.log_level = LogLevel::INFO;
+    parser.log_filepath = nullptr;
+    parser.is_low_latency = false;
+    parser.is_busy_poll = false;
+    parser.loop_cpu = -1;
+    parser.worker_cpu = -1;
 
     struct optparse options;
     optparse_init(&options, argv);
     struct optparse_long longopts[] = {
         {"port",            'p', OPTPARSE_REQUIRED},
         {"static-filepath", 'd', OPTPARSE_REQUIRED},
+        {"static-cache",    'c', OPTPARSE_REQUIRED},
+        {"no-bundle",       'B', OPTPARSE_NONE},
+        {"rate-limit-msgs", 'm', OPTPARSE_REQUIRED},
+        {"rate-limit-bytes",'b', OPTPARSE_REQUIRED},
+        {"no-rate-limit",   'n', OPTPARSE_NONE},
+        {"udp-port",        'u', OPTPARSE_REQUIRED},
+        {"shm",             's', OPTPARSE_NONE},
+        {"shm-name",        'S', OPTPARSE_REQUIRED},
+        {"relay",           'r', OPTPARSE_REQUIRED},
+        {"relay-listen",    'l', OPTPARSE_REQUIRED},
+        {"observer-rate",   'o', OPTPARSE_REQUIRED},
+        {"input-rate",      'i', OPTPARSE_REQUIRED},
+        {"profiles",        'P', OPTPARSE_REQUIRED},
+        {"log-level",       'L', OPTPARSE_REQUIRED},
+        {"log-file",        'F', OPTPARSE_REQUIRED},
+        {"low-latency",     'x', OPTPARSE_NONE},
+        {"loop-cpu",        'C', OPTPARSE_REQUIRED},
+        {"worker-cpu",      'W', OPTPARSE_REQUIRED},
+        {"busy-poll",       'y', OPTPARSE_NONE},
         {"help",            'h', OPTPARSE_NONE},
+        {0},
     };
 
     while (true) {
@@ -75,6 +203,74 @@ ArgumentParser parse_arguments(int argc, char** argv) {
         case 'd':
             parser.static_filepath = options.optarg;
             break;
+        case 'c':
+            parser.static_cache_mb = atoi(options.optarg);
+            break;
+        case 'B':
+            parser.is_bundle_static = false;
+            break;
+        case 'm':
+            parser.rate_limit_messages = float(atof(options.optarg));
+            break;
+        case 'b':
+            parser.rate_limit_bytes = float(atof(options.optarg));
+            break;
+        case 'n':
+            parser.is_rate_limit = false;
+            break;
+        case 'u':
+            parser.udp_port = atoi(options.optarg);
+            break;
+        case 's':
+            parser.is_shm = true;
+            break;
+        case 'S':
+            parser.is_shm = true;
+            parser.shm_name = options.optarg;
+            break;
+        case 'r':
+            {
+                RelayBackendConfig backend;
+                if (!parse_relay_backend(options.optarg, backend)) {
+                    fprintf(stderr, "Invalid relay backend '%s', expected <ipv4>:<port>=<ids>\n", options.optarg);
+                    exit(1);
+                }
+                parser.relay_backends.push_back(std::move(backend));
+            }
+            break;
+        case 'l':
+            parser.relay_listen_port = atoi(options.optarg);
+            break;
+        case 'o':
+            parser.observer_rate = atoi(options.optarg);
+            break;
+        case 'i':
+            parser.input_rate = atoi(options.optarg);
+            break;
+        case 'P':
+            parser.profiles_filepath = options.optarg;
+            break;
+        case 'L':
+            if (!parse_log_level(options.optarg, parser.log_level)) {
+                fprintf(stderr, "Invalid log level '%s', expected debug, info, warn or error\n", options.optarg);
+                exit(1);
+            }
+            break;
+        case 'F':
+            parser.log_filepath = options.optarg;
+            break;
+        case 'x':
+            parser.is_low_latency = true;
+            break;
+        case 'C':
+            parser.loop_cpu = atoi(options.optarg);
+            break;
+        case 'W':
+            parser.worker_cpu = atoi(options.optarg);
+            break;
+        case 'y':
+            parser.is_busy_poll = true;
+            break;
         case 'h':
         case '?':
             print_usage();
@@ -94,6 +290,62 @@ ArgumentParser parse_arguments(int argc, char** argv) {
         exit(1);
     }
 
+    if ((parser.udp_port < PORT_MIN) || (parser.udp_port > PORT_MAX)) {
+        fprintf(
+            stderr, "UDP port must be between %d and %d, got %d\n", 
+            PORT_MIN, PORT_MAX, parser.udp_port
+        );
+        exit(1);
+    }
+
+    if ((parser.relay_listen_port < PORT_MIN) || (parser.relay_listen_port > PORT_MAX)) {
+        fprintf(
+            stderr, "Relay listen port must be between %d and %d, got %d\n", 
+            PORT_MIN, PORT_MAX, parser.relay_listen_port
+        );
+        exit(1);
+    }
+
+    // Validate rate limits
+    if ((parser.rate_limit_messages <= 0.0f) || (parser.rate_limit_bytes <= 0.0f)) {
+        fprintf(stderr, "Rate limits must be positive\n");
+        exit(1);
+    }
+
+    constexpr int OBSERVER_RATE_MAX = 1000;
+    if ((parser.observer_rate < 0) || (parser.observer_rate > OBSERVER_RATE_MAX)) {
+        fprintf(stderr, "Observer rate must be between 0 and %d, got %d\n", OBSERVER_RATE_MAX, parser.observer_rate);
+        exit(1);
+    }
+
+    constexpr int INPUT_RATE_MAX = 1000;
+    if ((parser.input_rate < 0) || (parser.input_rate > INPUT_RATE_MAX)) {
+        fprintf(stderr, "Input rate must be between 0 and %d, got %d\n", INPUT_RATE_MAX, parser.input_rate);
+        exit(1);
+    }
+
+    constexpr int STATIC_CACHE_MAX_MB = 4096;
+    if ((parser.static_cache_mb < 0) || (parser.static_cache_mb > STATIC_CACHE_MAX_MB)) {
+        fprintf(stderr, "Static cache must be between 0 and %dMB, got %d\n", STATIC_CACHE_MAX_MB, parser.static_cache_mb);
+        exit(1);
+    }
+
+    // NOTE: Zero if unknown so we don't reject cores we can't see
+    const int total_cpus = int(std::thread::hardware_concurrency());
+    const int cpu_max = (total_cpus > 0) ? (total_cpus-1) : 1023;
+    if ((parser.loop_cpu < -1) || (parser.loop_cpu > cpu_max)) {
+        fprintf(stderr, "Loop cpu must be between 0 and %d, got %d\n", cpu_max, parser.loop_cpu);
+        exit(1);
+    }
+    if ((parser.worker_cpu < -1) || (parser.worker_cpu > cpu_max)) {
+        fprintf(stderr, "Worker cpu must be between 0 and %d, got %d\n", cpu_max, parser.worker_cpu);
+        exit(1);
+    }
+    if ((parser.loop_cpu >= 0) && (parser.loop_cpu == parser.worker_cpu)) {
+        fprintf(stderr, "Worker cpu should be different from the loop cpu, got %d for both\n", parser.loop_cpu);
+        exit(1);
+    }
+
     // Validate filepath
     namespace fs = std::filesystem;
     fs::path static_filepath;
@@ -111,6 +363,46 @@ ArgumentParser parse_arguments(int argc, char** argv) {
     return parser;
 }
 
+// Format: <ipv4>:<port>=<ids> where ids is a comma separated list of ids or ranges
+// E.g. 192.168.1.2:4000=1-4,6
+bool parse_relay_backend(const char* arg, RelayBackendConfig& backend) {
+    const auto str = std::string_view(arg);
+    const size_t port_pos = str.find(':');
+    const size_t ids_pos = str.find('=');
+    if ((port_pos == std::string_view::npos) || (ids_pos == std::string_view::npos) || (ids_pos < port_pos)) {
+        return false;
+    }
+    backend.host = std::string(str.substr(0, port_pos));
+    backend.port = atoi(std::string(str.substr(port_pos+1, ids_pos-port_pos-1)).c_str());
+    if ((backend.port <= 0) || (backend.port > 65535)) {
+        return false;
+    }
+
+    auto ids = str.substr(ids_pos+1);
+    while (!ids.empty()) {
+        const size_t end = std::min(ids.find(','), ids.size());
+        const auto range = std::string(ids.substr(0, end));
+        ids = ids.substr(std::min(end+1, ids.size()));
+
+        int start_id = 0;
+        int end_id = 0;
+        const size_t dash = range.find('-');
+        if (dash == std::string::npos) {
+            start_id = end_id = atoi(range.c_str());
+        } else {
+            start_id = atoi(range.substr(0, dash).c_str());
+            end_id = atoi(range.substr(dash+1).c_str());
+        }
+        if ((start_id < 1) || (end_id > 255) || (start_id > end_id)) {
+            return false;
+        }
+        for (int id = start_id; id <= end_id; id++) {
+            backend.device_ids.push_back(uint8_t(id));
+        }
+    }
+    return !backend.device_ids.empty();
+}
+
 void vjoy_api_print_info(void) {
     const uint16_t version_number = vjoy::api_get_version();
     const char16_t* product_str = vjoy::api_get_product_string();
@@ -1,129 +1,281 @@
 // Source: https://github.com/uNetworking/uWebSockets/blob/526a9ad6cdc0299b95ef9c8d337ce99d2cac120a/examples/helpers/AsyncFileReader.h
+// Modified so buffers fit the file and share a memory budget
+// Modified so reads go through libuv and any number can be in flight per file
 #pragma once
 
 #include <map>
+#include <list>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
 #include <cstring>
-#include <fstream>
 #include <sstream>
 #include <iostream>
-#include <future>
+#include <uv.h>
+#include "utility/logger.hpp"
+
+struct AsyncFileReader;
+
+/* Memory budget shared by every file reader
+ * Least recently used buffers are released first when a new buffer doesn't fit */
+struct FileCache {
+    const size_t capacity;
+    size_t totalSize = 0;
+    std::list<AsyncFileReader*> lru;
+
+    FileCache(size_t capacity) : capacity(capacity) {}
+
+    /* Account for a reader's buffer changing size, returns false if it doesn't fit
+     * NOTE: When eviction is allowed the budget can be exceeded by the chunk being streamed */
+    bool resize(AsyncFileReader* reader, size_t size, bool canEvict);
+    void touch(AsyncFileReader* reader);
+};
+
+/* An open file shared by a reader and its reads in flight
+ * NOTE: The last owner closes it so a read still on the thread pool never sees a closed file */
+struct AsyncFileHandle {
+    uv_loop_t *loop;
+    uv_file file;
+
+    AsyncFileHandle(uv_loop_t *loop, const std::string &fileName) : loop(loop) {
+        uv_fs_t req;
+        file = uv_fs_open(loop, &req, fileName.c_str(), UV_FS_O_RDONLY, 0, nullptr);
+        uv_fs_req_cleanup(&req);
+    }
+
+    ~AsyncFileHandle() {
+        if (file < 0) return;
+        uv_fs_t req;
+        uv_fs_close(loop, &req, file, nullptr);
+        uv_fs_req_cleanup(&req);
+    }
+};
+
+/* A positional read with its own buffer, requests for the same offset share it */
+struct AsyncFileRead {
+    uv_fs_t req;
+    std::shared_ptr<AsyncFileHandle> handle;
+    AsyncFileReader *reader;
+    int offset;
+    std::string buffer;
+    std::vector<std::function<void(std::string_view)>> cbs;
+};
 
-/* This is just a very simple and inefficient demo of async responses,
- * please do roll your own variant or use a database or Node.js's async
- * features instead of this really bad demo */
 struct AsyncFileReader {
+    /* Files larger than this are streamed in chunks of this size */
+    static constexpr int CHUNK_SIZE = 256 * 1024;
 private:
-    /* The cache we have in memory for this file */
+    /* The cache we have in memory for this file, sized to the file or a chunk */
     std::string cache;
     int cacheOffset;
     bool hasCache;
 
-    /* The pending async file read (yes we only support one pending read) */
-    std::function<void(std::string_view)> pendingReadCb;
+    /* Position in the least recently used list while the cache holds a buffer */
+    FileCache *fileCache;
+    std::list<AsyncFileReader*>::iterator lruIt;
+    bool isResident;
+
+    /* Reads run on the libuv thread pool (or io_uring where libuv supports it)
+     * and complete on the loop thread, so nothing here needs a lock */
+    std::vector<AsyncFileRead*> pendingReads;
 
     int fileSize;
     std::string fileName;
-    std::ifstream fin;
-    uWS::Loop *loop;
+    std::shared_ptr<AsyncFileHandle> handle;
+
+    friend struct FileCache;
 
 public:
-    /* Construct a demo async. file reader for fileName */
-    AsyncFileReader(std::string fileName) : fileName(fileName) {
-        fin.open(fileName, std::ios::binary);
+    /* Construct a demo async. file reader for fileName, nothing is read until the file is needed */
+    AsyncFileReader(uv_loop_t *loop, std::string fileName, FileCache *fileCache) : fileCache(fileCache), fileName(fileName) {
+        handle = std::make_shared<AsyncFileHandle>(loop, fileName);
 
         // get fileSize
-        fin.seekg(0, fin.end);
-        fileSize = int(fin.tellg());
+        fileSize = 0;
+        if (handle->file >= 0) {
+            uv_fs_t req;
+            if (uv_fs_fstat(loop, &req, handle->file, nullptr) == 0) {
+                fileSize = int(std::min<uint64_t>(req.statbuf.st_size, INT32_MAX));
+            }
+            uv_fs_req_cleanup(&req);
+        } else {
+            log_error("Failed to open file: {}", fileName);
+        }
 
-        //std::cout << "File size is: " << fileSize << std::endl;
+        cacheOffset = 0;
+        hasCache = false;
+        isResident = false;
+    }
 
-        // cache up 1 mb!
-        cache.resize(1024 * 1024);
+    ~AsyncFileReader() {
+        /* Reads that are still queued are cancelled, ones already running complete without us */
+        for (auto *read : pendingReads) {
+            read->reader = nullptr;
+            uv_cancel(reinterpret_cast<uv_req_t*>(&read->req));
+        }
+    }
 
-        //std::cout << "Caching 1 MB at offset = " << 0 << std::endl;
-        fin.seekg(0, fin.beg);
-        fin.read(cache.data(), cache.length());
+    /* Read the whole file if it is small and fits the budget without evicting anything */
+    bool preload() {
+        if ((fileSize == 0) || (fileSize > CHUNK_SIZE)) {
+            return false;
+        }
+        std::string buffer(size_t(fileSize), '\0');
+        uv_fs_t req;
+        uv_buf_t buf = uv_buf_init(buffer.data(), unsigned(buffer.length()));
+        const int result = uv_fs_read(handle->loop, &req, handle->file, &buf, 1, 0, nullptr);
+        uv_fs_req_cleanup(&req);
+        if (result != fileSize) {
+            return false;
+        }
+        if (!fileCache->resize(this, size_t(fileSize), false)) {
+            return false;
+        }
+        cache = std::move(buffer);
         cacheOffset = 0;
         hasCache = true;
-
-        // get loop for thread
-
-        loop = uWS::Loop::get();
+        return true;
     }
 
     /* Returns any data already cached for this offset */
     std::string_view peek(int offset) {
         /* Did we hit the cache? */
-        if (hasCache && offset >= cacheOffset && ((offset - cacheOffset) < cache.length())) {
+        if (hasCache && offset >= cacheOffset && ((offset - cacheOffset) < int(cache.length()))) {
             /* Cache hit */
-            //std::cout << "Cache hit!" << std::endl;
-
-            /*if (fileSize - offset < cache.length()) {
-                std::cout << "LESS THAN WHAT WE HAVE!" << std::endl;
-            }*/
-
+            fileCache->touch(this);
             const int chunkSize = std::min<int>(fileSize-offset, int(cache.length())-offset+cacheOffset);
             return std::string_view(cache.data()+offset-cacheOffset, chunkSize);
         } else {
             /* Cache miss */
-            //std::cout << "Cache miss!" << std::endl;
             return std::string_view(nullptr, 0);
         }
     }
 
-    /* Asynchronously request more data at offset */
+    /* Asynchronously request more data at offset, cb gets an empty chunk if the read failed */
     void request(int offset, std::function<void(std::string_view)> cb) {
+        /* Responses streaming the same part of the file wait on the same read */
+        for (auto *read : pendingReads) {
+            if (read->offset == offset) {
+                read->cbs.push_back(std::move(cb));
+                return;
+            }
+        }
 
-        // in this case, what do we do?
-        // we need to queue up this chunk request and callback!
-        // if queue is full, either block or close the connection via abort!
-        if (!hasCache) {
-            // already requesting a chunk!
-            std::cout << "ERROR: already requesting a chunk!" << std::endl;
+        // size the buffer to what is left of the file, up to a chunk
+        const int chunkSize = std::max(std::min<int>(CHUNK_SIZE, fileSize - offset), 0);
+        if (chunkSize == 0) {
+            cb(std::string_view(nullptr, 0));
             return;
         }
 
-        // disable cache
-        hasCache = false;
+        // NOTE: The buffer only counts against the budget once the read completes
+        auto read = std::make_unique<AsyncFileRead>();
+        read->handle = handle;
+        read->reader = this;
+        read->offset = offset;
+        read->buffer.resize(size_t(chunkSize));
+        read->cbs.push_back(std::move(cb));
+        read->req.data = read.get();
 
-        auto future = std::async(std::launch::async, [this, cb, offset]() {
-            //std::cout << "ASYNC Caching 1 MB at offset = " << offset << std::endl;
-            // den har stängts! öppna igen!
-            if (!fin.good()) {
-                fin.close();
-                //std::cout << "Reopening fin!" << std::endl;
-                fin.open(fileName, std::ios::binary);
-            }
-            fin.seekg(offset, fin.beg);
-            fin.read(cache.data(), cache.length());
+        uv_buf_t buf = uv_buf_init(read->buffer.data(), unsigned(chunkSize));
+        const int status = uv_fs_read(handle->loop, &read->req, handle->file, &buf, 1, offset, &AsyncFileReader::onRead);
+        if (status < 0) {
+            log_error("Failed to read file: {} ({})", fileName, uv_strerror(status));
+            uv_fs_req_cleanup(&read->req);
+            read->cbs.front()(std::string_view(nullptr, 0));
+            return;
+        }
+        pendingReads.push_back(read.release());
+    }
 
-            cacheOffset = offset;
+    int getFileSize() {
+        return fileSize;
+    }
 
-            loop->defer([this, cb, offset]() {
+    size_t getCacheSize() {
+        return cache.length();
+    }
 
-                int chunkSize = std::min<int>(int(cache.length()), fileSize - offset);
+    size_t getTotalPendingReads() {
+        return pendingReads.size();
+    }
 
-                // båda dessa sker, wtf?
-                if (chunkSize == 0) {
-                    std::cout << "Zero size!?" << std::endl;
-                }
+    const std::string& getFileName() {
+        return fileName;
+    }
 
-                if (chunkSize != cache.length()) {
-                    std::cout << "LESS THAN A CACHE 1 MB!" << std::endl;
-                }
+private:
+    static void onRead(uv_fs_t *req) {
+        std::unique_ptr<AsyncFileRead> read(static_cast<AsyncFileRead*>(req->data));
+        const ssize_t result = req->result;
+        uv_fs_req_cleanup(req);
 
-                hasCache = true;
-                cb(std::string_view(cache.data(), chunkSize));
-            });
-        });
-    }
+        AsyncFileReader *reader = read->reader;
+        if (reader == nullptr) {
+            return;
+        }
+        auto &pendingReads = reader->pendingReads;
+        pendingReads.erase(std::find(pendingReads.begin(), pendingReads.end(), read.get()));
 
-    /* Abort any pending async. request */
-    void abort() {
+        if (result <= 0) {
+            if (result < 0) {
+                log_error("Failed to read file: {} ({})", reader->fileName, uv_strerror(int(result)));
+            }
+            for (auto &cb : read->cbs) {
+                cb(std::string_view(nullptr, 0));
+            }
+            return;
+        }
 
+        /* The completed chunk becomes the cache so every waiting response can peek it */
+        read->buffer.resize(size_t(result));
+        reader->fileCache->resize(reader, read->buffer.length(), true);
+        reader->cache = std::move(read->buffer);
+        reader->cacheOffset = read->offset;
+        reader->hasCache = true;
+
+        for (auto &cb : read->cbs) {
+            cb(reader->peek(read->offset));
+        }
     }
 
-    int getFileSize() {
-        return fileSize;
+    /* Release the buffer so another file can use the budget */
+    void release() {
+        std::string().swap(cache);
+        hasCache = false;
     }
 };
+
+inline bool FileCache::resize(AsyncFileReader* reader, size_t size, bool canEvict) {
+    const size_t oldSize = reader->isResident ? reader->cache.length() : 0;
+    while ((totalSize - oldSize + size > capacity) && canEvict) {
+        // NOTE: Reads in flight have their own buffer so any resident cache can go
+        auto it = std::find_if(lru.rbegin(), lru.rend(), [reader](AsyncFileReader* other) {
+            return (other != reader) && other->hasCache;
+        });
+        if (it == lru.rend()) break;
+        AsyncFileReader* victim = *it;
+        totalSize -= victim->cache.length();
+        lru.erase(victim->lruIt);
+        victim->isResident = false;
+        victim->release();
+    }
+    if (!canEvict && (totalSize - oldSize + size > capacity)) {
+        return false;
+    }
+
+    totalSize = totalSize - oldSize + size;
+    if (reader->isResident) {
+        lru.erase(reader->lruIt);
+    }
+    lru.push_front(reader);
+    reader->lruIt = lru.begin();
+    reader->isResident = true;
+    return true;
+}
+
+inline void FileCache::touch(AsyncFileReader* reader) {
+    if (!reader->isResident || (reader->lruIt == lru.begin())) return;
+    lru.splice(lru.begin(), lru, reader->lruIt);
+}
@@ -1,18 +1,25 @@
 // Source: https://github.com/uNetworking/uWebSockets/blob/526a9ad6cdc0299b95ef9c8d337ce99d2cac120a/examples/helpers/AsyncFileStreamer.h
+// Modified so files share a memory bounded cache
+// Modified so responses stop waiting on reads when the peer disconnects
 #pragma once
 
 #include <filesystem>
 #include <memory>
+#include <vector>
 #include "get_mime_type.hpp"
+#include "utility/logger.hpp"
 
 struct AsyncFileStreamer {
 
+    uv_loop_t *loop;
+    FileCache fileCache;
     std::map<std::string, std::unique_ptr<AsyncFileReader>, std::less<>> asyncFileReaders;
     std::string root;
 
-    AsyncFileStreamer(std::string root) : root(root) {
+    AsyncFileStreamer(uv_loop_t *loop, std::string root, size_t cacheSize) : loop(loop), fileCache(cacheSize), root(root) {
         // for all files in this path, init the map of AsyncFileReaders
         updateRootCache();
+        preloadCache();
     }
 
     void updateRootCache() {
@@ -26,16 +33,37 @@ struct AsyncFileStreamer {
             std::string relative_filepath = absolute_filepath.substr(root.length());
             std::replace(relative_filepath.begin(), relative_filepath.end(), '\\', '/');
 
-            std::cout << "Cached file: " << relative_filepath << std::endl;
-            asyncFileReaders[std::move(relative_filepath)] = std::make_unique<AsyncFileReader>(std::move(absolute_filepath));
+            asyncFileReaders[std::move(relative_filepath)] = std::make_unique<AsyncFileReader>(loop, std::move(absolute_filepath), &fileCache);
         }
     }
 
+    // Smallest files first so the budget holds as many files as possible
+    // Everything else is read when requested and evicted least recently used first
+    void preloadCache() {
+        std::vector<std::pair<std::string_view, AsyncFileReader*>> readers;
+        size_t totalSize = 0;
+        for (auto &[filepath, reader] : asyncFileReaders) {
+            readers.push_back({filepath, reader.get()});
+            totalSize += size_t(reader->getFileSize());
+        }
+        std::sort(readers.begin(), readers.end(), [](const auto& a, const auto& b) {
+            return a.second->getFileSize() < b.second->getFileSize();
+        });
+        size_t totalCached = 0;
+        for (auto &[filepath, reader] : readers) {
+            const bool isCached = reader->preload();
+            totalCached += isCached ? 1 : 0;
+            log_debug(isCached ? "Cached file: {} ({} bytes)" : "Streamed file: {} ({} bytes)", filepath, reader->getFileSize());
+        }
+        printf("Static file cache: %zu/%zu files resident, %zu/%zu KB of %zu KB budget\n",
+            totalCached, readers.size(), fileCache.totalSize/1024, totalSize/1024, fileCache.capacity/1024);
+    }
+
     template <bool SSL>
     void streamFile(uWS::HttpResponse<SSL> *res, std::string_view url) {
         auto it = asyncFileReaders.find(url);
         if (it == asyncFileReaders.end()) {
-            std::cout << "Did not find file: " << url << std::endl;
+            log_info("Did not find file: {}", url);
             res->writeStatus("404 Not Found");
             res->end();
             return;
@@ -46,6 +74,10 @@ struct AsyncFileStreamer {
         if (!mime_type.empty()) {
             res->writeHeader("Content-Type", mime_type);
         }
+        if (it->second->getFileSize() == 0) {
+            res->end();
+            return;
+        }
         streamFile(res, it->second.get());
     }
 
@@ -53,48 +85,41 @@ struct AsyncFileStreamer {
     static void streamFile(uWS::HttpResponse<SSL> *res, AsyncFileReader *asyncFileReader) {
         /* Peek from cache */
         std::string_view chunk = asyncFileReader->peek(int(res->getWriteOffset()));
-        if (!chunk.length() || res->tryEnd(chunk, asyncFileReader->getFileSize()).first) {
-            /* Request new chunk */
-            // todo: we need to abort this callback if peer closed!
-            // this also means Loop::defer needs to support aborting (functions should embedd an atomic boolean abort or something)
-
-            // Loop::defer(f) -> integer
-            // Loop::abort(integer)
-
-            // hmm? no?
-
-            // us_socket_up_ref eftersom vi delar ägandeskapet
-
-            if (chunk.length() < asyncFileReader->getFileSize()) {
-                asyncFileReader->request(int(res->getWriteOffset()), [res, asyncFileReader](std::string_view chunk) {
-                    // check if we were closed in the mean time
-                    //if (us_socket_is_closed()) {
-                        // free it here
-                        //return;
-                    //}
-
-                    /* We were aborted for some reason */
-                    if (!chunk.length()) {
-                        // todo: make sure to check for is_closed internally after all callbacks!
-                        res->close();
-                    } else {
-                        AsyncFileStreamer::streamFile(res, asyncFileReader);
-                    }
+        if (chunk.length()) {
+            auto [isWritten, hasResponded] = res->tryEnd(chunk, asyncFileReader->getFileSize());
+            if (hasResponded) {
+                return;
+            }
+            if (!isWritten) {
+                /* We failed writing everything, so let's continue when we can */
+                res->onWritable([res, asyncFileReader](size_t offset) {
+                    AsyncFileStreamer::streamFile(res, asyncFileReader);
+                    return false;
+                })->onAborted([asyncFileReader]() {
+                    log_debug("Aborted response while streaming {}", asyncFileReader->getFileName());
                 });
+                return;
             }
-        } else {
-            /* We failed writing everything, so let's continue when we can */
-            res->onWritable([res, asyncFileReader](size_t offset) {
-
-                // här kan skiten avbrytas!
+        }
 
+        /* Request new chunk */
+        // NOTE: The response is freed if the peer disconnects while the read is in flight
+        //       so the callback only touches it if we weren't aborted
+        auto isAborted = std::make_shared<bool>(false);
+        res->onAborted([isAborted]() {
+            *isAborted = true;
+        });
+        asyncFileReader->request(int(res->getWriteOffset()), [res, asyncFileReader, isAborted](std::string_view chunk) {
+            if (*isAborted) {
+                return;
+            }
+            /* The read failed so there is nothing left to send */
+            if (!chunk.length()) {
+                res->close();
+            } else {
                 AsyncFileStreamer::streamFile(res, asyncFileReader);
-                // todo: I don't really know what this is supposed to mean?
-                return false;
-            })->onAborted([]() {
-                std::cout << "ABORTED!" << std::endl;
-            });
-        }
+            }
+        });
     }
 
     inline bool hasExt(std::string_view file, std::string_view ext) {
@@ -0,0 +1,118 @@
+#include "create_observer.hpp"
+#include <stdio.h>
+#include <string_view>
+
+struct ObserverTopic {
+    char buf[16];
+    std::string_view view;
+    ObserverTopic(uint8_t channel) {
+        const int N = snprintf(buf, sizeof(buf), "observe/%u", unsigned(channel));
+        view = std::string_view(buf, size_t(N));
+    }
+};
+
+uWS::App::WebSocketBehavior<ObserverSession> create_observer(ObserverContext* context) {
+    uWS::App::WebSocketBehavior<ObserverSession> websocket;
+    websocket.compression = uWS::CompressOptions::DISABLED;
+    // NOTE: Observers only send a channel id
+    websocket.maxPayloadLength = 16;
+    websocket.idleTimeout = 120;
+    // NOTE: Deltas only carry changed fields so an observer that drops frames would show stale state
+    //       Disconnect it instead so that it reconnects and gets a new snapshot
+    websocket.maxBackpressure = 16*1024;
+    websocket.closeOnBackpressureLimit = true;
+    websocket.open = [context](auto *ws) {
+        context->on_open(ws);
+    };
+    websocket.message = [context](auto *ws, std::string_view message, uWS::OpCode opCode) {
+        if (opCode != uWS::BINARY) {
+            return;
+        }
+
+        auto buf = tcb::span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(message.data()),
+            message.size()
+        );
+        context->on_message(ws, buf);
+    };
+    websocket.close = [context](auto *ws, int code, std::string_view message) {
+        context->on_close(ws);
+    };
+    return websocket;
+}
+
+void ObserverContext::publish_changes() {
+    if (app == nullptr) return;
+    if (stats.total_active == 0) return;
+    source->publish_changes(this);
+}
+
+void ObserverContext::close_all() {
+    // NOTE: Closing calls on_close which modifies the set
+    auto closing = sockets;
+    for (auto* ws: closing) {
+        ws->end(1001, "Server shutting down");
+    }
+}
+
+bool ObserverContext::has_subscribers(uint8_t channel) {
+    const auto topic = ObserverTopic(channel);
+    return app->numSubscribers(topic.view) > 0;
+}
+
+void ObserverContext::publish(uint8_t channel, tcb::span<const uint8_t> frame) {
+    const auto topic = ObserverTopic(channel);
+    const auto view = std::string_view(reinterpret_cast<const char*>(frame.data()), frame.size());
+    app->publish(topic.view, view, uWS::OpCode::BINARY);
+    stats.total_frames++;
+    stats.total_bytes += frame.size();
+}
+
+void ObserverContext::on_open(ObserverWebsocket* ws) {
+    stats.total_connections++;
+    stats.total_active++;
+    sockets.insert(ws);
+}
+
+void ObserverContext::on_close(ObserverWebsocket* ws) {
+    stats.total_active--;
+    sockets.erase(ws);
+}
+
+// Subscribe to a channel and start with a full snapshot
+void ObserverContext::on_message(ObserverWebsocket* ws, tcb::span<const uint8_t> buf) {
+    constexpr size_t N = 1;
+    if (buf.size() != N) {
+        ws->end(1008, "Expected channel id");
+        return;
+    }
+
+    auto* session = ws->getUserData();
+    if (session->is_subscribed) {
+        ws->unsubscribe(ObserverTopic(session->channel).view);
+    }
+    session->channel = buf[0];
+    session->is_subscribed = true;
+    ws->subscribe(ObserverTopic(session->channel).view);
+    stats.total_subscribes++;
+
+    const auto snapshot = source->get_snapshot(session->channel);
+    if (!snapshot.empty()) {
+        ws->send(std::string_view(reinterpret_cast<const char*>(snapshot.data()), snapshot.size()), uWS::OpCode::BINARY);
+    }
+}
+
+void ObserverContext::write_stats(std::string& dst) const {
+    char buf[256];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"observer\":{"
+        "\"connections\":%llu,\"active\":%llu,\"subscribes\":%llu,\"frames\":%llu,\"bytes\":%llu"
+        "}",
+        (unsigned long long)stats.total_connections,
+        (unsigned long long)stats.total_active,
+        (unsigned long long)stats.total_subscribes,
+        (unsigned long long)stats.total_frames,
+        (unsigned long long)stats.total_bytes
+    );
+    dst.append(buf, size_t(N));
+}
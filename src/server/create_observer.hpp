@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+#include <uwebsockets/App.h>
+#include "observer.hpp"
+
+struct ObserverStats {
+    uint64_t total_connections = 0;
+    uint64_t total_active = 0;
+    uint64_t total_subscribes = 0;
+    uint64_t total_frames = 0;
+    uint64_t total_bytes = 0;
+};
+
+struct ObserverSession {
+    bool is_subscribed = false;
+    uint8_t channel = 0;
+};
+
+using ObserverWebsocket = uWS::WebSocket<false, true, ObserverSession>;
+
+// Fans out state to observers through uWS topics, one topic per channel
+class ObserverContext: public ObserverPublisher
+{
+public:
+    ObserverStats stats;
+private:
+    uWS::App* app;
+    ObserverSource* const source;
+    std::unordered_set<ObserverWebsocket*> sockets;
+public:
+    ObserverContext(ObserverSource* _source): app(nullptr), source(_source) {}
+    void attach(uWS::App* _app) { app = _app; }
+    // Called at the publish rate
+    void publish_changes();
+    // Disconnect all observers when shutting down
+    void close_all();
+    void write_stats(std::string& dst) const;
+    bool has_subscribers(uint8_t channel) override;
+    void publish(uint8_t channel, tcb::span<const uint8_t> frame) override;
+    // Internal methods for the websocket behaviour
+    void on_open(ObserverWebsocket* ws);
+    void on_close(ObserverWebsocket* ws);
+    void on_message(ObserverWebsocket* ws, tcb::span<const uint8_t> buf);
+};
+
+uWS::App::WebSocketBehavior<ObserverSession> create_observer(ObserverContext* context);
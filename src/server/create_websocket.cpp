@@ -1,45 +1,59 @@
 #include "create_websocket.hpp"
+#include "low_latency.hpp"
+#include "utility/trace.hpp"
+#include "utility/logger.hpp"
+#include <stdio.h>
+#include <algorithm>
 
-uWS::App::WebSocketBehavior<std::unique_ptr<PacketHandler>> create_websocket(PacketHandlerFactory* factory) {
-    uWS::App::WebSocketBehavior<std::unique_ptr<PacketHandler>> websocket;
+uWS::App::WebSocketBehavior<WebsocketSession> create_websocket(PacketHandlerFactory* factory, WebsocketContext* context) {
+    uWS::App::WebSocketBehavior<WebsocketSession> websocket;
     websocket.compression = uWS::CompressOptions::DISABLED;
     websocket.maxPayloadLength = 16*1024;
     websocket.idleTimeout = 120;
-    websocket.maxBackpressure = 64*1024;
-    websocket.upgrade = [factory](auto *res, auto *req, auto *context) {
+    websocket.maxBackpressure = WebsocketContext::MAX_BACKPRESSURE;
+    websocket.upgrade = [factory, context](auto *res, auto *req, auto *us_context) {
+        const auto& rate_limit = context->config.rate_limit;
+        WebsocketSession session;
+        session.handler = factory->create_handler();
+        session.message_bucket = TokenBucket(rate_limit.messages);
+        session.byte_bucket = TokenBucket(rate_limit.bytes);
+        session.reject_bucket = TokenBucket(rate_limit.rejects);
         res->upgrade(
-            factory->create_handler(),
+            std::move(session),
             req->getHeader("sec-websocket-key"),
             req->getHeader("sec-websocket-protocol"),
             req->getHeader("sec-websocket-extensions"),
-            context
+            us_context
         );
     };
-    websocket.open = [](auto *ws) {
-        auto* handler = ws->getUserData()->get();
+    websocket.open = [context](auto *ws) {
+        auto* session = ws->getUserData();
+        session->ws = ws;
+        session->log_session_id = get_log_registry().create_session_id();
+        LogSessionScope log_scope(session->log_session_id);
+        log_info("Websocket connected from {}", ws->getRemoteAddressAsText());
+        // NOTE: User data has a stable address once the websocket is open
+        session->sink.context = context;
+        session->sink.session = session;
+        session->handler->attach_sink(&session->sink);
+        context->on_open(session);
     };
-    websocket.message = [](auto *ws, std::string_view message, uWS::OpCode opCode) {
+    websocket.message = [context](auto *ws, std::string_view message, uWS::OpCode opCode) {
+        TRACE_SPAN(TraceSpanId::WEBSOCKET_MESSAGE);
         if (opCode != uWS::BINARY) {
             return;
         }
 
-        auto* handler = ws->getUserData()->get();
         auto buf = tcb::span<const uint8_t>(
             reinterpret_cast<const uint8_t*>(message.data()), 
             message.size()
         );
-
-        auto res = handler->on_packet(buf);
-        if (res.size() > 0) {
-            auto res_view = std::string_view(
-                reinterpret_cast<const char*>(res.data()),
-                res.size()
-            );
-            ws->send(res_view);
-        }
+        auto* session = ws->getUserData();
+        LogSessionScope log_scope(session->log_session_id);
+        context->on_message(session, buf);
     };
-    websocket.drain = [](auto *ws) {
-
+    websocket.drain = [context](auto *ws) {
+        context->on_drain(ws->getUserData());
     };
     websocket.ping = [](auto *ws, std::string_view) {
 
@@ -47,9 +61,332 @@ uWS::App::WebSocketBehavior<std::unique_ptr<PacketHandler>> create_websocket(Pac
     websocket.pong = [](auto *ws, std::string_view) {
 
     };
-    websocket.close = [](auto *ws, int code, std::string_view message) {
-
+    websocket.close = [context](auto *ws, int code, std::string_view message) {
+        auto* session = ws->getUserData();
+        LogSessionScope log_scope(session->log_session_id);
+        log_info("Websocket disconnected with code {}", code);
+        context->on_close(session);
     };
 
     return websocket;
-}
\ No newline at end of file
+}
+
+void WebsocketContext::on_open(WebsocketSession* session) {
+    const auto& socket_config = config.socket;
+    if (socket_config.is_no_delay || (socket_config.busy_poll_us > 0)) {
+        const auto sock = uv_os_sock_t(reinterpret_cast<uintptr_t>(session->ws->getNativeHandle()));
+        if (!tune_socket(sock, true, socket_config) && !is_tune_failure_logged) {
+            is_tune_failure_logged = true;
+            log_warn("Failed to set low latency options on websocket connections");
+        }
+    }
+    stats.total_connections++;
+    stats.total_active++;
+    sessions.push_back(session);
+}
+
+void WebsocketContext::on_close(WebsocketSession* session) {
+    stats.total_active--;
+    auto it = std::find(sessions.begin(), sessions.end(), session);
+    if (it != sessions.end()) {
+        *it = sessions.back();
+        sessions.pop_back();
+    }
+    remove_conflated(session);
+    remove_outgoing(session);
+    session->ws = nullptr;
+    session->sink.session = nullptr;
+}
+
+void WebsocketContext::on_drain(WebsocketSession* session) {
+    if (session->is_dropping_acks && (session->ws->getBufferedAmount() <= config.ack_drop_threshold)) {
+        session->is_dropping_acks = false;
+    }
+}
+
+void WebsocketContext::on_message(WebsocketSession* session, tcb::span<const uint8_t> buf) {
+    stats.total_messages++;
+    if (!config.rate_limit.is_enabled) {
+        process(session, buf);
+        return;
+    }
+
+    // Older conflated packets must be applied before newer ones
+    const auto now = TokenBucket::Clock::now();
+    const bool is_flushed = flush_session(session, now);
+    if (is_flushed && try_consume(session, buf.size(), now)) {
+        process(session, buf);
+        return;
+    }
+
+    stats.total_throttled++;
+    const auto info = session->handler->get_packet_info(buf);
+    auto* packet = (info.priority == PacketPriority::CONFLATE) && (buf.size() <= ConflatedPacket::MAX_LENGTH)
+        ? find_conflated(session, info.conflate_key) : nullptr;
+    // NOTE: Keys past the queue's capacity are rejected like any other throttled packet
+    if (packet != nullptr) {
+        packet->length = uint8_t(buf.size());
+        std::copy(buf.begin(), buf.end(), packet->data.begin());
+        if (!session->is_conflated) {
+            session->is_conflated = true;
+            conflated_sessions.push_back(session);
+        }
+        stats.total_conflated++;
+        return;
+    }
+
+    stats.total_rejected++;
+    send(session, session->handler->on_rate_limited(buf));
+    if (!session->reject_bucket.try_consume(1.0f, now)) {
+        stats.total_disconnects++;
+        log_warn("Disconnecting websocket client due to flooding");
+        remove_conflated(session);
+        session->conflated.clear();
+        // NOTE: Send the rejection before closing since the queue is discarded on close
+        write_outgoing(session);
+        // NOTE: This calls websocket.close which erases the session from our context
+        session->ws->end(1008, "Rate limit exceeded");
+    }
+}
+
+void WebsocketContext::flush_conflated() {
+    const auto now = TokenBucket::Clock::now();
+    for (size_t i = 0; i < conflated_sessions.size();) {
+        auto* session = conflated_sessions[i];
+        if (flush_session(session, now)) {
+            session->is_conflated = false;
+            conflated_sessions[i] = conflated_sessions.back();
+            conflated_sessions.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
+
+void WebsocketContext::update_flow_control(float loop_load) {
+    const auto& flow_config = config.flow_control;
+    float max_rate_hz = float(flow_config.max_rate_hz);
+    // NOTE: A joystick sends one packet per axis so leave headroom under the message rate limit
+    if (config.rate_limit.is_enabled) {
+        max_rate_hz = std::min(max_rate_hz, config.rate_limit.messages.rate/4.0f);
+    }
+    const float min_rate_hz = std::min(float(flow_config.min_rate_hz), max_rate_hz);
+    // Back off once the loop is busy for more than half the time
+    const float load_scale = std::clamp((1.0f - loop_load)*2.0f, 0.0f, 1.0f);
+    constexpr int RATE_STEP_HZ = 5;
+    for (auto* session: sessions) {
+        // Replies queue up in the websocket when the client or network can't keep up
+        const float buffered = float(session->ws->getBufferedAmount());
+        const float backpressure_scale = std::clamp(1.0f - buffered/float(MAX_BACKPRESSURE/2), 0.0f, 1.0f);
+        const float rate_hz = std::max(min_rate_hz, max_rate_hz*load_scale*backpressure_scale);
+        // NOTE: Rounded down to steps so small fluctuations aren't sent
+        FlowControl flow;
+        flow.max_rate_hz = uint16_t(std::max(RATE_STEP_HZ, int(rate_hz)/RATE_STEP_HZ*RATE_STEP_HZ));
+        flow.batch_ms = uint16_t(std::max(1, 1000/int(flow.max_rate_hz)));
+        if ((flow.max_rate_hz == session->flow.max_rate_hz) && (flow.batch_ms == session->flow.batch_ms)) {
+            continue;
+        }
+        session->flow = flow;
+        send(session, session->handler->on_flow_control(flow));
+    }
+}
+
+// Returns the packet with this key, a new one if there is none, or nullptr if the queue is full
+ConflatedPacket* WebsocketContext::find_conflated(WebsocketSession* session, uint16_t key) {
+    auto& packets = session->conflated;
+    for (size_t i = 0; i < packets.size(); i++) {
+        if (packets[i].key == key) return &packets[i];
+    }
+    ConflatedPacket packet;
+    packet.key = key;
+    if (!packets.push_back(packet)) return nullptr;
+    return &packets.back();
+}
+
+void WebsocketContext::remove_conflated(WebsocketSession* session) {
+    if (!session->is_conflated) return;
+    session->is_conflated = false;
+    auto it = std::find(conflated_sessions.begin(), conflated_sessions.end(), session);
+    if (it != conflated_sessions.end()) {
+        *it = conflated_sessions.back();
+        conflated_sessions.pop_back();
+    }
+}
+
+void WebsocketContext::close_all() {
+    flush_outgoing();
+    // NOTE: Closing a websocket calls on_close which modifies our session list
+    auto open_sessions = sessions;
+    for (auto* session: open_sessions) {
+        session->ws->end(1001, "Server shutting down");
+    }
+}
+
+// Returns true if there are no conflated packets left
+bool WebsocketContext::flush_session(WebsocketSession* session, TokenBucket::Clock::time_point now) {
+    auto& packets = session->conflated;
+    while (!packets.empty()) {
+        const auto& packet = packets.front();
+        const auto buf = tcb::span<const uint8_t>(packet.data.data(), packet.length);
+        if (!try_consume(session, buf.size(), now)) {
+            break;
+        }
+        process(session, buf);
+        packets.pop_front();
+    }
+    return packets.empty();
+}
+
+bool WebsocketContext::try_consume(WebsocketSession* session, const size_t total_bytes, TokenBucket::Clock::time_point now) {
+    // NOTE: Check both buckets before consuming so a failure doesn't cost any tokens
+    if (!session->message_bucket.can_consume(1.0f, now)) return false;
+    if (!session->byte_bucket.try_consume(float(total_bytes), now)) return false;
+    if (!session->message_bucket.try_consume(1.0f, now)) return false;
+    return true;
+}
+
+void WebsocketContext::process(WebsocketSession* session, tcb::span<const uint8_t> buf) {
+    auto res = session->handler->on_packet(buf);
+    send(session, res);
+}
+
+void WebsocketContext::send(WebsocketSession* session, tcb::span<const uint8_t> buf) {
+    session->sink.send_packet(buf);
+}
+
+void WebsocketSink::send_packet(tcb::span<const uint8_t> buf) {
+    if (session == nullptr) return;
+    context->queue_send(session, buf);
+}
+
+void WebsocketContext::queue_send(WebsocketSession* session, tcb::span<const uint8_t> buf) {
+    if (buf.size() == 0) return;
+    if (session->ws == nullptr) return;
+    // Client already knows what it sent succeeded unless told otherwise, so acks go first when it falls behind
+    const size_t total_pending = size_t(session->ws->getBufferedAmount()) + session->total_outgoing;
+    if ((total_pending > config.ack_drop_threshold) && session->handler->get_is_droppable(buf)) {
+        if (!session->is_dropping_acks) {
+            session->is_dropping_acks = true;
+            stats.total_backpressure_events++;
+        }
+        stats.total_acks_dropped++;
+        stats.total_ack_bytes_saved += buf.size();
+        return;
+    }
+
+    // NOTE: The buffer belongs to the handler and is reused by its next response so it is copied
+    //       Queued packets are written early if it doesn't fit, which keeps them in order
+    auto& outgoing = session->outgoing;
+    if (session->total_outgoing + 2 + buf.size() > outgoing.size()) {
+        write_outgoing(session);
+    }
+    if (2 + buf.size() > outgoing.size()) {
+        const auto view = std::string_view(reinterpret_cast<const char*>(buf.data()), buf.size());
+        session->ws->send(view, uWS::BINARY);
+        stats.total_sends++;
+        return;
+    }
+    size_t i = session->total_outgoing;
+    outgoing[i++] = uint8_t(buf.size());
+    outgoing[i++] = uint8_t(buf.size() >> 8);
+    std::copy(buf.begin(), buf.end(), outgoing.begin() + i);
+    session->total_outgoing = i + buf.size();
+    if (!session->is_outgoing) {
+        session->is_outgoing = true;
+        outgoing_sessions.push_back(session);
+    }
+}
+
+void WebsocketContext::flush_outgoing() {
+    // NOTE: Sending never closes the socket since closeOnBackpressureLimit is off, so the list can't change here
+    for (auto* session: outgoing_sessions) {
+        session->is_outgoing = false;
+        write_outgoing(session);
+    }
+    outgoing_sessions.clear();
+}
+
+void WebsocketContext::write_outgoing(WebsocketSession* session) {
+    const auto& outgoing = session->outgoing;
+    const size_t total_outgoing = session->total_outgoing;
+    session->total_outgoing = 0;
+    if ((total_outgoing == 0) || (session->ws == nullptr)) {
+        return;
+    }
+    TRACE_SPAN(TraceSpanId::WEBSOCKET_SEND);
+    // NOTE: Corking turns every message below into a single socket write
+    session->ws->cork([this, session, &outgoing, total_outgoing]() {
+        for (size_t i = 0; i+2 <= total_outgoing;) {
+            const size_t length = size_t(outgoing[i]) | size_t(outgoing[i+1]) << 8;
+            const auto view = std::string_view(reinterpret_cast<const char*>(outgoing.data()+i+2), length);
+            i += 2+length;
+            const auto status = session->ws->send(view, uWS::BINARY);
+            stats.total_sends++;
+            if (status == Websocket::SendStatus::BACKPRESSURE) stats.total_send_backpressure++;
+            if (status == Websocket::SendStatus::DROPPED) stats.total_send_dropped++;
+        }
+    });
+    stats.total_corked_writes++;
+}
+
+void WebsocketContext::remove_outgoing(WebsocketSession* session) {
+    session->total_outgoing = 0;
+    if (!session->is_outgoing) return;
+    session->is_outgoing = false;
+    auto it = std::find(outgoing_sessions.begin(), outgoing_sessions.end(), session);
+    if (it != outgoing_sessions.end()) {
+        *it = outgoing_sessions.back();
+        outgoing_sessions.pop_back();
+    }
+}
+
+void WebsocketContext::write_stats(std::string& dst) const {
+    char buf[512];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"websocket\":{"
+        "\"connections\":%llu,\"active\":%llu,\"messages\":%llu,"
+        "\"throttled\":%llu,\"conflated\":%llu,\"rejected\":%llu,\"disconnects\":%llu,"
+        "\"sends\":%llu,\"corked_writes\":%llu,\"send_backpressure\":%llu,\"send_dropped\":%llu,"
+        "\"backpressure_events\":%llu,\"acks_dropped\":%llu,\"ack_bytes_saved\":%llu,",
+        (unsigned long long)stats.total_connections,
+        (unsigned long long)stats.total_active,
+        (unsigned long long)stats.total_messages,
+        (unsigned long long)stats.total_throttled,
+        (unsigned long long)stats.total_conflated,
+        (unsigned long long)stats.total_rejected,
+        (unsigned long long)stats.total_disconnects,
+        (unsigned long long)stats.total_sends,
+        (unsigned long long)stats.total_corked_writes,
+        (unsigned long long)stats.total_send_backpressure,
+        (unsigned long long)stats.total_send_dropped,
+        (unsigned long long)stats.total_backpressure_events,
+        (unsigned long long)stats.total_acks_dropped,
+        (unsigned long long)stats.total_ack_bytes_saved
+    );
+    dst.append(buf, size_t(N));
+
+    dst.append("\"sessions\":[");
+    bool is_first = true;
+    for (const auto* session: sessions) {
+        if (!is_first) dst.append(",");
+        is_first = false;
+        dst.append("{\"address\":\"");
+        if (session->ws != nullptr) {
+            dst.append(session->ws->getRemoteAddressAsText());
+        }
+        dst.append("\"");
+        if (session->flow.max_rate_hz > 0) {
+            const int N = snprintf(buf, sizeof(buf), ",\"flow_rate_hz\":%u", unsigned(session->flow.max_rate_hz));
+            dst.append(buf, size_t(N));
+        }
+        // NOTE: Remove the separator if the handler has nothing to add
+        const size_t length = dst.size();
+        dst.append(",");
+        session->handler->write_stats(dst);
+        if (dst.size() == length+1) {
+            dst.resize(length);
+        }
+        dst.append("}");
+    }
+    dst.append("]}");
+}
@@ -1,7 +1,122 @@
 #pragma once
+#include <stdint.h>
+#include <array>
 #include <memory>
+#include <string>
+#include <vector>
 #include <uwebsockets/App.h>
 #include "packet_handler.hpp"
+#include "rate_limiter.hpp"
+#include "utility/fixed_queue.hpp"
+#include "server_config.hpp"
+
+struct WebsocketStats {
+    uint64_t total_connections = 0;
+    uint64_t total_active = 0;
+    uint64_t total_messages = 0;
+    uint64_t total_throttled = 0;
+    uint64_t total_conflated = 0;
+    uint64_t total_rejected = 0;
+    uint64_t total_disconnects = 0;
+    // Responses queued during a loop iteration go out in one corked write per session
+    uint64_t total_sends = 0;
+    uint64_t total_corked_writes = 0;
+    // Sends that uWS buffered or dropped because the socket was full
+    uint64_t total_send_backpressure = 0;
+    uint64_t total_send_dropped = 0;
+    // Times a session started dropping acks and what was dropped
+    uint64_t total_backpressure_events = 0;
+    uint64_t total_acks_dropped = 0;
+    uint64_t total_ack_bytes_saved = 0;
+};
+
+// Packet that was held back by the rate limiter and can be overwritten by a newer one
+struct ConflatedPacket {
+    static constexpr size_t MAX_LENGTH = 16;
+    uint16_t key;
+    uint8_t length;
+    std::array<uint8_t, MAX_LENGTH> data;
+};
+
+struct WebsocketSession;
+class WebsocketContext;
+using Websocket = uWS::WebSocket<false, true, WebsocketSession>;
+
+// Queues packets on the context so they are sent together at the end of the loop iteration
+class WebsocketSink: public PacketSink 
+{
+public:
+    WebsocketContext* context = nullptr;
+    WebsocketSession* session = nullptr;
+    void send_packet(tcb::span<const uint8_t> buf) override;
+};
+
+// NOTE: Buffers have a fixed size so connecting and sending don't allocate
+struct WebsocketSession {
+    // Every axis of a device can be conflated at once
+    static constexpr size_t MAX_CONFLATED = 16;
+    static constexpr size_t OUTGOING_SIZE = 4096;
+    // NOTE: Sink is declared first so it outlives the handler
+    WebsocketSink sink;
+    std::unique_ptr<PacketHandler> handler;
+    Websocket* ws = nullptr;
+    // Tags log records while handling this session's packets
+    uint32_t log_session_id = 0;
+    TokenBucket message_bucket;
+    TokenBucket byte_bucket;
+    TokenBucket reject_bucket;
+    FixedQueue<ConflatedPacket, MAX_CONFLATED> conflated;
+    bool is_conflated = false;
+    // Last recommendation sent to the client
+    FlowControl flow;
+    // Packets waiting for the corked write, each prefixed with a u16 length
+    std::array<uint8_t, OUTGOING_SIZE> outgoing;
+    size_t total_outgoing = 0;
+    bool is_outgoing = false;
+    bool is_dropping_acks = false;
+};
+
+// Shared state between all websocket sessions on the event loop
+class WebsocketContext 
+{
+public:
+    static constexpr size_t MAX_BACKPRESSURE = 64*1024;
+    const WebsocketConfig config;
+    WebsocketStats stats;
+private:
+    // NOTE: Vectors keep their capacity so connecting and conflating don't allocate once warmed up
+    std::vector<WebsocketSession*> sessions;
+    std::vector<WebsocketSession*> conflated_sessions;
+    std::vector<WebsocketSession*> outgoing_sessions;
+    // Only the first socket that couldn't be tuned is logged
+    bool is_tune_failure_logged = false;
+public:
+    WebsocketContext(const WebsocketConfig& _config): config(_config) {}
+    // Try to process packets that were conflated while sessions were throttled
+    void flush_conflated();
+    // Send queued packets with one corked write per session, called once per loop iteration
+    void flush_outgoing();
+    void queue_send(WebsocketSession* session, tcb::span<const uint8_t> buf);
+    // Recompute each session's recommended send rate, loop_load is the fraction of time the loop was busy
+    void update_flow_control(float loop_load);
+    // Disconnect all clients when shutting down
+    void close_all();
+    void write_stats(std::string& dst) const;
+    // Internal methods for the websocket behaviour
+    void on_open(WebsocketSession* session);
+    void on_close(WebsocketSession* session);
+    void on_message(WebsocketSession* session, tcb::span<const uint8_t> buf);
+    void on_drain(WebsocketSession* session);
+private:
+    void write_outgoing(WebsocketSession* session);
+    void remove_outgoing(WebsocketSession* session);
+    ConflatedPacket* find_conflated(WebsocketSession* session, uint16_t key);
+    void remove_conflated(WebsocketSession* session);
+    bool try_consume(WebsocketSession* session, const size_t total_bytes, TokenBucket::Clock::time_point now);
+    bool flush_session(WebsocketSession* session, TokenBucket::Clock::time_point now);
+    void process(WebsocketSession* session, tcb::span<const uint8_t> buf);
+    void send(WebsocketSession* session, tcb::span<const uint8_t> buf);
+};
 
 // This websocket takes in a generic packet handler
-uWS::App::WebSocketBehavior<std::unique_ptr<PacketHandler>> create_websocket(PacketHandlerFactory* factory);
+uWS::App::WebSocketBehavior<WebsocketSession> create_websocket(PacketHandlerFactory* factory, WebsocketContext* context);
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <uv.h>
+
+// Fraction of time the libuv loop spends handling events instead of waiting for them
+class LoopLoad 
+{
+private:
+    uv_loop_t* const loop;
+    uint64_t last_time_ns;
+    uint64_t last_idle_ns;
+public:
+    LoopLoad(uv_loop_t* _loop): loop(_loop) {
+        // NOTE: Idle time is only accumulated after this is set
+        uv_loop_configure(loop, UV_METRICS_IDLE_TIME);
+        last_time_ns = uv_hrtime();
+        last_idle_ns = uv_metrics_idle_time(loop);
+    }
+
+    // Load since the last call between 0 and 1
+    float update() {
+        const uint64_t time_ns = uv_hrtime();
+        const uint64_t idle_ns = uv_metrics_idle_time(loop);
+        const uint64_t elapsed_ns = time_ns - last_time_ns;
+        const uint64_t elapsed_idle_ns = idle_ns - last_idle_ns;
+        last_time_ns = time_ns;
+        last_idle_ns = idle_ns;
+        if (elapsed_ns == 0) return 0.0f;
+        return std::clamp(1.0f - float(elapsed_idle_ns)/float(elapsed_ns), 0.0f, 1.0f);
+    }
+};
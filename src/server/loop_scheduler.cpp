@@ -0,0 +1,177 @@
+#include "loop_scheduler.hpp"
+#include <stdio.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+// NOTE: Event loop timers have millisecond resolution
+//       Tasks that are due within this window are run early instead of rearming for <1ms
+constexpr auto TIMER_RESOLUTION = std::chrono::milliseconds(1);
+
+LoopScheduler::LoopScheduler(uWS::Loop* loop)
+:   total_free(MAX_TASKS), total_pending(0), is_armed(false), is_high_resolution(false),
+    total_scheduled(0), total_executed(0), total_rejected(0), max_lateness_us(0)
+{
+    // Lowest slots are handed out first
+    for (size_t i = 0; i < MAX_TASKS; i++) {
+        free_slots[i] = uint16_t(MAX_TASKS-1-i);
+    }
+    // NOTE: Fallthrough so that pending tasks don't keep the loop alive after the server stops
+    timer = us_create_timer(reinterpret_cast<struct us_loop_t*>(loop), 1, sizeof(LoopScheduler*));
+    *static_cast<LoopScheduler**>(us_timer_ext(timer)) = this;
+}
+
+LoopScheduler::~LoopScheduler() {
+    us_timer_close(timer);
+    set_high_resolution(false);
+}
+
+// Format: <generation:32> <slot+1:32>
+TaskScheduler::TaskID LoopScheduler::schedule(Clock::time_point deadline, TaskCallback callback) {
+    if (total_free == 0) {
+        total_rejected++;
+        return INVALID_TASK;
+    }
+    const uint16_t slot_index = free_slots[--total_free];
+    auto& slot = slots[slot_index];
+    slot.callback = callback;
+    slot.deadline = deadline;
+    slot.is_pending = true;
+    slot.heap_index = uint16_t(total_pending);
+    heap[total_pending++] = slot_index;
+    heap_sift_up(slot.heap_index);
+    total_scheduled++;
+    if (!is_armed || (deadline < armed_deadline)) {
+        rearm();
+    }
+    return (TaskID(slot.generation) << 32) | TaskID(slot_index+1);
+}
+
+void LoopScheduler::cancel(TaskID id) {
+    const uint64_t index = (id & 0xFFFFFFFFull);
+    if ((index == 0) || (index > MAX_TASKS)) return;
+    const auto slot_index = uint16_t(index-1);
+    const auto& slot = slots[slot_index];
+    if (!slot.is_pending || (slot.generation != uint32_t(id >> 32))) return;
+    heap_remove(slot_index);
+    free_slot(slot_index);
+    // NOTE: The timer is left armed for the old deadline and rearms itself when it fires
+}
+
+void LoopScheduler::on_timer(struct us_timer_t* t) {
+    auto* self = *static_cast<LoopScheduler**>(us_timer_ext(t));
+    self->is_armed = false;
+    self->run_due_tasks();
+    self->rearm();
+}
+
+void LoopScheduler::run_due_tasks() {
+    while (total_pending > 0) {
+        const uint16_t slot_index = heap[0];
+        auto& slot = slots[slot_index];
+        const auto now = Clock::now();
+        if (slot.deadline - now >= TIMER_RESOLUTION) break;
+
+        // NOTE: Callback can schedule or cancel tasks so free the slot first
+        auto callback = slot.callback;
+        const auto deadline = slot.deadline;
+        heap_remove(slot_index);
+        free_slot(slot_index);
+
+        const int64_t lateness_us = std::chrono::duration_cast<std::chrono::microseconds>(now - deadline).count();
+        max_lateness_us = std::max(max_lateness_us, lateness_us);
+        total_executed++;
+        callback();
+    }
+}
+
+void LoopScheduler::rearm() {
+    if (total_pending == 0) {
+        // NOTE: A timeout of 0 stops the timer
+        us_timer_set(timer, &LoopScheduler::on_timer, 0, 0);
+        is_armed = false;
+        set_high_resolution(false);
+        return;
+    }
+
+    const auto deadline = slots[heap[0]].deadline;
+    const auto delay = deadline - Clock::now();
+    const auto delay_ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+    us_timer_set(timer, &LoopScheduler::on_timer, int(std::max<int64_t>(delay_ms, 1)), 0);
+    armed_deadline = deadline;
+    is_armed = true;
+    set_high_resolution(true);
+}
+
+void LoopScheduler::heap_remove(uint16_t slot_index) {
+    const size_t i = slots[slot_index].heap_index;
+    const size_t last = --total_pending;
+    if (i == last) return;
+    heap_swap(i, last);
+    heap_sift_up(i);
+    heap_sift_down(i);
+}
+
+void LoopScheduler::heap_sift_up(size_t i) {
+    while (i > 0) {
+        const size_t parent = (i-1)/2;
+        if (!(slots[heap[i]].deadline < slots[heap[parent]].deadline)) break;
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+void LoopScheduler::heap_sift_down(size_t i) {
+    while (true) {
+        const size_t left = 2*i+1;
+        const size_t right = left+1;
+        size_t smallest = i;
+        if ((left < total_pending) && (slots[heap[left]].deadline < slots[heap[smallest]].deadline)) smallest = left;
+        if ((right < total_pending) && (slots[heap[right]].deadline < slots[heap[smallest]].deadline)) smallest = right;
+        if (smallest == i) break;
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+void LoopScheduler::heap_swap(size_t a, size_t b) {
+    std::swap(heap[a], heap[b]);
+    slots[heap[a]].heap_index = uint16_t(a);
+    slots[heap[b]].heap_index = uint16_t(b);
+}
+
+void LoopScheduler::free_slot(uint16_t slot_index) {
+    auto& slot = slots[slot_index];
+    slot.is_pending = false;
+    slot.generation++;
+    slot.callback = TaskCallback();
+    free_slots[total_free++] = slot_index;
+}
+
+void LoopScheduler::set_high_resolution(bool is_enabled) {
+    if (is_high_resolution == is_enabled) return;
+    is_high_resolution = is_enabled;
+#ifdef _WIN32
+    // NOTE: Default windows timer resolution is ~15ms, only raise it while tasks are pending
+    if (is_enabled) {
+        timeBeginPeriod(1);
+    } else {
+        timeEndPeriod(1);
+    }
+#endif
+}
+
+void LoopScheduler::write_stats(std::string& dst) const {
+    char buf[256];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"scheduler\":{\"pending\":%zu,\"scheduled\":%llu,\"executed\":%llu,\"rejected\":%llu,\"max_lateness_us\":%lld}",
+        total_pending,
+        (unsigned long long)total_scheduled,
+        (unsigned long long)total_executed,
+        (unsigned long long)total_rejected,
+        (long long)max_lateness_us
+    );
+    dst.append(buf, size_t(N));
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <string>
+#include <uwebsockets/App.h>
+#include "./task_scheduler.hpp"
+
+// Deadline scheduler on the uWS event loop using a single one shot timer
+// Timer is rearmed to the earliest pending deadline so an idle server has no wakeups
+// Tasks live in a fixed pool of slots ordered by an indexed heap so scheduling and cancelling never allocate
+class LoopScheduler: public TaskScheduler
+{
+public:
+    // Enough for every pooled session running all of its macros with smoothing and playout
+    static constexpr size_t MAX_TASKS = 2048;
+private:
+    struct Slot {
+        TaskCallback callback;
+        Clock::time_point deadline;
+        // Bumped when the slot is freed so ids of finished tasks don't match its next task
+        uint32_t generation = 0;
+        uint16_t heap_index = 0;
+        bool is_pending = false;
+    };
+    struct us_timer_t* timer;
+    std::array<Slot, MAX_TASKS> slots;
+    std::array<uint16_t, MAX_TASKS> free_slots;
+    std::array<uint16_t, MAX_TASKS> heap;
+    size_t total_free;
+    size_t total_pending;
+    Clock::time_point armed_deadline;
+    bool is_armed;
+    bool is_high_resolution;
+    // stats
+    uint64_t total_scheduled;
+    uint64_t total_executed;
+    uint64_t total_rejected;
+    int64_t max_lateness_us;
+public:
+    LoopScheduler(uWS::Loop* loop);
+    ~LoopScheduler() override;
+    LoopScheduler(const LoopScheduler&) = delete;
+    LoopScheduler(LoopScheduler&&) = delete;
+    LoopScheduler& operator=(const LoopScheduler&) = delete;
+    LoopScheduler& operator=(LoopScheduler&&) = delete;
+
+    TaskID schedule(Clock::time_point deadline, TaskCallback callback) override;
+    void cancel(TaskID id) override;
+    void write_stats(std::string& dst) const;
+private:
+    static void on_timer(struct us_timer_t* t);
+    void run_due_tasks();
+    void rearm();
+    void set_high_resolution(bool is_enabled);
+    // Indexed min heap by deadline
+    void heap_remove(uint16_t slot_index);
+    void heap_sift_up(size_t i);
+    void heap_sift_down(size_t i);
+    void heap_swap(size_t a, size_t b);
+    void free_slot(uint16_t slot_index);
+};
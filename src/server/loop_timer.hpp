@@ -0,0 +1,34 @@
+#pragma once
+#include <functional>
+#include <uwebsockets/App.h>
+
+// Repeating timer that runs on the uWS event loop
+class LoopTimer 
+{
+private:
+    struct us_timer_t* timer;
+    std::function<void()> callback;
+public:
+    LoopTimer(uWS::Loop* loop, const int interval_ms, std::function<void()> _callback)
+    :   callback(std::move(_callback))
+    {
+        // NOTE: Fallthrough so that the timer doesn't keep the loop alive if the server fails to start
+        timer = us_create_timer(reinterpret_cast<struct us_loop_t*>(loop), 1, sizeof(LoopTimer*));
+        *static_cast<LoopTimer**>(us_timer_ext(timer)) = this;
+        us_timer_set(timer, &LoopTimer::on_timer, interval_ms, interval_ms);
+    }
+
+    ~LoopTimer() {
+        us_timer_close(timer);
+    }
+
+    LoopTimer(const LoopTimer&) = delete;
+    LoopTimer(LoopTimer&&) = delete;
+    LoopTimer& operator=(const LoopTimer&) = delete;
+    LoopTimer& operator=(LoopTimer&&) = delete;
+private:
+    static void on_timer(struct us_timer_t* t) {
+        auto* self = *static_cast<LoopTimer**>(us_timer_ext(t));
+        self->callback();
+    }
+};
@@ -0,0 +1,65 @@
+#include "low_latency.hpp"
+#include "utility/thread_tuning.hpp"
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+void apply_low_latency(uv_loop_t* loop, const LowLatencyConfig& config) {
+    if ((config.loop_cpu < 0) && !config.is_high_priority) return;
+    // NOTE: New threads inherit the affinity and priority of the thread that creates them
+    //       libuv creates its thread pool on the first work request, so the file reads would end up on our core
+    auto* req = new uv_work_t;
+    uv_queue_work(loop, req, [](uv_work_t*) {}, [](uv_work_t* req, int) {
+        delete req;
+    });
+
+    if ((config.loop_cpu >= 0) && !pin_current_thread(config.loop_cpu)) {
+        fprintf(stderr, "Failed to pin the event loop to cpu %d\n", config.loop_cpu);
+    }
+    if (config.is_high_priority) {
+        // NOTE: A busy polling thread at realtime priority never lets kernel work on its core run
+        //       so it only gets the highest normal priority
+        const auto priority = config.is_busy_poll ? ThreadPriority::HIGH : ThreadPriority::REALTIME;
+        if (!raise_current_thread_priority(priority)) {
+            fprintf(stderr, "Failed to raise the priority of the event loop, continuing with normal priority\n");
+        }
+    }
+}
+
+bool tune_socket(uv_os_sock_t sock, bool is_tcp, const SocketConfig& config) {
+    bool is_success = true;
+    if (is_tcp && config.is_no_delay) {
+        int flag = 1;
+        is_success = (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&flag), sizeof(flag)) == 0) && is_success;
+    }
+    if (config.busy_poll_us > 0) {
+// NOTE: Not supported on windows so it is skipped there
+#ifdef SO_BUSY_POLL
+        const int busy_poll_us = config.busy_poll_us;
+        is_success = (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(busy_poll_us)) == 0) && is_success;
+#endif
+    }
+    return is_success;
+}
+
+bool tune_socket(uv_handle_t* handle, bool is_tcp, const SocketConfig& config) {
+    uv_os_fd_t fd;
+    if (uv_fileno(handle, &fd) != 0) return false;
+    // NOTE: libuv returns sockets as a HANDLE on windows
+#ifdef _WIN32
+    return tune_socket(uv_os_sock_t(reinterpret_cast<uintptr_t>(fd)), is_tcp, config);
+#else
+    return tune_socket(uv_os_sock_t(fd), is_tcp, config);
+#endif
+}
+
+void run_busy_poll(uWS::Loop* loop, uv_loop_t* uv_loop) {
+    // NOTE: Starts the handles uSockets uses for pre and post handlers, which app.run() would have done
+    loop->integrate();
+    while (uv_run(uv_loop, UV_RUN_NOWAIT) != 0) {}
+}
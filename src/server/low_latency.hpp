@@ -0,0 +1,16 @@
+#pragma once
+#include <uv.h>
+#include <uwebsockets/App.h>
+#include "server_config.hpp"
+
+// Pins and raises the priority of the calling thread, which must be the one running the event loop
+// NOTE: The libuv thread pool is started first so its threads keep the default scheduling
+void apply_low_latency(uv_loop_t* loop, const LowLatencyConfig& config);
+
+// Returns false if an option isn't permitted, options the os doesn't support are skipped
+bool tune_socket(uv_os_sock_t sock, bool is_tcp, const SocketConfig& config);
+bool tune_socket(uv_handle_t* handle, bool is_tcp, const SocketConfig& config);
+
+// Same as app.run() except the os is only ever asked for events that are already ready
+// NOTE: Returns once nothing keeps the loop alive
+void run_busy_poll(uWS::Loop* loop, uv_loop_t* uv_loop);
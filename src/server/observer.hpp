@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include "utility/span.hpp"
+
+// Destination for observer frames, implemented by the server with uWS topics
+class ObserverPublisher
+{
+public:
+    virtual ~ObserverPublisher() {};
+    virtual bool has_subscribers(uint8_t channel) = 0;
+    virtual void publish(uint8_t channel, tcb::span<const uint8_t> frame) = 0;
+};
+
+// State that read only observers can subscribe to, such as a device
+// NOTE: Handlers only mark state as changed, encoding happens at the publish rate
+//       so observers never slow down the session that owns the state
+class ObserverSource
+{
+public:
+    virtual ~ObserverSource() {};
+    // Publish frames for channels that changed since the last call
+    virtual void publish_changes(ObserverPublisher* publisher) = 0;
+    // Full state for a new subscriber
+    virtual tcb::span<const uint8_t> get_snapshot(uint8_t channel) = 0;
+};
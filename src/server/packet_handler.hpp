@@ -3,16 +3,64 @@
 #include "utility/span.hpp"
 #include <stdint.h>
 #include <memory>
+#include <string>
+#include "./task_scheduler.hpp"
+#include "./observer.hpp"
+
+// How a transport may treat a packet when the session exceeds its rate limit
+enum class PacketPriority {
+    CONTROL,    // Must be processed in order or rejected
+    CONFLATE,   // Can be replaced by a newer packet with the same conflate_key
+};
+
+struct PacketInfo {
+    PacketPriority priority = PacketPriority::CONTROL;
+    uint16_t conflate_key = 0;
+};
+
+// Send rate the server recommends so the client conflates input locally instead of flooding it
+struct FlowControl {
+    uint16_t max_rate_hz = 0;
+    uint16_t batch_ms = 0;
+};
+
+// Lets a handler send packets to its client outside of on_packet
+class PacketSink 
+{
+public:
+    virtual ~PacketSink() {};
+    virtual void send_packet(tcb::span<const uint8_t> buf) = 0;
+};
 
 class PacketHandler 
 {
 public:
     virtual ~PacketHandler() {};
     virtual tcb::span<const uint8_t> on_packet(tcb::span<const uint8_t> buf) = 0;
+    // Classify packet without processing it
+    virtual PacketInfo get_packet_info(tcb::span<const uint8_t> buf) { return {}; }
+    // Response for a control packet that was rejected by the rate limiter
+    virtual tcb::span<const uint8_t> on_rate_limited(tcb::span<const uint8_t> buf) { return {}; }
+    // Packet telling the client its recommended send rate, empty if the protocol has none
+    virtual tcb::span<const uint8_t> on_flow_control(const FlowControl& flow) { return {}; }
+    // Responses which only acknowledge success and can be dropped when the client falls behind
+    virtual bool get_is_droppable(tcb::span<const uint8_t> response) const { return false; }
+    // Transports that can push packets to the client attach a sink which outlives the handler
+    virtual void attach_sink(PacketSink* sink) {}
+    // Append per session json fields for /api/stats, e.g. "key":value
+    virtual void write_stats(std::string& dst) const {}
 };
 
 class PacketHandlerFactory 
 {
 public:
     virtual std::unique_ptr<PacketHandler> create_handler(void) = 0;
+    // Server attaches its scheduler before creating any handlers and detaches it with nullptr after they are destroyed
+    virtual void attach_scheduler(TaskScheduler* scheduler) {}
+    // Called about once a second on the event loop for work that doesn't need the scheduler's precision
+    virtual void on_housekeeping() {}
+    // State that observers can subscribe to, nullptr if there is none
+    virtual ObserverSource* get_observer_source() { return nullptr; }
+    // Append json fields for /api/stats that are shared by all handlers
+    virtual void write_stats(std::string& dst) const {}
 };
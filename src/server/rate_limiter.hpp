@@ -0,0 +1,43 @@
+#pragma once
+#include <chrono>
+
+struct TokenBucketConfig {
+    float rate;     // tokens per second
+    float burst;    // maximum tokens that can be accumulated
+};
+
+// Classic token bucket for limiting sustained rate while allowing small bursts
+class TokenBucket 
+{
+public:
+    using Clock = std::chrono::steady_clock;
+private:
+    TokenBucketConfig config;
+    float tokens;
+    Clock::time_point last_refill;
+public:
+    TokenBucket(const TokenBucketConfig _config = {1.0f, 1.0f})
+    :   config(_config), tokens(_config.burst), last_refill(Clock::now())
+    {}
+
+    bool can_consume(const float n, const Clock::time_point now) {
+        refill(now);
+        return tokens >= n;
+    }
+
+    bool try_consume(const float n, const Clock::time_point now) {
+        if (!can_consume(n, now)) {
+            return false;
+        }
+        tokens -= n;
+        return true;
+    }
+private:
+    void refill(const Clock::time_point now) {
+        const auto dt = std::chrono::duration<float>(now - last_refill).count();
+        if (dt <= 0.0f) return;
+        last_refill = now;
+        tokens += dt*config.rate;
+        tokens = (tokens > config.burst) ? config.burst : tokens;
+    }
+};
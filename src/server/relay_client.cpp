@@ -0,0 +1,254 @@
+#include "relay_router.hpp"
+#include "relay_connection.hpp"
+#include "loop_timer.hpp"
+#include "utility/logger.hpp"
+#include <stdio.h>
+#include <array>
+#include <unordered_map>
+#include <uwebsockets/App.h>
+
+class RelayClientStream;
+
+// Persistent connection to a backend instance shared by all streams routed to it
+struct RelayBackend {
+    RelayBackendConfig config;
+    std::unique_ptr<RelayConnection> connection = nullptr;
+    uv_tcp_t* connecting_tcp = nullptr;
+    std::unordered_map<uint32_t, RelayClientStream*> streams;
+    uint64_t total_connects = 0;
+    uint64_t total_disconnects = 0;
+    uint64_t total_streams = 0;
+
+    bool get_is_connected() const {
+        return (connection != nullptr) && connection->get_is_connected();
+    }
+    void close_streams();
+};
+
+class RelayClientStream: public RelayStream
+{
+public:
+    RelayBackend* const backend;
+    const uint32_t id;
+    PacketSink* const sink;
+    bool is_open;
+public:
+    RelayClientStream(RelayBackend* _backend, uint32_t _id, PacketSink* _sink)
+    :   backend(_backend), id(_id), sink(_sink), is_open(true)
+    {
+        backend->streams.insert({id, this});
+    }
+
+    ~RelayClientStream() override {
+        if (!is_open) return;
+        backend->streams.erase(id);
+        backend->connection->send_frame(RelayFrameType::CLOSE, id, {});
+    }
+
+    bool send_packet(tcb::span<const uint8_t> buf) override {
+        if (!is_open) return false;
+        return backend->connection->send_frame(RelayFrameType::PACKET, id, buf);
+    }
+
+    bool get_is_open() const override {
+        return is_open;
+    }
+};
+
+void RelayBackend::close_streams() {
+    for (auto& [id, stream]: streams) {
+        stream->is_open = false;
+    }
+    streams.clear();
+}
+
+// Forwards client sessions to backends over one multiplexed connection per backend
+class RelayClient: public RelayRouter
+{
+private:
+    static constexpr int RECONNECT_INTERVAL_MS = 1000;
+    std::vector<std::unique_ptr<RelayBackend>> backends;
+    std::array<RelayBackend*, 256> routes;
+    uint32_t next_stream_id;
+    std::unique_ptr<LoopTimer> reconnect_timer;
+public:
+    RelayClient(const std::vector<RelayBackendConfig>& configs)
+    :   next_stream_id(0), reconnect_timer(nullptr)
+    {
+        routes.fill(nullptr);
+        for (const auto& config: configs) {
+            auto backend = std::make_unique<RelayBackend>();
+            backend->config = config;
+            for (const uint8_t device_id: config.device_ids) {
+                if (routes[device_id] != nullptr) {
+                    fprintf(stderr, "Device %u is routed to multiple backends, using the first one\n", unsigned(device_id));
+                    continue;
+                }
+                routes[device_id] = backend.get();
+            }
+            backends.push_back(std::move(backend));
+        }
+    }
+
+    ~RelayClient() override {
+        stop();
+    }
+
+    void start() override {
+        for (auto& backend: backends) {
+            connect(backend.get());
+        }
+        reconnect_timer = std::make_unique<LoopTimer>(uWS::Loop::get(), RECONNECT_INTERVAL_MS, [this]() {
+            for (auto& backend: backends) {
+                if (backend->get_is_connected()) continue;
+                if (backend->connecting_tcp != nullptr) continue;
+                // NOTE: Connection is destroyed here since it can't be destroyed inside its own callbacks
+                backend->connection = nullptr;
+                connect(backend.get());
+            }
+        });
+    }
+
+    void stop() override {
+        reconnect_timer = nullptr;
+        for (auto& backend: backends) {
+            backend->close_streams();
+            backend->connection = nullptr;
+            if (backend->connecting_tcp != nullptr) {
+                RelayConnection::close_handle(backend->connecting_tcp);
+                backend->connecting_tcp = nullptr;
+            }
+        }
+    }
+
+    std::unique_ptr<RelayStream> open_stream(uint8_t device_id, PacketSink* sink) override {
+        auto* backend = routes[device_id];
+        if ((backend == nullptr) || !backend->get_is_connected()) {
+            return nullptr;
+        }
+        return open_backend_stream(backend, sink);
+    }
+
+    std::unique_ptr<RelayStream> open_any_stream(PacketSink* sink) override {
+        RelayBackend* best = nullptr;
+        for (auto& backend: backends) {
+            if (!backend->get_is_connected()) continue;
+            if ((best == nullptr) || (backend->streams.size() < best->streams.size())) {
+                best = backend.get();
+            }
+        }
+        if (best == nullptr) {
+            return nullptr;
+        }
+        return open_backend_stream(best, sink);
+    }
+
+    bool get_is_routed(const RelayStream& stream, uint8_t device_id) const override {
+        return routes[device_id] == static_cast<const RelayClientStream&>(stream).backend;
+    }
+
+    void write_stats(std::string& dst) const override {
+        dst.append("\"relay_backends\":[");
+        char buf[512];
+        for (size_t i = 0; i < backends.size(); i++) {
+            const auto& backend = *backends[i];
+            const int N = snprintf(buf, sizeof(buf),
+                "%s{\"host\":\"%s\",\"port\":%d,\"connected\":%s,\"active_streams\":%zu,"
+                "\"streams\":%llu,\"connects\":%llu,\"disconnects\":%llu}",
+                (i == 0) ? "" : ",",
+                backend.config.host.c_str(), backend.config.port,
+                backend.get_is_connected() ? "true" : "false",
+                backend.streams.size(),
+                (unsigned long long)backend.total_streams,
+                (unsigned long long)backend.total_connects,
+                (unsigned long long)backend.total_disconnects
+            );
+            dst.append(buf, size_t(N));
+        }
+        dst.append("]");
+    }
+private:
+    std::unique_ptr<RelayStream> open_backend_stream(RelayBackend* backend, PacketSink* sink) {
+        const uint32_t id = next_stream_id++;
+        if (!backend->connection->send_frame(RelayFrameType::OPEN, id, {})) {
+            return nullptr;
+        }
+        backend->total_streams++;
+        return std::make_unique<RelayClientStream>(backend, id, sink);
+    }
+
+    void connect(RelayBackend* backend) {
+        struct sockaddr_in addr;
+        if (uv_ip4_addr(backend->config.host.c_str(), backend->config.port, &addr) != 0) {
+            fprintf(stderr, "Relay backend has invalid ipv4 address '%s'\n", backend->config.host.c_str());
+            return;
+        }
+
+        auto* tcp = new uv_tcp_t;
+        uv_tcp_init(uv_default_loop(), tcp);
+        tcp->data = nullptr;
+        auto* req = new uv_connect_t;
+        req->data = this;
+        backend->connecting_tcp = tcp;
+        const int rv = uv_tcp_connect(req, tcp, reinterpret_cast<const struct sockaddr*>(&addr), [](uv_connect_t* req, int status) {
+            auto* self = static_cast<RelayClient*>(req->data);
+            auto* tcp = reinterpret_cast<uv_tcp_t*>(req->handle);
+            delete req;
+            // NOTE: Handle was closed by stop()
+            if (status == UV_ECANCELED) return;
+            self->on_connect(tcp, status);
+        });
+        if (rv != 0) {
+            delete req;
+            RelayConnection::close_handle(tcp);
+            backend->connecting_tcp = nullptr;
+        }
+    }
+
+    void on_connect(uv_tcp_t* tcp, int status) {
+        RelayBackend* backend = nullptr;
+        for (auto& it: backends) {
+            if (it->connecting_tcp == tcp) backend = it.get();
+        }
+        if (backend == nullptr) return;
+        backend->connecting_tcp = nullptr;
+
+        if (status < 0) {
+            RelayConnection::close_handle(tcp);
+            return;
+        }
+
+        backend->total_connects++;
+        backend->connection = std::make_unique<RelayConnection>(tcp);
+        backend->connection->on_frame = [backend](RelayFrameType type, uint32_t id, tcb::span<const uint8_t> payload) {
+            auto it = backend->streams.find(id);
+            if (it == backend->streams.end()) return;
+            auto* stream = it->second;
+            switch (type) {
+            case RelayFrameType::PACKET:
+                if (stream->sink != nullptr) {
+                    stream->sink->send_packet(payload);
+                }
+                break;
+            case RelayFrameType::CLOSE:
+                stream->is_open = false;
+                backend->streams.erase(it);
+                break;
+            default:
+                break;
+            }
+        };
+        backend->connection->on_close = [backend]() {
+            log_warn("Relay backend {}:{} disconnected", backend->config.host, backend->config.port);
+            backend->total_disconnects++;
+            backend->close_streams();
+        };
+        if (backend->connection->start()) {
+            log_info("Relay backend {}:{} connected", backend->config.host, backend->config.port);
+        }
+    }
+};
+
+std::unique_ptr<RelayRouter> create_relay_router(const std::vector<RelayBackendConfig>& backends) {
+    return std::make_unique<RelayClient>(backends);
+}
@@ -0,0 +1,154 @@
+#include "relay_connection.hpp"
+#include "utility/logger.hpp"
+#include <stdio.h>
+#include <string.h>
+
+struct RelayWriteRequest {
+    uv_write_t req;
+    RelayConnection* connection;
+    std::vector<uint8_t> data;
+};
+
+RelayConnection::RelayConnection(uv_tcp_t* _tcp)
+:   tcp(_tcp), is_connected(true), total_pending_writes(0)
+{
+    tcp->data = this;
+    // NOTE: Input packets are tiny so we never want them delayed by Nagle's algorithm
+    uv_tcp_nodelay(tcp, 1);
+}
+
+RelayConnection::~RelayConnection() {
+    // NOTE: Don't notify owner since it is the one destroying us
+    on_close = nullptr;
+    close();
+}
+
+bool RelayConnection::start() {
+    const int rv = uv_read_start(reinterpret_cast<uv_stream_t*>(tcp), &RelayConnection::on_alloc, &RelayConnection::on_read);
+    if (rv != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void RelayConnection::close() {
+    if (!is_connected) return;
+    is_connected = false;
+    tcp->data = nullptr;
+    close_handle(tcp);
+    tcp = nullptr;
+    if (on_close != nullptr) {
+        on_close();
+    }
+}
+
+void RelayConnection::close_handle(uv_tcp_t* tcp) {
+    uv_close(reinterpret_cast<uv_handle_t*>(tcp), [](uv_handle_t* handle) {
+        delete reinterpret_cast<uv_tcp_t*>(handle);
+    });
+}
+
+void RelayConnection::on_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+    auto* self = static_cast<RelayConnection*>(handle->data);
+    *buf = uv_buf_init(self->recv_chunk.data(), (unsigned int)(self->recv_chunk.size()));
+}
+
+void RelayConnection::on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+    auto* self = static_cast<RelayConnection*>(stream->data);
+    if (self == nullptr) return;
+    if (nread < 0) {
+        if (nread != UV_EOF) {
+            log_warn("Relay connection read error: {}", uv_strerror(int(nread)));
+        }
+        self->close();
+        return;
+    }
+    const auto* data = reinterpret_cast<const uint8_t*>(buf->base);
+    self->read_buf.insert(self->read_buf.end(), data, data + nread);
+    self->parse_frames();
+}
+
+void RelayConnection::parse_frames() {
+    size_t offset = 0;
+    while (is_connected && (read_buf.size() - offset) >= 2) {
+        const uint8_t* it = read_buf.data() + offset;
+        const size_t length = size_t(it[0]) | (size_t(it[1]) << 8);
+        if ((length < HEADER_SIZE-2) || (length > HEADER_SIZE-2+MAX_PAYLOAD)) {
+            log_warn("Relay connection received invalid frame length {}", length);
+            close();
+            return;
+        }
+        if ((read_buf.size() - offset - 2) < length) break;
+
+        const auto type = RelayFrameType(it[2]);
+        uint32_t stream_id = 0;
+        for (int i = 0; i < 4; i++) {
+            stream_id |= uint32_t(it[3+i]) << (8*i);
+        }
+        const auto payload = tcb::span<const uint8_t>(it + HEADER_SIZE, length - (HEADER_SIZE-2));
+        offset += 2 + length;
+        if (on_frame != nullptr) {
+            on_frame(type, stream_id, payload);
+        }
+    }
+    // NOTE: Callbacks may have closed and destroyed the buffer's owner
+    if (!is_connected) return;
+    read_buf.erase(read_buf.begin(), read_buf.begin() + offset);
+}
+
+bool RelayConnection::send_frame(RelayFrameType type, uint32_t stream_id, tcb::span<const uint8_t> payload) {
+    if (!is_connected) return false;
+    if (payload.size() > MAX_PAYLOAD) return false;
+    uint8_t frame[HEADER_SIZE + MAX_PAYLOAD];
+    const size_t length = HEADER_SIZE-2 + payload.size();
+    frame[0] = uint8_t(length & 0xFF);
+    frame[1] = uint8_t((length >> 8) & 0xFF);
+    frame[2] = uint8_t(type);
+    for (int i = 0; i < 4; i++) {
+        frame[3+i] = uint8_t((stream_id >> (8*i)) & 0xFF);
+    }
+    if (payload.size() > 0) {
+        memcpy(frame + HEADER_SIZE, payload.data(), payload.size());
+    }
+    return write(frame, HEADER_SIZE + payload.size());
+}
+
+bool RelayConnection::write(const uint8_t* data, const size_t length) {
+    auto* stream = reinterpret_cast<uv_stream_t*>(tcp);
+    size_t total_written = 0;
+    // NOTE: Can only write immediately if nothing is queued, otherwise frames are reordered
+    if (total_pending_writes == 0) {
+        uv_buf_t buf = uv_buf_init(const_cast<char*>(reinterpret_cast<const char*>(data)), (unsigned int)length);
+        const int rv = uv_try_write(stream, &buf, 1);
+        if (rv >= 0) {
+            total_written = size_t(rv);
+        } else if ((rv != UV_EAGAIN) && (rv != UV_ENOSYS)) {
+            close();
+            return false;
+        }
+    }
+    if (total_written == length) {
+        return true;
+    }
+
+    auto* request = new RelayWriteRequest;
+    request->connection = this;
+    request->data.assign(data + total_written, data + length);
+    uv_buf_t buf = uv_buf_init(reinterpret_cast<char*>(request->data.data()), (unsigned int)request->data.size());
+    const int rv = uv_write(&request->req, stream, &buf, 1, [](uv_write_t* req, int status) {
+        auto* request = reinterpret_cast<RelayWriteRequest*>(req);
+        // NOTE: Connection may have been destroyed if the handle was closed
+        if (status != UV_ECANCELED) {
+            request->connection->total_pending_writes--;
+        }
+        delete request;
+    });
+    if (rv != 0) {
+        delete request;
+        close();
+        return false;
+    }
+    total_pending_writes++;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <functional>
+#include <vector>
+#include <uv.h>
+#include "utility/span.hpp"
+
+// Frames multiplexed over a single tcp connection between relay and backend
+// [u16 length][u8 type][u32 stream_id][payload], little endian, length excludes itself
+enum class RelayFrameType: uint8_t {
+    OPEN   = 0x00,
+    PACKET = 0x01,
+    CLOSE  = 0x02,
+};
+
+class RelayConnection 
+{
+public:
+    static constexpr size_t HEADER_SIZE = 2+1+4;
+    static constexpr size_t MAX_PAYLOAD = 16*1024;
+    std::function<void(RelayFrameType, uint32_t, tcb::span<const uint8_t>)> on_frame = nullptr;
+    // Called once when the connection closes for any reason
+    // NOTE: The owner must not destroy the connection inside these callbacks
+    std::function<void()> on_close = nullptr;
+private:
+    uv_tcp_t* tcp;
+    bool is_connected;
+    std::vector<uint8_t> read_buf;
+    std::array<char, 4096> recv_chunk;
+    size_t total_pending_writes;
+public:
+    // Takes ownership of a connected tcp handle
+    explicit RelayConnection(uv_tcp_t* _tcp);
+    ~RelayConnection();
+    RelayConnection(const RelayConnection&) = delete;
+    RelayConnection(RelayConnection&&) = delete;
+    RelayConnection& operator=(const RelayConnection&) = delete;
+    RelayConnection& operator=(RelayConnection&&) = delete;
+
+    bool start();
+    bool send_frame(RelayFrameType type, uint32_t stream_id, tcb::span<const uint8_t> payload);
+    bool get_is_connected() const { return is_connected; }
+    void close();
+    // Frees a tcp handle once libuv is done with it
+    static void close_handle(uv_tcp_t* tcp);
+private:
+    static void on_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
+    static void on_read(uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf);
+    void parse_frames();
+    bool write(const uint8_t* data, const size_t length);
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "packet_handler.hpp"
+
+// Stream to a backend instance that owns the device
+// Destroying the stream closes it on the backend which releases the device
+class RelayStream 
+{
+public:
+    virtual ~RelayStream() {};
+    virtual bool send_packet(tcb::span<const uint8_t> buf) = 0;
+    // Streams close if the backend disconnects
+    virtual bool get_is_open() const = 0;
+};
+
+class RelayRouter 
+{
+public:
+    virtual ~RelayRouter() {};
+    // Responses from the backend are sent to the sink
+    // Returns nullptr if no backend is available for this device
+    virtual std::unique_ptr<RelayStream> open_stream(uint8_t device_id, PacketSink* sink) = 0;
+    // Opens a stream to the connected backend with the fewest streams so it can pick a free device
+    virtual std::unique_ptr<RelayStream> open_any_stream(PacketSink* sink) = 0;
+    // Returns true if the stream goes to the backend that owns the device
+    virtual bool get_is_routed(const RelayStream& stream, uint8_t device_id) const = 0;
+    // Connections are started once the server is running on the event loop
+    virtual void start() = 0;
+    virtual void stop() = 0;
+    virtual void write_stats(std::string& dst) const = 0;
+};
+
+struct RelayBackendConfig {
+    std::string host;
+    int port;
+    std::vector<uint8_t> device_ids;
+};
+
+std::unique_ptr<RelayRouter> create_relay_router(const std::vector<RelayBackendConfig>& backends);
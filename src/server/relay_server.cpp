@@ -0,0 +1,131 @@
+#include "relay_server.hpp"
+#include "utility/logger.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+RelayServer::RelayServer(uv_loop_t* _loop, PacketHandlerFactory* _factory)
+:   loop(_loop), factory(_factory), server(nullptr), total_connections(0), total_streams(0)
+{}
+
+RelayServer::~RelayServer() {
+    // NOTE: Streams are destroyed before connections so their handlers can release devices
+    for (auto& peer: peers) {
+        peer->streams.clear();
+    }
+    peers.clear();
+    if (server != nullptr) {
+        RelayConnection::close_handle(server);
+        server = nullptr;
+    }
+}
+
+bool RelayServer::listen(const int port) {
+    struct sockaddr_in addr;
+    uv_ip4_addr("0.0.0.0", port, &addr);
+
+    server = new uv_tcp_t;
+    uv_tcp_init(loop, server);
+    server->data = this;
+    int rv = uv_tcp_bind(server, reinterpret_cast<const struct sockaddr*>(&addr), 0);
+    if (rv == 0) {
+        rv = uv_listen(reinterpret_cast<uv_stream_t*>(server), 16, &RelayServer::on_connection);
+    }
+    if (rv != 0) {
+        fprintf(stderr, "Failed to listen for relay connections on port=%d: %s\n", port, uv_strerror(rv));
+        RelayConnection::close_handle(server);
+        server = nullptr;
+        return false;
+    }
+    printf("Listening for relay connections on port %d\n", port);
+    return true;
+}
+
+void RelayServer::on_connection(uv_stream_t* stream, int status) {
+    auto* self = static_cast<RelayServer*>(stream->data);
+    if (status < 0) {
+        log_warn("Relay connection failed: {}", uv_strerror(status));
+        return;
+    }
+
+    auto* tcp = new uv_tcp_t;
+    uv_tcp_init(self->loop, tcp);
+    if (uv_accept(stream, reinterpret_cast<uv_stream_t*>(tcp)) != 0) {
+        RelayConnection::close_handle(tcp);
+        return;
+    }
+
+    auto peer = std::make_unique<Peer>();
+    auto* peer_ptr = peer.get();
+    peer->connection = std::make_unique<RelayConnection>(tcp);
+    peer->connection->on_frame = [self, peer_ptr](RelayFrameType type, uint32_t id, tcb::span<const uint8_t> payload) {
+        self->on_frame(peer_ptr, type, id, payload);
+    };
+    peer->connection->on_close = [peer_ptr]() {
+        log_info("Relay gateway disconnected, closing {} streams", peer_ptr->streams.size());
+        peer_ptr->streams.clear();
+    };
+    if (!peer->connection->start()) {
+        return;
+    }
+    log_info("Relay gateway connected");
+    self->total_connections++;
+    self->peers.push_back(std::move(peer));
+}
+
+void RelayServer::on_frame(Peer* peer, RelayFrameType type, uint32_t id, tcb::span<const uint8_t> payload) {
+    switch (type) {
+    case RelayFrameType::OPEN:
+        {
+            if (peer->streams.find(id) != peer->streams.end()) return;
+            auto stream = std::make_unique<Stream>();
+            stream->sink.connection = peer->connection.get();
+            stream->sink.id = id;
+            stream->handler = factory->create_handler();
+            stream->handler->attach_sink(&stream->sink);
+            peer->streams.insert({id, std::move(stream)});
+            total_streams++;
+        }
+        break;
+    case RelayFrameType::PACKET:
+        {
+            auto it = peer->streams.find(id);
+            if (it == peer->streams.end()) {
+                // NOTE: Let the gateway know the stream no longer exists
+                peer->connection->send_frame(RelayFrameType::CLOSE, id, {});
+                return;
+            }
+            auto& stream = it->second;
+            const auto res = stream->handler->on_packet(payload);
+            stream->sink.send_packet(res);
+        }
+        break;
+    case RelayFrameType::CLOSE:
+        peer->streams.erase(id);
+        break;
+    default:
+        break;
+    }
+}
+
+void RelayServer::cleanup() {
+    peers.erase(
+        std::remove_if(peers.begin(), peers.end(), [](const auto& peer) {
+            return !peer->connection->get_is_connected();
+        }),
+        peers.end()
+    );
+}
+
+void RelayServer::write_stats(std::string& dst) const {
+    size_t total_active_streams = 0;
+    for (const auto& peer: peers) {
+        total_active_streams += peer->streams.size();
+    }
+    char buf[256];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"relay_server\":{\"connections\":%llu,\"active_connections\":%zu,\"streams\":%llu,\"active_streams\":%zu}",
+        (unsigned long long)total_connections, peers.size(),
+        (unsigned long long)total_streams, total_active_streams
+    );
+    dst.append(buf, size_t(N));
+}
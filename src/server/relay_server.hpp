@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <uv.h>
+#include "packet_handler.hpp"
+#include "relay_connection.hpp"
+
+// Backend side of the relay
+// Accepts connections from a gateway and runs a packet handler for each stream
+class RelayServer 
+{
+private:
+    class Sink: public PacketSink 
+    {
+    public:
+        RelayConnection* connection = nullptr;
+        uint32_t id = 0;
+        void send_packet(tcb::span<const uint8_t> buf) override {
+            if (buf.size() == 0) return;
+            connection->send_frame(RelayFrameType::PACKET, id, buf);
+        }
+    };
+    struct Stream {
+        // NOTE: Sink is declared first so it outlives the handler
+        Sink sink;
+        std::unique_ptr<PacketHandler> handler;
+    };
+    struct Peer {
+        std::unique_ptr<RelayConnection> connection;
+        std::unordered_map<uint32_t, std::unique_ptr<Stream>> streams;
+    };
+
+    uv_loop_t* const loop;
+    PacketHandlerFactory* const factory;
+    uv_tcp_t* server;
+    std::vector<std::unique_ptr<Peer>> peers;
+    uint64_t total_connections;
+    uint64_t total_streams;
+public:
+    RelayServer(uv_loop_t* _loop, PacketHandlerFactory* _factory);
+    ~RelayServer();
+    RelayServer(const RelayServer&) = delete;
+    RelayServer(RelayServer&&) = delete;
+    RelayServer& operator=(const RelayServer&) = delete;
+    RelayServer& operator=(RelayServer&&) = delete;
+
+    bool listen(const int port);
+    // Destroys connections that have closed
+    void cleanup();
+    void write_stats(std::string& dst) const;
+private:
+    static void on_connection(uv_stream_t* stream, int status);
+    void on_frame(Peer* peer, RelayFrameType type, uint32_t id, tcb::span<const uint8_t> payload);
+};
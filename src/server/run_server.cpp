@@ -1,27 +1,274 @@
 #include "run_server.hpp"
 #include "./create_websocket.hpp"
+#include "./create_observer.hpp"
+#include "./loop_timer.hpp"
+#include "./loop_scheduler.hpp"
+#include "./loop_load.hpp"
+#include "./udp_server.hpp"
+#include "./shm_server.hpp"
+#include "./relay_server.hpp"
+#include "./relay_router.hpp"
 #include "./AsyncFileReader.hpp"
 #include "./AsyncFileStreamer.hpp"
+#include "./static_bundles.hpp"
+#include "./low_latency.hpp"
+#include "utility/allocation_counter.hpp"
+#include "utility/trace.hpp"
+#include "utility/logger.hpp"
 #include <stdio.h>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <uv.h>
 
-void run_server(const int port, const char* static_filepath, PacketHandlerFactory* factory) {
-    AsyncFileStreamer async_file_streamer(static_filepath);
+bool ServerControl::stop() {
+    auto lock = std::scoped_lock(mutex);
+    if (loop == nullptr) {
+        return false;
+    }
+    // NOTE: Loop::defer is the only thread safe method of uWS
+    loop->defer(stop_callback);
+    return true;
+}
 
-    auto websocket = create_websocket(factory);
+void ServerControl::attach(uWS::Loop* _loop, std::function<void()> _stop_callback) {
+    auto lock = std::scoped_lock(mutex);
+    loop = _loop;
+    stop_callback = std::move(_stop_callback);
+}
+
+void ServerControl::detach() {
+    auto lock = std::scoped_lock(mutex);
+    loop = nullptr;
+    stop_callback = nullptr;
+}
+
+void run_server(const ServerConfig& config, PacketHandlerFactory* factory, ServerControl* control) {
+    const int port = config.port;
+    const char* static_filepath = config.static_filepath;
+    // NOTE: Declared first so records from everything below are written before it exits
+    LogWriter log_writer(config.log);
+    // NOTE: This thread becomes the event loop
+    apply_low_latency(uv_default_loop(), config.low_latency);
+    const bool is_busy_poll = config.low_latency.is_busy_poll;
+    // NOTE: uSockets uses libuv on Windows, so we give it the default libuv loop
+    //       This lets the udp socket share the same event loop as the http server
+    auto* loop = uWS::Loop::get(uv_default_loop());
+    AsyncFileStreamer async_file_streamer(uv_default_loop(), static_filepath, config.static_cache_size);
+    StaticBundles static_bundles;
+    if (config.is_bundle_static) {
+        static_bundles.build(static_filepath);
+    }
+    // Bundled layouts are served from memory, everything else including the original files from the static folder
+    auto serve_static = [&async_file_streamer, &static_bundles](auto* res, std::string_view url) {
+        const auto* file = static_bundles.find(url);
+        if (file == nullptr) {
+            async_file_streamer.streamFile(res, url);
+            return;
+        }
+        res->writeStatus(uWS::HTTP_200_OK);
+        res->writeHeader("Content-Type", file->mime_type);
+        // NOTE: Pages are revalidated so a restart with changed files picks up the new bundle urls
+        res->writeHeader("Cache-Control", file->is_immutable ? "public, max-age=31536000, immutable" : "no-cache");
+        res->end(file->data);
+    };
+    // NOTE: Declared before any transport so it outlives every handler
+    LoopScheduler scheduler(loop);
+    factory->attach_scheduler(&scheduler);
+    LoopTimer housekeeping_timer(loop, 1000, [factory]() {
+        factory->on_housekeeping();
+    });
+
+    WebsocketContext websocket_context(config.websocket);
+    auto websocket = create_websocket(factory, &websocket_context);
+    LoopTimer conflate_timer(loop, config.websocket.rate_limit.flush_interval_ms, [&websocket_context]() {
+        websocket_context.flush_conflated();
+    });
+    // Responses from packets, timers and the scheduler in this iteration go out together
+    loop->addPostHandler(&websocket_context, [&websocket_context](uWS::Loop*) {
+        websocket_context.flush_outgoing();
+    });
+    LoopLoad loop_load(uv_default_loop());
+    std::unique_ptr<LoopTimer> flow_control_timer = nullptr;
+    if (config.websocket.flow_control.is_enabled) {
+        flow_control_timer = std::make_unique<LoopTimer>(loop, config.websocket.flow_control.interval_ms, [&websocket_context, &loop_load, is_busy_poll]() {
+            // NOTE: A busy polling loop never idles so its load only says it is polling
+            websocket_context.update_flow_control(is_busy_poll ? 0.0f : loop_load.update());
+        });
+    }
 
     // Webserver
 	auto app = uWS::App();
-    app.get("/", [&async_file_streamer](auto *res, auto *req) {
-        async_file_streamer.streamFile(res, "/index.html");
+    std::unique_ptr<ObserverContext> observer_context = nullptr;
+    std::unique_ptr<LoopTimer> observer_timer = nullptr;
+    auto* observer_source = factory->get_observer_source();
+    if ((observer_source != nullptr) && (config.observer.max_rate_hz > 0)) {
+        observer_context = std::make_unique<ObserverContext>(observer_source);
+        observer_context->attach(&app);
+        app.ws("/observer", create_observer(observer_context.get()));
+        // NOTE: Publish rate is capped so fast input doesn't become a send per input per observer
+        const int interval_ms = std::max(1, 1000/config.observer.max_rate_hz);
+        observer_timer = std::make_unique<LoopTimer>(loop, interval_ms, [&observer_context]() {
+            observer_context->publish_changes();
+        });
+    }
+    app.get("/", [&serve_static](auto *res, auto *req) {
+        serve_static(res, "/index.html");
+    });
+    std::unique_ptr<UdpServer> udp_server = nullptr;
+    std::unique_ptr<LoopTimer> udp_expire_timer = nullptr;
+    std::unique_ptr<ShmServer> shm_server = nullptr;
+    std::unique_ptr<LoopTimer> shm_poll_timer = nullptr;
+    std::unique_ptr<LoopTimer> shm_expire_timer = nullptr;
+    std::unique_ptr<RelayServer> relay_server = nullptr;
+    std::unique_ptr<LoopTimer> relay_cleanup_timer = nullptr;
+    auto* relay_router = config.relay.router;
+    app.get("/api/stats", [factory, &websocket_context, &scheduler, &observer_context, &udp_server, &shm_server, &relay_server, relay_router](auto *res, auto *req) {
+        std::string body = "{";
+        websocket_context.write_stats(body);
+        body.append(",");
+        scheduler.write_stats(body);
+        {
+            // NOTE: Factories without stats write nothing so drop the separator
+            const size_t prev_size = body.size();
+            body.append(",");
+            factory->write_stats(body);
+            if (body.size() == prev_size+1) {
+                body.resize(prev_size);
+            }
+        }
+        if (get_is_allocation_counter_enabled()) {
+            const auto counts = get_allocation_counts();
+            char buf[128];
+            const int N = snprintf(buf, sizeof(buf),
+                ",\"allocations\":{\"total\":%llu,\"frees\":%llu,\"bytes\":%llu}",
+                (unsigned long long)counts.total_allocations,
+                (unsigned long long)counts.total_frees,
+                (unsigned long long)counts.total_bytes
+            );
+            body.append(buf, size_t(N));
+        }
+        if (observer_context != nullptr) {
+            body.append(",");
+            observer_context->write_stats(body);
+        }
+        if (udp_server != nullptr) {
+            body.append(",");
+            udp_server->write_stats(body);
+        }
+        if (shm_server != nullptr) {
+            body.append(",");
+            shm_server->write_stats(body);
+        }
+        if (relay_server != nullptr) {
+            body.append(",");
+            relay_server->write_stats(body);
+        }
+        if (relay_router != nullptr) {
+            body.append(",");
+            relay_router->write_stats(body);
+        }
+        body.append("}");
+        res->writeHeader("Content-Type", "application/json");
+        res->end(body);
     });
-    app.get("/*", [&async_file_streamer](auto *res, auto* req) {
-        async_file_streamer.streamFile(res, req->getUrl());
+    if (get_is_tracing_enabled()) {
+        app.get("/api/trace", [](auto *res, auto *req) {
+            std::string body;
+            get_trace_registry().write_trace(body);
+            res->writeHeader("Content-Type", "application/json");
+            res->end(body);
+        });
+    }
+    app.get("/*", [&serve_static](auto *res, auto* req) {
+        serve_static(res, req->getUrl());
     });
     app.ws("/websocket", std::move(websocket));
-    app.listen(port, [port, static_filepath](auto *token) {
-        if (token) {
-            printf("Serving '%s' on http://localhost:%d\n", static_filepath, port);
+    struct us_listen_socket_t* listen_socket = nullptr;
+
+    // Close everything that keeps the event loop alive so that app.run() returns
+    auto stop_server = [&]() {
+        if (listen_socket != nullptr) {
+            // NOTE: Closing the http context closes idle keep-alive connections along with the listen socket
+            //       Upgraded websockets are in their own context and closed below
+            auto* http_context = us_socket_context(0, reinterpret_cast<struct us_socket_t*>(listen_socket));
+            us_socket_context_close(0, http_context);
+            listen_socket = nullptr;
+        }
+        websocket_context.close_all();
+        flow_control_timer = nullptr;
+        if (observer_context != nullptr) {
+            observer_context->close_all();
+        }
+        udp_expire_timer = nullptr;
+        udp_server = nullptr;
+        shm_poll_timer = nullptr;
+        shm_expire_timer = nullptr;
+        shm_server = nullptr;
+        relay_cleanup_timer = nullptr;
+        relay_server = nullptr;
+        if (relay_router != nullptr) {
+            relay_router->stop();
+        }
+        printf("Server stopped\n");
+    };
+    if (control != nullptr) {
+        control->attach(loop, stop_server);
+    }
+
+    app.listen(port, [&](auto *token) {
+        if (control != nullptr && control->on_listen != nullptr) {
+            control->on_listen(token != nullptr);
+        }
+        if (!token) return;
+        listen_socket = token;
+        printf("Serving '%s' on http://localhost:%d\n", static_filepath, port);
+        // NOTE: Only start other transports if the http server started, otherwise they keep the loop alive
+        if (config.udp.is_enabled) {
+            udp_server = std::make_unique<UdpServer>(uv_default_loop(), config.udp, config.websocket.rate_limit, factory);
+            if (udp_server->listen()) {
+                udp_expire_timer = std::make_unique<LoopTimer>(loop, 1000, [&udp_server]() {
+                    udp_server->expire_sessions();
+                });
+            } else {
+                udp_server = nullptr;
+            }
+        }
+        if (config.shm.is_enabled) {
+            shm_server = std::make_unique<ShmServer>(config.shm, factory);
+            if (shm_server->open()) {
+                shm_poll_timer = std::make_unique<LoopTimer>(loop, config.shm.poll_interval_ms, [&shm_server]() {
+                    shm_server->poll();
+                });
+                shm_expire_timer = std::make_unique<LoopTimer>(loop, 1000, [&shm_server]() {
+                    shm_server->expire_sessions();
+                });
+            } else {
+                shm_server = nullptr;
+            }
+        }
+        if (config.relay.listen_port > 0) {
+            relay_server = std::make_unique<RelayServer>(uv_default_loop(), factory);
+            if (relay_server->listen(config.relay.listen_port)) {
+                relay_cleanup_timer = std::make_unique<LoopTimer>(loop, 1000, [&relay_server]() {
+                    relay_server->cleanup();
+                });
+            } else {
+                relay_server = nullptr;
+            }
+        }
+        if (relay_router != nullptr) {
+            relay_router->start();
         }
     });
-    app.run();
-}
\ No newline at end of file
+    if (is_busy_poll) {
+        run_busy_poll(loop, uv_default_loop());
+    } else {
+        app.run();
+    }
+    loop->removePostHandler(&websocket_context);
+    if (control != nullptr) {
+        control->detach();
+    }
+    factory->attach_scheduler(nullptr);
+}
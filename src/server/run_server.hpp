@@ -1,3 +1,30 @@
 #pragma once
+#include <functional>
+#include <mutex>
 #include "packet_handler.hpp"
-void run_server(const int port, const char* static_filepath, PacketHandlerFactory* factory);
\ No newline at end of file
+#include "server_config.hpp"
+
+namespace uWS {
+    struct Loop;
+}
+
+// Lets another thread know when the server has started and stop it
+class ServerControl 
+{
+public:
+    // Called on the server thread once listening has either succeeded or failed
+    std::function<void(bool is_listening)> on_listen = nullptr;
+private:
+    std::mutex mutex;
+    uWS::Loop* loop = nullptr;
+    std::function<void()> stop_callback = nullptr;
+public:
+    // Thread safe, returns false if the server isn't running
+    bool stop();
+    // Called by the server thread
+    void attach(uWS::Loop* _loop, std::function<void()> _stop_callback);
+    void detach();
+};
+
+// NOTE: This blocks until the server stops or fails to start
+void run_server(const ServerConfig& config, PacketHandlerFactory* factory, ServerControl* control = nullptr);
@@ -0,0 +1,101 @@
+#pragma once
+#include "rate_limiter.hpp"
+#include "utility/logger.hpp"
+
+class RelayRouter;
+
+struct RateLimitConfig {
+    bool is_enabled = true;
+    TokenBucketConfig messages = { 1000.0f, 200.0f };
+    TokenBucketConfig bytes = { 32.0f*1024.0f, 16.0f*1024.0f };
+    // Sustained rejection of control packets past this rate disconnects the client
+    TokenBucketConfig rejects = { 50.0f, 200.0f };
+    // How often conflated packets are retried
+    int flush_interval_ms = 5;
+};
+
+// Send rate recommended to clients from the device rate, websocket backpressure and loop load
+struct FlowControlConfig {
+    bool is_enabled = true;
+    // Input faster than games poll the device is wasted
+    int max_rate_hz = 125;
+    int min_rate_hz = 10;
+    // How often recommendations are recomputed, they are only sent when they change
+    int interval_ms = 500;
+};
+
+// Extra options for the sockets of clients
+struct SocketConfig {
+    // NOTE: uSockets already disables Nagle's algorithm on accepted sockets, this makes sure of it
+    bool is_no_delay = false;
+    // Microseconds the kernel may busy poll the network device on reads, 0 to disable, linux only
+    // NOTE: Raising it above net.core.busy_read needs CAP_NET_ADMIN
+    int busy_poll_us = 0;
+};
+
+struct WebsocketConfig {
+    RateLimitConfig rate_limit;
+    FlowControlConfig flow_control;
+    // Acks that only confirm success are dropped while more than this is waiting to be sent
+    // NOTE: Errors and state replies are always sent, but past 64KB uWS drops them and keeps the socket open
+    size_t ack_drop_threshold = 16*1024;
+    SocketConfig socket;
+};
+
+struct UdpConfig {
+    bool is_enabled = false;
+    int port = 3001;
+    int max_sessions = 64;
+    // Sessions are closed and their devices released after this long without a datagram
+    int idle_timeout_ms = 5000;
+    SocketConfig socket;
+};
+
+struct ShmConfig {
+    bool is_enabled = false;
+    // Uses the default name in shm/input_ring.h if null
+    const char* name = nullptr;
+    int poll_interval_ms = 1;
+    int max_records_per_poll = 4096;
+    int max_sessions = 16;
+    int idle_timeout_ms = 5000;
+};
+
+struct RelayConfig {
+    // Accept connections from a relay gateway on this port, 0 to disable
+    int listen_port = 0;
+    // Routes to backends when running as a relay gateway
+    RelayRouter* router = nullptr;
+};
+
+struct ObserverConfig {
+    // Changes are published to observers at most this often, 0 to disable observers
+    int max_rate_hz = 30;
+};
+
+// For dedicated machines, trades a core and power for lower tail latency
+struct LowLatencyConfig {
+    // Core the event loop runs on, which is also the thread that updates the driver, -1 to not pin
+    int loop_cpu = -1;
+    // Raise the priority of the event loop thread as far as permitted
+    bool is_high_priority = false;
+    // Poll for events without waiting so input never waits on the os to wake the loop up
+    // NOTE: Keeps its core busy and flow control ignores the loop load since the loop never idles
+    bool is_busy_poll = false;
+};
+
+struct ServerConfig {
+    int port = 3000;
+    const char* static_filepath = "./static";
+    // Memory budget for cached static files, larger files are streamed in chunks
+    size_t static_cache_size = 8*1024*1024;
+    // Layouts load one minified script and stylesheet with content hashed urls built at startup
+    bool is_bundle_static = true;
+    WebsocketConfig websocket;
+    UdpConfig udp;
+    ShmConfig shm;
+    RelayConfig relay;
+    ObserverConfig observer;
+    LogConfig log;
+    LowLatencyConfig low_latency;
+};
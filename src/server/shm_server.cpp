@@ -0,0 +1,163 @@
+#include "shm_server.hpp"
+#include <stdio.h>
+#ifdef _WIN32
+#include <timeapi.h>
+#else
+#include <sys/stat.h>
+#include <sys/file.h>
+#endif
+
+ShmServer::ShmServer(const ShmConfig& _config, PacketHandlerFactory* _factory)
+:   config(_config), factory(_factory)
+{
+    name = (config.name != nullptr) ? config.name : VJOY_INPUT_RING_DEFAULT_NAME;
+    handle.ring = nullptr;
+#ifdef _WIN32
+    server_lock = NULL;
+#endif
+}
+
+ShmServer::~ShmServer() {
+    close();
+}
+
+// NOTE: The ring is reinitialised when it is opened, so it must fail while another server is using it
+//       A region left by a crashed server is reused since its lock went away with the process
+bool ShmServer::open() {
+    void* view = nullptr;
+#ifdef _WIN32
+    server_lock = CreateMutexA(NULL, FALSE, (name + ".Server").c_str());
+    if (server_lock == NULL) {
+        fprintf(stderr, "Failed to create shared memory lock '%s' (error=%lu)\n", name.c_str(), GetLastError());
+        return false;
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        fprintf(stderr, "Shared memory '%s' is used by another server\n", name.c_str());
+        CloseHandle(server_lock);
+        server_lock = NULL;
+        return false;
+    }
+    handle.mapping = CreateFileMappingA(
+        INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 
+        0, DWORD(sizeof(vjoy_input_ring)), name.c_str()
+    );
+    if (handle.mapping == NULL) {
+        fprintf(stderr, "Failed to create shared memory '%s' (error=%lu)\n", name.c_str(), GetLastError());
+        CloseHandle(server_lock);
+        server_lock = NULL;
+        return false;
+    }
+    view = MapViewOfFile(handle.mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(vjoy_input_ring));
+    if (view == NULL) {
+        fprintf(stderr, "Failed to map shared memory '%s' (error=%lu)\n", name.c_str(), GetLastError());
+        CloseHandle(handle.mapping);
+        CloseHandle(server_lock);
+        server_lock = NULL;
+        return false;
+    }
+    // NOTE: Default windows timer resolution is ~15ms which is far too coarse for polling
+    timeBeginPeriod(1);
+#else
+    handle.fd = shm_open(name.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if (handle.fd < 0) {
+        fprintf(stderr, "Failed to create shared memory '%s'\n", name.c_str());
+        return false;
+    }
+    // NOTE: Released by the kernel if the server exits without closing
+    if (flock(handle.fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Shared memory '%s' is used by another server\n", name.c_str());
+        ::close(handle.fd);
+        return false;
+    }
+    if (ftruncate(handle.fd, off_t(sizeof(vjoy_input_ring))) != 0) {
+        fprintf(stderr, "Failed to resize shared memory '%s'\n", name.c_str());
+        ::close(handle.fd);
+        return false;
+    }
+    view = mmap(NULL, sizeof(vjoy_input_ring), PROT_READ | PROT_WRITE, MAP_SHARED, handle.fd, 0);
+    if (view == MAP_FAILED) {
+        fprintf(stderr, "Failed to map shared memory '%s'\n", name.c_str());
+        ::close(handle.fd);
+        return false;
+    }
+#endif
+    handle.ring = static_cast<vjoy_input_ring*>(view);
+    // NOTE: If a previous server crashed the region may contain stale records
+    vjoy_input_ring_init(handle.ring);
+    printf("Listening for shared memory input on '%s'\n", name.c_str());
+    return true;
+}
+
+void ShmServer::close() {
+    if (handle.ring == nullptr) return;
+    vjoy_input_ring_close(&handle);
+#ifdef _WIN32
+    timeEndPeriod(1);
+    CloseHandle(server_lock);
+    server_lock = NULL;
+#else
+    shm_unlink(name.c_str());
+#endif
+}
+
+void ShmServer::poll() {
+    if (handle.ring == nullptr) return;
+    const auto now = Clock::now();
+    vjoy_input_record record;
+    // NOTE: Bound the amount of work so a runaway producer can't stall the event loop
+    for (int i = 0; i < config.max_records_per_poll; i++) {
+        if (!vjoy_input_ring_pop(handle.ring, &record)) break;
+        stats.total_records++;
+
+        auto it = sessions.find(record.producer_id);
+        if (it == sessions.end()) {
+            if (sessions.size() >= size_t(config.max_sessions)) {
+                stats.total_rejected++;
+                continue;
+            }
+            Session session;
+            session.handler = factory->create_handler();
+            it = sessions.insert({record.producer_id, std::move(session)}).first;
+            stats.total_sessions++;
+            stats.total_active++;
+        }
+
+        auto& session = it->second;
+        session.last_seen = now;
+        const size_t length = (record.length < VJOY_INPUT_RING_MAX_PACKET) ? record.length : VJOY_INPUT_RING_MAX_PACKET;
+        // NOTE: There is no return channel so responses are discarded
+        session.handler->on_packet(tcb::span<const uint8_t>(record.data, length));
+    }
+}
+
+void ShmServer::expire_sessions() {
+    const auto now = Clock::now();
+    const auto timeout = std::chrono::milliseconds(config.idle_timeout_ms);
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if ((now - it->second.last_seen) > timeout) {
+            it = sessions.erase(it);
+            stats.total_active--;
+            stats.total_expired++;
+        } else {
+            it++;
+        }
+    }
+}
+
+void ShmServer::write_stats(std::string& dst) const {
+    const uint32_t total_dropped = (handle.ring != nullptr) ? vjoy_input_ring_load(&handle.ring->total_dropped) : 0;
+    char buf[512];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"shm\":{"
+        "\"sessions\":%llu,\"active\":%llu,\"expired\":%llu,\"records\":%llu,"
+        "\"rejected\":%llu,\"dropped\":%lu"
+        "}",
+        (unsigned long long)stats.total_sessions,
+        (unsigned long long)stats.total_active,
+        (unsigned long long)stats.total_expired,
+        (unsigned long long)stats.total_records,
+        (unsigned long long)stats.total_rejected,
+        (unsigned long)total_dropped
+    );
+    dst.append(buf, size_t(N));
+}
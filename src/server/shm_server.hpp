@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include "packet_handler.hpp"
+#include "server_config.hpp"
+#include "shm/input_ring.h"
+
+struct ShmStats {
+    uint64_t total_sessions = 0;
+    uint64_t total_active = 0;
+    uint64_t total_expired = 0;
+    uint64_t total_records = 0;
+    uint64_t total_rejected = 0;
+};
+
+// Drains the shared memory input ring of local producers into packet handlers
+// Each producer id gets its own session which expires when idle
+class ShmServer 
+{
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Session {
+        std::unique_ptr<PacketHandler> handler;
+        Clock::time_point last_seen;
+    };
+
+    const ShmConfig config;
+    PacketHandlerFactory* const factory;
+    std::string name;
+    vjoy_input_ring_handle handle;
+#ifdef _WIN32
+    // Only exists while a server is running, unlike the mapping which producers keep alive
+    HANDLE server_lock;
+#endif
+    std::map<uint32_t, Session> sessions;
+    ShmStats stats;
+public:
+    ShmServer(const ShmConfig& _config, PacketHandlerFactory* _factory);
+    ~ShmServer();
+    ShmServer(const ShmServer&) = delete;
+    ShmServer(ShmServer&&) = delete;
+    ShmServer& operator=(const ShmServer&) = delete;
+    ShmServer& operator=(ShmServer&&) = delete;
+
+    bool open();
+    void poll();
+    void expire_sessions();
+    void write_stats(std::string& dst) const;
+private:
+    void close();
+};
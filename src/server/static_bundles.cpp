@@ -0,0 +1,570 @@
+#include "static_bundles.hpp"
+#include "get_mime_type.hpp"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static bool read_file(const fs::path& path, std::string& dst) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    dst = stream.str();
+    return true;
+}
+
+// FNV-1a, only has to change whenever the content does
+static std::string get_content_hash(std::string_view data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c: data) {
+        hash ^= uint8_t(c);
+        hash *= 1099511628211ull;
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+    return std::string(buf, 16);
+}
+
+static bool is_ident_char(char c) {
+    return (isalnum((unsigned char)c) != 0) || (c == '_') || (c == '$') || ((unsigned char)c >= 0x80);
+}
+
+static bool starts_with_keyword(std::string_view str, std::string_view keyword) {
+    if (str.substr(0, keyword.size()) != keyword) return false;
+    return (str.size() == keyword.size()) || !is_ident_char(str[keyword.size()]);
+}
+
+// Module specifiers and hrefs resolved to a path relative to the static folder
+// Returns false if it points outside of it or isn't a relative url
+static bool resolve_path(std::string_view base_dir, std::string_view url, std::string& dst) {
+    std::string path;
+    if (url.substr(0, 1) == "/") {
+        path = std::string(url.substr(1));
+    } else if ((url.substr(0, 2) == "./") || (url.substr(0, 3) == "../")) {
+        path = std::string(base_dir);
+        path.append(url);
+    } else {
+        return false;
+    }
+
+    std::vector<std::string_view> parts;
+    std::string_view remain = path;
+    while (!remain.empty()) {
+        const size_t end = std::min(remain.find('/'), remain.size());
+        const auto part = remain.substr(0, end);
+        remain = remain.substr(std::min(end+1, remain.size()));
+        if (part.empty() || (part == ".")) continue;
+        if (part == "..") {
+            if (parts.empty()) return false;
+            parts.pop_back();
+            continue;
+        }
+        parts.push_back(part);
+    }
+    if (parts.empty()) return false;
+    dst.clear();
+    for (const auto part: parts) {
+        if (!dst.empty()) dst.push_back('/');
+        dst.append(part);
+    }
+    return true;
+}
+
+static std::string_view get_base_dir(std::string_view path) {
+    const size_t i = path.rfind('/');
+    return (i == std::string_view::npos) ? std::string_view() : path.substr(0, i+1);
+}
+
+// Drops comments and whitespace that doesn't separate tokens
+// NOTE: Newlines are kept where automatic semicolon insertion could depend on them
+static std::string minify_script(std::string_view src) {
+    std::string dst;
+    dst.reserve(src.size());
+    char last = 0;
+    std::string_view last_word;
+    bool is_space = false;
+    bool is_newline = false;
+
+    auto write_separator = [&](char next) {
+        if (is_newline && (last != 0) && (strchr("{([,;=:?&|*/%<>!~^", last) == nullptr) && (strchr(")]},;.:?", next) == nullptr)) {
+            dst.push_back('\n');
+        } else if (is_space || is_newline) {
+            const bool is_word = is_ident_char(last) && is_ident_char(next);
+            const bool is_operator = ((last == '+') || (last == '-') || (last == '/')) && ((next == last) || (next == '/') || (next == '*'));
+            if (is_word || is_operator) dst.push_back(' ');
+        }
+        is_space = false;
+        is_newline = false;
+    };
+
+    // Regexes start where a value is expected, divisions follow a value
+    auto is_regex_start = [&]() {
+        if ((last == 0) || (strchr("(,=:[!&|?{};+-*%<>~^", last) != nullptr)) return true;
+        return (last_word == "return") || (last_word == "typeof") || (last_word == "case") || (last_word == "in") || (last_word == "of");
+    };
+
+    size_t i = 0;
+    while (i < src.size()) {
+        const char c = src[i];
+        const char next = (i+1 < src.size()) ? src[i+1] : 0;
+        if ((c == ' ') || (c == '\t') || (c == '\r')) {
+            is_space = true;
+            i++;
+            continue;
+        }
+        if (c == '\n') {
+            is_newline = true;
+            i++;
+            continue;
+        }
+        if ((c == '/') && (next == '/')) {
+            while ((i < src.size()) && (src[i] != '\n')) i++;
+            continue;
+        }
+        if ((c == '/') && (next == '*')) {
+            const size_t end = src.find("*/", i+2);
+            const bool has_newline = src.substr(i, end-i).find('\n') != std::string_view::npos;
+            i = (end == std::string_view::npos) ? src.size() : end+2;
+            is_newline = is_newline || has_newline;
+            is_space = true;
+            continue;
+        }
+
+        write_separator(c);
+        const size_t start = i;
+        if ((c == '"') || (c == '\'') || (c == '`') || ((c == '/') && is_regex_start())) {
+            // NOTE: Template literal substitutions are copied as is, nested templates in them aren't supported
+            bool is_class = false;
+            i++;
+            while (i < src.size()) {
+                const char s = src[i];
+                if (s == '\\') {
+                    i += 2;
+                    continue;
+                }
+                i++;
+                if ((c == '/') && (s == '[')) is_class = true;
+                else if ((c == '/') && (s == ']')) is_class = false;
+                else if ((s == c) && !is_class) break;
+                else if ((s == '\n') && (c != '`')) break;
+            }
+            if (c == '/') {
+                while ((i < src.size()) && is_ident_char(src[i])) i++;
+            }
+            i = std::min(i, src.size());
+            dst.append(src.substr(start, i-start));
+            last = c;
+            last_word = {};
+            continue;
+        }
+        if (is_ident_char(c)) {
+            while ((i < src.size()) && is_ident_char(src[i])) i++;
+            last_word = src.substr(start, i-start);
+            dst.append(last_word);
+            last = src[i-1];
+            continue;
+        }
+        dst.push_back(c);
+        last = c;
+        last_word = {};
+        i++;
+    }
+    return dst;
+}
+
+static std::string minify_stylesheet(std::string_view src) {
+    std::string dst;
+    dst.reserve(src.size());
+    bool is_space = false;
+    size_t i = 0;
+    while (i < src.size()) {
+        const char c = src[i];
+        if ((c == '/') && (i+1 < src.size()) && (src[i+1] == '*')) {
+            const size_t end = src.find("*/", i+2);
+            i = (end == std::string_view::npos) ? src.size() : end+2;
+            is_space = true;
+            continue;
+        }
+        if (isspace((unsigned char)c) != 0) {
+            is_space = true;
+            i++;
+            continue;
+        }
+        const bool is_punctuation = strchr("{};,", c) != nullptr;
+        if (is_space && !dst.empty() && !is_punctuation && (strchr("{};,:", dst.back()) == nullptr)) {
+            dst.push_back(' ');
+        }
+        is_space = false;
+        if ((c == '}') && !dst.empty() && (dst.back() == ';')) {
+            dst.pop_back();
+        }
+        if ((c == '"') || (c == '\'')) {
+            const size_t start = i++;
+            while ((i < src.size()) && (src[i] != c)) {
+                i += (src[i] == '\\') ? 2 : 1;
+            }
+            i = std::min(i+1, src.size());
+            dst.append(src.substr(start, i-start));
+            continue;
+        }
+        dst.push_back(c);
+        i++;
+    }
+    return dst;
+}
+
+// Reads the subset of import and export statements used in static/js
+struct StatementReader {
+    std::string_view src;
+    size_t pos;
+
+    void skip_space() {
+        while ((pos < src.size()) && (isspace((unsigned char)src[pos]) != 0)) pos++;
+    }
+    bool accept(char c) {
+        skip_space();
+        if ((pos >= src.size()) || (src[pos] != c)) return false;
+        pos++;
+        return true;
+    }
+    bool read_ident(std::string_view& dst) {
+        skip_space();
+        const size_t start = pos;
+        while ((pos < src.size()) && is_ident_char(src[pos])) pos++;
+        dst = src.substr(start, pos-start);
+        return !dst.empty();
+    }
+    bool accept_keyword(std::string_view keyword) {
+        skip_space();
+        if (!starts_with_keyword(src.substr(pos), keyword)) return false;
+        pos += keyword.size();
+        return true;
+    }
+    bool read_string(std::string_view& dst) {
+        skip_space();
+        if ((pos >= src.size()) || ((src[pos] != '"') && (src[pos] != '\''))) return false;
+        const size_t end = src.find(src[pos], pos+1);
+        if (end == std::string_view::npos) return false;
+        dst = src.substr(pos+1, end-pos-1);
+        pos = end+1;
+        return true;
+    }
+    // { a, b as c } after the opening brace
+    bool read_names(std::vector<std::pair<std::string_view, std::string_view>>& dst) {
+        while (true) {
+            if (accept('}')) return true;
+            std::string_view name;
+            if (!read_ident(name)) return false;
+            std::string_view alias = name;
+            if (accept_keyword("as") && !read_ident(alias)) return false;
+            dst.push_back({name, alias});
+            if (!accept(',')) return accept('}');
+        }
+    }
+};
+
+// Joins a module graph into one script in dependency order
+// Each module runs in its own function scope and returns its exports, imports become destructuring
+// NOTE: Exports are copied when the module finishes so reassigned exported variables aren't live bindings
+class ScriptBundler
+{
+private:
+    struct Module {
+        int index;
+        bool is_done;
+    };
+    const fs::path& root;
+    std::unordered_map<std::string, Module> modules;
+    std::string script;
+    int total_modules;
+public:
+    std::string error;
+
+    ScriptBundler(const fs::path& _root): root(_root), total_modules(0) {}
+
+    bool add_entry(std::string_view source, std::string_view base_dir) {
+        std::string body;
+        std::string exports;
+        if (!transform(source, base_dir, body, exports)) return false;
+        script.append(body);
+        return true;
+    }
+
+    const std::string& get_script() const { return script; }
+    int get_total_modules() const { return total_modules; }
+private:
+    bool add_module(const std::string& path, int& index) {
+        auto it = modules.find(path);
+        if (it != modules.end()) {
+            if (!it->second.is_done) {
+                error = "import cycle through '" + path + "'";
+                return false;
+            }
+            index = it->second.index;
+            return true;
+        }
+        modules[path] = { -1, false };
+
+        std::string source;
+        if (!read_file(root / path, source)) {
+            error = "can't read '" + path + "'";
+            return false;
+        }
+        std::string body;
+        std::string exports;
+        if (!transform(source, get_base_dir(path), body, exports)) {
+            error = "'" + path + "': " + error;
+            return false;
+        }
+
+        // NOTE: Dependencies were appended while transforming so they come before this module
+        index = total_modules++;
+        script.append("const __module_" + std::to_string(index) + " = (() => {\n");
+        script.append(body);
+        script.append("return {" + exports + " };\n})();\n");
+        modules[path] = { index, true };
+        return true;
+    }
+
+    // NOTE: Only statements at the start of a line are treated as imports and exports
+    bool transform(std::string_view source, std::string_view base_dir, std::string& body, std::string& exports) {
+        size_t pos = 0;
+        while (pos < source.size()) {
+            const size_t line_end = std::min(source.find('\n', pos), source.size());
+            const auto line = source.substr(pos, line_end-pos);
+            const size_t indent = std::min(line.find_first_not_of(" \t"), line.size());
+            const auto statement = line.substr(indent);
+            StatementReader reader { source, pos+indent };
+
+            if (starts_with_keyword(statement, "import") && (statement.substr(6, 1) != "(") && (statement.substr(6, 1) != ".")) {
+                reader.pos += 6;
+                if (!read_import(reader, base_dir, body)) return false;
+            } else if (starts_with_keyword(statement, "export")) {
+                reader.pos += 6;
+                std::string_view keyword;
+                if (reader.accept('{')) {
+                    std::vector<std::pair<std::string_view, std::string_view>> names;
+                    if (!reader.read_names(names)) {
+                        error = "malformed export list";
+                        return false;
+                    }
+                    if (reader.accept_keyword("from")) {
+                        error = "re-exports aren't supported";
+                        return false;
+                    }
+                    reader.accept(';');
+                    for (const auto& [name, alias]: names) {
+                        write_property(exports, alias, name);
+                    }
+                } else if (reader.read_ident(keyword) && is_declaration(keyword)) {
+                    const size_t declaration_start = reader.pos - keyword.size();
+                    if (keyword == "async") reader.accept_keyword("function");
+                    reader.accept('*');
+                    std::string_view name;
+                    if (!reader.read_ident(name)) {
+                        error = "destructured exports aren't supported";
+                        return false;
+                    }
+                    write_property(exports, name, name);
+                    body.append(source.substr(declaration_start, line_end-declaration_start));
+                    body.push_back('\n');
+                    pos = line_end+1;
+                    continue;
+                } else {
+                    error = "default exports aren't supported";
+                    return false;
+                }
+            } else {
+                body.append(line);
+                body.push_back('\n');
+                pos = line_end+1;
+                continue;
+            }
+
+            // Rest of the line after the statement
+            const size_t rest_end = std::min(source.find('\n', reader.pos), source.size());
+            body.append(source.substr(reader.pos, rest_end-reader.pos));
+            body.push_back('\n');
+            pos = rest_end+1;
+        }
+        return true;
+    }
+
+    bool read_import(StatementReader& reader, std::string_view base_dir, std::string& body) {
+        std::string binding;
+        std::string_view specifier;
+        if (reader.read_string(specifier)) {
+            // Only run for its side effects
+        } else if (reader.accept('{')) {
+            std::vector<std::pair<std::string_view, std::string_view>> names;
+            if (!reader.read_names(names)) {
+                error = "malformed import list";
+                return false;
+            }
+            binding = "const {";
+            for (const auto& [name, alias]: names) {
+                write_property(binding, name, alias);
+            }
+            binding.append(" }");
+        } else if (reader.accept('*')) {
+            std::string_view name;
+            if (!reader.accept_keyword("as") || !reader.read_ident(name)) {
+                error = "malformed namespace import";
+                return false;
+            }
+            binding = "const ";
+            binding.append(name);
+        } else {
+            error = "default imports aren't supported";
+            return false;
+        }
+        if (specifier.empty() && (!reader.accept_keyword("from") || !reader.read_string(specifier))) {
+            error = "import without a module specifier";
+            return false;
+        }
+        reader.accept(';');
+
+        std::string path;
+        if (!resolve_path(base_dir, specifier, path)) {
+            error = "can't resolve '" + std::string(specifier) + "'";
+            return false;
+        }
+        int index = 0;
+        if (!add_module(path, index)) return false;
+        if (!binding.empty()) {
+            body.append(binding + " = __module_" + std::to_string(index) + ";");
+        }
+        return true;
+    }
+
+    static bool is_declaration(std::string_view keyword) {
+        return (keyword == "const") || (keyword == "let") || (keyword == "var") ||
+               (keyword == "function") || (keyword == "class") || (keyword == "async");
+    }
+
+    // Object property used for both export objects and import destructuring, e.g. "a, b: c"
+    static void write_property(std::string& dst, std::string_view key, std::string_view value) {
+        if (!dst.empty() && (dst.back() != '{')) dst.push_back(',');
+        dst.push_back(' ');
+        dst.append(key);
+        if (key != value) {
+            dst.append(": ");
+            dst.append(value);
+        }
+    }
+};
+
+// Returns the value of an attribute in a tag, e.g. href="./css/app.css"
+static std::string_view get_attribute(std::string_view tag, std::string_view name) {
+    const std::string pattern = " " + std::string(name) + "=\"";
+    const size_t start = tag.find(pattern);
+    if (start == std::string_view::npos) return {};
+    const size_t value_start = start + pattern.size();
+    const size_t end = tag.find('"', value_start);
+    if (end == std::string_view::npos) return {};
+    return tag.substr(value_start, end-value_start);
+}
+
+size_t StaticBundles::build(const std::string& root_filepath) {
+    const fs::path root = fs::path(root_filepath);
+    std::error_code ec;
+    auto it = fs::directory_iterator(root, ec);
+    if (ec) {
+        fprintf(stderr, "Can't bundle static folder '%s': %s\n", root_filepath.c_str(), ec.message().c_str());
+        return 0;
+    }
+
+    size_t total_pages = 0;
+    for (const auto& entry: it) {
+        if (!entry.is_regular_file() || (entry.path().extension() != ".html")) continue;
+        const std::string page = entry.path().filename().string();
+        std::string html;
+        if (!read_file(entry.path(), html)) continue;
+
+        // Only layouts with a module script are bundled
+        constexpr std::string_view SCRIPT_OPEN = "<script type=\"module\">";
+        constexpr std::string_view SCRIPT_CLOSE = "</script>";
+        const size_t script_start = html.find(SCRIPT_OPEN);
+        if (script_start == std::string::npos) continue;
+        const size_t script_end = html.find(SCRIPT_CLOSE, script_start);
+        if ((script_end == std::string::npos) || (html.find(SCRIPT_OPEN, script_end) != std::string::npos)) {
+            fprintf(stderr, "Not bundling '%s': expected one inline module script\n", page.c_str());
+            continue;
+        }
+        const auto inline_script = std::string_view(html).substr(script_start + SCRIPT_OPEN.size(), script_end - script_start - SCRIPT_OPEN.size());
+
+        ScriptBundler bundler(root);
+        if (!bundler.add_entry(inline_script, get_base_dir(page))) {
+            fprintf(stderr, "Not bundling '%s': %s\n", page.c_str(), bundler.error.c_str());
+            continue;
+        }
+        const std::string script = minify_script(bundler.get_script());
+
+        // Local stylesheets are joined in order, ones with urls are left alone since they are relative to the stylesheet
+        std::string stylesheet;
+        std::vector<std::pair<size_t, size_t>> link_tags;
+        for (size_t pos = html.find("<link"); pos < script_start; pos = html.find("<link", pos)) {
+            const size_t end = html.find('>', pos);
+            if (end == std::string::npos) break;
+            const auto tag = std::string_view(html).substr(pos, end+1-pos);
+            pos = end+1;
+            if (get_attribute(tag, "rel") != "stylesheet") continue;
+            std::string path;
+            std::string source;
+            if (!resolve_path(get_base_dir(page), get_attribute(tag, "href"), path)) continue;
+            if (!read_file(root / path, source)) continue;
+            if ((source.find("url(") != std::string::npos) || (source.find("@import") != std::string::npos)) continue;
+            stylesheet.append(minify_stylesheet(source));
+            link_tags.push_back({tag.data() - html.data(), tag.size()});
+        }
+
+        const std::string name = entry.path().stem().string();
+        const std::string script_url = "bundle/" + name + "." + get_content_hash(script) + ".js";
+        const std::string stylesheet_url = "bundle/" + name + "." + get_content_hash(stylesheet) + ".css";
+
+        // Rewrite from the end so earlier offsets stay valid
+        html.replace(script_start, script_end + SCRIPT_CLOSE.size() - script_start,
+            "<script type=\"module\" src=\"./" + script_url + "\"></script>");
+        for (size_t i = link_tags.size(); i > 0; i--) {
+            auto [start, size] = link_tags[i-1];
+            if (i == 1) {
+                html.replace(start, size, "<link rel=\"stylesheet\" href=\"./" + stylesheet_url + "\">");
+                continue;
+            }
+            // Drop the indentation and line of removed tags
+            while ((start > 0) && ((html[start-1] == ' ') || (html[start-1] == '\t'))) {
+                start--;
+                size++;
+            }
+            if ((start > 0) && (html[start-1] == '\n')) {
+                start--;
+                size++;
+            }
+            html.erase(start, size);
+        }
+
+        printf("Bundled page: %s (%d modules, %zu bytes script, %zu bytes stylesheet)\n",
+            page.c_str(), bundler.get_total_modules(), script.size(), stylesheet.size());
+        if (!link_tags.empty()) {
+            files["/" + stylesheet_url] = File { std::move(stylesheet), get_mime_type(".css"), true };
+        }
+        files["/" + script_url] = File { script, get_mime_type(".js"), true };
+        files["/" + page] = File { std::move(html), get_mime_type(".html"), false };
+        total_pages++;
+    }
+    return total_pages;
+}
+
+const StaticBundles::File* StaticBundles::find(std::string_view url) const {
+    auto it = files.find(url);
+    return (it == files.end()) ? nullptr : &it->second;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <map>
+#include <string>
+#include <string_view>
+
+// Layout pages rewritten at startup to load one minified script and one stylesheet
+// The module graph of each page's inline <script type="module"> under the static folder is joined into a single script
+// Bundles have content hashed urls so browsers can cache them forever, the original files are still served unchanged
+class StaticBundles
+{
+public:
+    struct File {
+        std::string data;
+        std::string_view mime_type;
+        // Content hashed files never change, pages referencing them must be revalidated
+        bool is_immutable;
+    };
+private:
+    std::map<std::string, File, std::less<>> files;
+public:
+    // Returns the number of pages that were bundled
+    size_t build(const std::string& root);
+    // Returns nullptr if the url isn't a bundle or rewritten page
+    const File* find(std::string_view url) const;
+    size_t get_total_files() const { return files.size(); }
+};
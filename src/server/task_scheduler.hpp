@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <chrono>
+#include <new>
+#include <type_traits>
+
+// Callable stored in place so scheduling a task never allocates
+// NOTE: Captures must be trivially copyable and fit in CAPACITY bytes, e.g. [this, id, deadline]
+class TaskCallback
+{
+public:
+    static constexpr size_t CAPACITY = 32;
+private:
+    alignas(alignof(std::max_align_t)) unsigned char storage[CAPACITY];
+    void (*invoke)(void*);
+public:
+    TaskCallback(): invoke(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, TaskCallback>>>
+    TaskCallback(F&& fn) {
+        using T = std::decay_t<F>;
+        static_assert(sizeof(T) <= CAPACITY, "Task captures don't fit in TaskCallback");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "Task captures are over aligned");
+        static_assert(std::is_trivially_copyable_v<T>, "Task captures must be trivially copyable");
+        new (storage) T(std::forward<F>(fn));
+        invoke = [](void* ptr) { (*static_cast<T*>(ptr))(); };
+    }
+
+    void operator()() { invoke(storage); }
+    explicit operator bool() const { return invoke != nullptr; }
+};
+
+// Runs callbacks at a deadline on the server's event loop
+// Handlers use this for work that isn't triggered by a packet
+class TaskScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using TaskID = uint64_t;
+    static constexpr TaskID INVALID_TASK = 0;
+public:
+    virtual ~TaskScheduler() {};
+    // Returns INVALID_TASK if too many tasks are pending
+    virtual TaskID schedule(Clock::time_point deadline, TaskCallback callback) = 0;
+    // Cancelling a task that already ran or was cancelled does nothing
+    virtual void cancel(TaskID id) = 0;
+};
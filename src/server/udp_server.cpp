@@ -0,0 +1,194 @@
+#include "udp_server.hpp"
+#include "low_latency.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+UdpServer::UdpServer(uv_loop_t* _loop, const UdpConfig& _config, const RateLimitConfig& _rate_limit, PacketHandlerFactory* _factory)
+:   config(_config), rate_limit(_rate_limit), factory(_factory), loop(_loop), socket(nullptr)
+{}
+
+UdpServer::~UdpServer() {
+    if (socket == nullptr) return;
+    uv_udp_recv_stop(socket);
+    // NOTE: libuv frees the handle on the next loop iteration
+    uv_close(reinterpret_cast<uv_handle_t*>(socket), [](uv_handle_t* handle) {
+        delete reinterpret_cast<uv_udp_t*>(handle);
+    });
+    socket = nullptr;
+}
+
+bool UdpServer::listen() {
+    struct sockaddr_in addr;
+    uv_ip4_addr("0.0.0.0", config.port, &addr);
+
+    socket = new uv_udp_t;
+    uv_udp_init(loop, socket);
+    socket->data = this;
+
+    int rv = uv_udp_bind(socket, reinterpret_cast<const struct sockaddr*>(&addr), 0);
+    if (rv == 0) {
+        rv = uv_udp_recv_start(socket, &UdpServer::on_alloc, &UdpServer::on_recv);
+    }
+    if ((rv == 0) && (config.socket.busy_poll_us > 0)) {
+        if (!tune_socket(reinterpret_cast<uv_handle_t*>(socket), false, config.socket)) {
+            fprintf(stderr, "Failed to set busy polling on the udp socket, continuing without it\n");
+        }
+    }
+    if (rv != 0) {
+        fprintf(stderr, "Failed to start udp server on port=%d: %s\n", config.port, uv_strerror(rv));
+        uv_close(reinterpret_cast<uv_handle_t*>(socket), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_udp_t*>(handle);
+        });
+        socket = nullptr;
+        return false;
+    }
+    printf("Listening for udp packets on port %d\n", config.port);
+    return true;
+}
+
+void UdpServer::on_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
+    auto* self = static_cast<UdpServer*>(handle->data);
+    *buf = uv_buf_init(self->recv_buf.data(), (unsigned int)(self->recv_buf.size()));
+}
+
+void UdpServer::on_recv(uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags) {
+    auto* self = static_cast<UdpServer*>(handle->data);
+    // NOTE: libuv signals an empty read queue with nread=0 and addr=NULL
+    if ((nread <= 0) || (addr == nullptr)) {
+        return;
+    }
+    if (flags & UV_UDP_PARTIAL) {
+        self->stats.total_malformed++;
+        return;
+    }
+    auto data = tcb::span<const uint8_t>(reinterpret_cast<const uint8_t*>(buf->base), size_t(nread));
+    self->on_datagram(data, addr);
+}
+
+void UdpServer::on_datagram(tcb::span<const uint8_t> buf, const struct sockaddr* addr) {
+    stats.total_datagrams++;
+    if (buf.size() < TOKEN_SIZE) {
+        stats.total_malformed++;
+        return;
+    }
+
+    const auto token = buf.first(TOKEN_SIZE);
+    const auto packet = buf.subspan(TOKEN_SIZE);
+    SessionKey key;
+    if (!create_key(addr, token, key)) {
+        stats.total_malformed++;
+        return;
+    }
+
+    const auto now = Clock::now();
+    auto it = sessions.find(key);
+    if (it == sessions.end()) {
+        if (sessions.size() >= size_t(config.max_sessions)) {
+            stats.total_throttled++;
+            return;
+        }
+        Session session;
+        session.handler = factory->create_handler();
+        session.message_bucket = TokenBucket(rate_limit.messages);
+        session.byte_bucket = TokenBucket(rate_limit.bytes);
+        it = sessions.insert({key, std::move(session)}).first;
+        // NOTE: Map nodes have stable addresses so the sink can be attached after insertion
+        auto& sink = it->second.sink;
+        sink.server = this;
+        memset(&sink.addr, 0, sizeof(sink.addr));
+        const size_t addr_size = (addr->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        memcpy(&sink.addr, addr, addr_size);
+        std::copy(token.begin(), token.end(), sink.token.begin());
+        it->second.handler->attach_sink(&sink);
+        stats.total_sessions++;
+        stats.total_active++;
+    }
+
+    auto& session = it->second;
+    session.last_seen = now;
+    if (rate_limit.is_enabled) {
+        // NOTE: Datagrams are unreliable anyway so excess packets are dropped instead of conflated
+        const bool is_allowed = 
+            session.message_bucket.can_consume(1.0f, now) &&
+            session.byte_bucket.try_consume(float(packet.size()), now) &&
+            session.message_bucket.try_consume(1.0f, now);
+        if (!is_allowed) {
+            stats.total_throttled++;
+            send(token, session.handler->on_rate_limited(packet), addr);
+            return;
+        }
+    }
+
+    const auto res = session.handler->on_packet(packet);
+    send(token, res, addr);
+}
+
+void UdpServer::send(tcb::span<const uint8_t> token, tcb::span<const uint8_t> buf, const struct sockaddr* addr) {
+    if (buf.size() == 0) return;
+    if (token.size() + buf.size() > send_buf.size()) return;
+    std::copy(token.begin(), token.end(), send_buf.begin());
+    std::copy(buf.begin(), buf.end(), send_buf.begin() + token.size());
+    uv_buf_t data = uv_buf_init(
+        reinterpret_cast<char*>(send_buf.data()),
+        (unsigned int)(token.size() + buf.size())
+    );
+    // NOTE: Try to send immediately since responses are tiny and we don't want to queue them
+    const int rv = uv_udp_try_send(socket, &data, 1, addr);
+    if (rv < 0) {
+        stats.total_send_failures++;
+    }
+}
+
+void UdpServer::expire_sessions() {
+    const auto now = Clock::now();
+    const auto timeout = std::chrono::milliseconds(config.idle_timeout_ms);
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if ((now - it->second.last_seen) > timeout) {
+            // NOTE: Destroying the handler releases any acquired devices
+            it = sessions.erase(it);
+            stats.total_active--;
+            stats.total_expired++;
+        } else {
+            it++;
+        }
+    }
+}
+
+bool UdpServer::create_key(const struct sockaddr* addr, tcb::span<const uint8_t> token, SessionKey& key) {
+    key.fill(0);
+    auto* it = key.data();
+    if (addr->sa_family == AF_INET) {
+        const auto* addr_in = reinterpret_cast<const struct sockaddr_in*>(addr);
+        it[0] = 4;
+        memcpy(&it[2], &addr_in->sin_port, 2);
+        memcpy(&it[4], &addr_in->sin_addr, 4);
+    } else if (addr->sa_family == AF_INET6) {
+        const auto* addr_in6 = reinterpret_cast<const struct sockaddr_in6*>(addr);
+        it[0] = 6;
+        memcpy(&it[2], &addr_in6->sin6_port, 2);
+        memcpy(&it[4], &addr_in6->sin6_addr, 16);
+    } else {
+        return false;
+    }
+    std::copy(token.begin(), token.end(), key.end() - TOKEN_SIZE);
+    return true;
+}
+
+void UdpServer::write_stats(std::string& dst) const {
+    char buf[512];
+    const int N = snprintf(buf, sizeof(buf),
+        "\"udp\":{"
+        "\"sessions\":%llu,\"active\":%llu,\"expired\":%llu,\"datagrams\":%llu,"
+        "\"malformed\":%llu,\"throttled\":%llu,\"send_failures\":%llu"
+        "}",
+        (unsigned long long)stats.total_sessions,
+        (unsigned long long)stats.total_active,
+        (unsigned long long)stats.total_expired,
+        (unsigned long long)stats.total_datagrams,
+        (unsigned long long)stats.total_malformed,
+        (unsigned long long)stats.total_throttled,
+        (unsigned long long)stats.total_send_failures
+    );
+    dst.append(buf, size_t(N));
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <uv.h>
+#include "packet_handler.hpp"
+#include "rate_limiter.hpp"
+#include "server_config.hpp"
+
+struct UdpStats {
+    uint64_t total_sessions = 0;
+    uint64_t total_active = 0;
+    uint64_t total_expired = 0;
+    uint64_t total_datagrams = 0;
+    uint64_t total_malformed = 0;
+    uint64_t total_throttled = 0;
+    uint64_t total_send_failures = 0;
+};
+
+// Datagram transport for the same packet handlers used by the websocket
+// Each datagram is a u32 session token (little endian) followed by a regular packet
+// Sessions are keyed by source address and token, and expire when idle
+class UdpServer 
+{
+public:
+    static constexpr size_t TOKEN_SIZE = 4;
+private:
+    using Clock = std::chrono::steady_clock;
+    // family, port, address, token
+    using SessionKey = std::array<uint8_t, 2+2+16+TOKEN_SIZE>;
+    class Sink: public PacketSink 
+    {
+    public:
+        UdpServer* server = nullptr;
+        struct sockaddr_storage addr;
+        std::array<uint8_t, TOKEN_SIZE> token;
+        void send_packet(tcb::span<const uint8_t> buf) override {
+            server->send(token, buf, reinterpret_cast<const struct sockaddr*>(&addr));
+        }
+    };
+    struct Session {
+        // NOTE: Sink is declared first so it outlives the handler
+        Sink sink;
+        std::unique_ptr<PacketHandler> handler;
+        TokenBucket message_bucket;
+        TokenBucket byte_bucket;
+        Clock::time_point last_seen;
+    };
+
+    const UdpConfig config;
+    const RateLimitConfig rate_limit;
+    PacketHandlerFactory* const factory;
+    uv_loop_t* const loop;
+    uv_udp_t* socket;
+    std::map<SessionKey, Session> sessions;
+    UdpStats stats;
+    // Datagrams are processed synchronously so a single buffer is enough
+    std::array<char, 2048> recv_buf;
+    std::array<uint8_t, 2048> send_buf;
+public:
+    UdpServer(uv_loop_t* _loop, const UdpConfig& _config, const RateLimitConfig& _rate_limit, PacketHandlerFactory* _factory);
+    ~UdpServer();
+    UdpServer(const UdpServer&) = delete;
+    UdpServer(UdpServer&&) = delete;
+    UdpServer& operator=(const UdpServer&) = delete;
+    UdpServer& operator=(UdpServer&&) = delete;
+
+    bool listen();
+    void expire_sessions();
+    void write_stats(std::string& dst) const;
+private:
+    static void on_alloc(uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf);
+    static void on_recv(uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags);
+    void on_datagram(tcb::span<const uint8_t> buf, const struct sockaddr* addr);
+    void send(tcb::span<const uint8_t> token, tcb::span<const uint8_t> buf, const struct sockaddr* addr);
+    static bool create_key(const struct sockaddr* addr, tcb::span<const uint8_t> token, SessionKey& key);
+};
@@ -0,0 +1,250 @@
+/* Shared memory input ring for local producers
+ * Producers on the same machine push packets without any syscalls
+ * The server drains the ring on its event loop and applies each packet
+ *
+ * Usage:
+ *   vjoy_input_ring_handle handle;
+ *   if (vjoy_input_ring_open(&handle, VJOY_INPUT_RING_DEFAULT_NAME) != 0) { ... }
+ *   const uint32_t producer_id = 1234;
+ *   vjoy_input_ring_acquire_device(handle.ring, producer_id, 1);
+ *   vjoy_input_ring_set_axis(handle.ring, producer_id, 0x00, 150);
+ *   vjoy_input_ring_close(&handle);
+ *
+ * Each producer_id gets its own session on the server, just like a websocket client
+ * Records use the same packet format as the websocket, refer to src/controller/packets.txt
+ * Sessions are closed after a period without any records, which releases the device
+ */
+#ifndef VJOY_INPUT_RING_H
+#define VJOY_INPUT_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#define VJOY_INPUT_RING_DEFAULT_NAME "Local\\VirtualJoystickCpp.InputRing"
+#else
+#define VJOY_INPUT_RING_DEFAULT_NAME "/VirtualJoystickCpp.InputRing"
+#endif
+
+#define VJOY_INPUT_RING_MAGIC       0x564A5249u /* 'VJRI' */
+#define VJOY_INPUT_RING_VERSION     1u
+#define VJOY_INPUT_RING_TOTAL_SLOTS 1024u       /* Must be a power of 2 */
+#define VJOY_INPUT_RING_MAX_PACKET  20u
+
+typedef struct {
+    volatile uint32_t sequence;
+    uint32_t producer_id;
+    uint8_t length;
+    uint8_t reserved[3];
+    uint8_t data[VJOY_INPUT_RING_MAX_PACKET];
+} vjoy_input_record;
+
+/* Bounded multi producer single consumer queue
+ * Refer to Dmitry Vyukov's bounded MPMC queue for the sequence number scheme */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_slots;
+    uint32_t record_size;
+    volatile uint32_t total_dropped;
+    uint8_t pad0[64-5*sizeof(uint32_t)];
+    /* Producer and consumer indices are on separate cache lines */
+    volatile uint32_t write_index;
+    uint8_t pad1[64-sizeof(uint32_t)];
+    volatile uint32_t read_index;
+    uint8_t pad2[64-sizeof(uint32_t)];
+    vjoy_input_record records[VJOY_INPUT_RING_TOTAL_SLOTS];
+} vjoy_input_ring;
+
+typedef struct {
+    vjoy_input_ring* ring;
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} vjoy_input_ring_handle;
+
+/* Atomic primitives that work with both C and C++ compilers */
+#ifdef _MSC_VER
+static inline uint32_t vjoy_input_ring_load(volatile uint32_t* p) {
+    return (uint32_t)_InterlockedOr((volatile long*)p, 0);
+}
+static inline void vjoy_input_ring_store(volatile uint32_t* p, uint32_t v) {
+    _InterlockedExchange((volatile long*)p, (long)v);
+}
+static inline int vjoy_input_ring_cas(volatile uint32_t* p, uint32_t expected, uint32_t desired) {
+    return (uint32_t)_InterlockedCompareExchange((volatile long*)p, (long)desired, (long)expected) == expected;
+}
+static inline void vjoy_input_ring_increment(volatile uint32_t* p) {
+    _InterlockedIncrement((volatile long*)p);
+}
+#else
+static inline uint32_t vjoy_input_ring_load(volatile uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void vjoy_input_ring_store(volatile uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static inline int vjoy_input_ring_cas(volatile uint32_t* p, uint32_t expected, uint32_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+static inline void vjoy_input_ring_increment(volatile uint32_t* p) {
+    __atomic_fetch_add(p, 1u, __ATOMIC_RELAXED);
+}
+#endif
+
+/* Server side setup of a freshly created region */
+static inline void vjoy_input_ring_init(vjoy_input_ring* ring) {
+    uint32_t i;
+    memset(ring, 0, sizeof(vjoy_input_ring));
+    ring->version = VJOY_INPUT_RING_VERSION;
+    ring->total_slots = VJOY_INPUT_RING_TOTAL_SLOTS;
+    ring->record_size = (uint32_t)sizeof(vjoy_input_record);
+    for (i = 0; i < VJOY_INPUT_RING_TOTAL_SLOTS; i++) {
+        ring->records[i].sequence = i;
+    }
+    /* Producers check the magic last so they never see a half initialised ring */
+    vjoy_input_ring_store(&ring->magic, VJOY_INPUT_RING_MAGIC);
+}
+
+static inline int vjoy_input_ring_is_valid(vjoy_input_ring* ring) {
+    return
+        (vjoy_input_ring_load(&ring->magic) == VJOY_INPUT_RING_MAGIC) &&
+        (ring->version == VJOY_INPUT_RING_VERSION) &&
+        (ring->total_slots == VJOY_INPUT_RING_TOTAL_SLOTS) &&
+        (ring->record_size == (uint32_t)sizeof(vjoy_input_record));
+}
+
+/* Returns 1 if the packet was queued, 0 if the ring is full or the packet is too large */
+static inline int vjoy_input_ring_push(vjoy_input_ring* ring, uint32_t producer_id, const uint8_t* data, uint32_t length) {
+    const uint32_t mask = VJOY_INPUT_RING_TOTAL_SLOTS-1u;
+    vjoy_input_record* record;
+    uint32_t index;
+    if (length > VJOY_INPUT_RING_MAX_PACKET) {
+        return 0;
+    }
+    index = vjoy_input_ring_load(&ring->write_index);
+    for (;;) {
+        int32_t diff;
+        record = &ring->records[index & mask];
+        diff = (int32_t)(vjoy_input_ring_load(&record->sequence) - index);
+        if (diff == 0) {
+            if (vjoy_input_ring_cas(&ring->write_index, index, index+1u)) break;
+            index = vjoy_input_ring_load(&ring->write_index);
+        } else if (diff < 0) {
+            vjoy_input_ring_increment(&ring->total_dropped);
+            return 0;
+        } else {
+            index = vjoy_input_ring_load(&ring->write_index);
+        }
+    }
+    record->producer_id = producer_id;
+    record->length = (uint8_t)length;
+    memcpy(record->data, data, length);
+    /* Publish record to consumer */
+    vjoy_input_ring_store(&record->sequence, index+1u);
+    return 1;
+}
+
+/* Consumer side, returns 1 if a record was copied into dst */
+static inline int vjoy_input_ring_pop(vjoy_input_ring* ring, vjoy_input_record* dst) {
+    const uint32_t mask = VJOY_INPUT_RING_TOTAL_SLOTS-1u;
+    const uint32_t index = ring->read_index;
+    vjoy_input_record* record = &ring->records[index & mask];
+    const int32_t diff = (int32_t)(vjoy_input_ring_load(&record->sequence) - (index+1u));
+    if (diff < 0) {
+        return 0;
+    }
+    dst->producer_id = record->producer_id;
+    dst->length = record->length;
+    memcpy(dst->data, record->data, VJOY_INPUT_RING_MAX_PACKET);
+    /* Release slot back to producers */
+    vjoy_input_ring_store(&record->sequence, index+VJOY_INPUT_RING_TOTAL_SLOTS);
+    vjoy_input_ring_store(&ring->read_index, index+1u);
+    return 1;
+}
+
+/* Convenience encoders for the packet format */
+static inline int vjoy_input_ring_acquire_device(vjoy_input_ring* ring, uint32_t producer_id, uint8_t device_id) {
+    const uint8_t packet[2] = { 0x00, device_id };
+    return vjoy_input_ring_push(ring, producer_id, packet, sizeof(packet));
+}
+
+static inline int vjoy_input_ring_set_button(vjoy_input_ring* ring, uint32_t producer_id, uint8_t button_id, uint8_t is_pressed) {
+    const uint8_t packet[3] = { 0x01, button_id, is_pressed };
+    return vjoy_input_ring_push(ring, producer_id, packet, sizeof(packet));
+}
+
+/* value is between 0 and 200 with 100 as the center */
+static inline int vjoy_input_ring_set_axis(vjoy_input_ring* ring, uint32_t producer_id, uint8_t axis_id, uint8_t value) {
+    const uint8_t packet[3] = { 0x02, axis_id, value };
+    return vjoy_input_ring_push(ring, producer_id, packet, sizeof(packet));
+}
+
+static inline int vjoy_input_ring_reset(vjoy_input_ring* ring, uint32_t producer_id) {
+    const uint8_t packet[1] = { 0x03 };
+    return vjoy_input_ring_push(ring, producer_id, packet, sizeof(packet));
+}
+
+/* Open a ring created by the server, returns 0 on success */
+static inline int vjoy_input_ring_open(vjoy_input_ring_handle* handle, const char* name) {
+    void* view;
+    handle->ring = NULL;
+#ifdef _WIN32
+    handle->mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (handle->mapping == NULL) return -1;
+    view = MapViewOfFile(handle->mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(vjoy_input_ring));
+    if (view == NULL) {
+        CloseHandle(handle->mapping);
+        return -1;
+    }
+#else
+    handle->fd = shm_open(name, O_RDWR, 0);
+    if (handle->fd < 0) return -1;
+    view = mmap(NULL, sizeof(vjoy_input_ring), PROT_READ | PROT_WRITE, MAP_SHARED, handle->fd, 0);
+    if (view == MAP_FAILED) {
+        close(handle->fd);
+        return -1;
+    }
+#endif
+    handle->ring = (vjoy_input_ring*)view;
+    if (!vjoy_input_ring_is_valid(handle->ring)) {
+        return -2;
+    }
+    return 0;
+}
+
+static inline void vjoy_input_ring_close(vjoy_input_ring_handle* handle) {
+    if (handle->ring == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(handle->ring);
+    CloseHandle(handle->mapping);
+#else
+    munmap(handle->ring, sizeof(vjoy_input_ring));
+    close(handle->fd);
+#endif
+    handle->ring = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
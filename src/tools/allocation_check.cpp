@@ -0,0 +1,225 @@
+// Check that connecting and steady state input don't allocate on the server
+// Runs the server in process, then connects, sends input and disconnects over and over on a websocket
+// Input is sent faster than the rate limit so axes are conflated like a busy client's would be
+// Fails if anything allocated after the warm up rounds
+// NOTE: Only counts allocations when built with -DCOUNT_ALLOCATIONS=ON and needs a free vJoy device
+// NOTE: Only operator new is counted, malloc calls inside uSockets and libuv aren't seen
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "vjoy.hpp"
+#include "server/run_server.hpp"
+#include "controller/controller_packet_handler.hpp"
+#include "controller/packets.hpp"
+#include "utility/allocation_counter.hpp"
+#define OPTPARSE_IMPLEMENTATION
+#include "utility/optparse.h"
+#include "tools/loopback_transport.hpp"
+
+struct ArgumentParser {
+    int port;
+    const char* static_filepath;
+    int total_warmup;
+    int total_rounds;
+    int total_packets;
+};
+
+// Server side message rate limit, the burst only fits the control packets of a round
+constexpr float RATE_LIMIT_MESSAGES = 1000.0f;
+constexpr float RATE_LIMIT_BURST = 20.0f;
+constexpr int TOTAL_BUTTON_PACKETS = 4;
+
+// Input that goes through the rate limiter, the scheduler, the jitter buffer and axis smoothing
+// Returns false if the device couldn't be acquired or the server stopped responding
+// NOTE: Adds the packets that were conflated to total_conflated, which is every packet without a reply
+static bool run_round(const ArgumentParser& args, uint64_t& total_conflated) {
+    WebsocketTransport transport;
+    if (!transport.open("127.0.0.1", args.port, 1000)) return false;
+    uint8_t buf[64];
+    uint8_t inner[8];
+    uint8_t response[256];
+
+    auto send = [&transport](tcb::span<const uint8_t> packet) {
+        return transport.send_packet(packet.data(), packet.size());
+    };
+    if (!send(AcquireAnyRequest::write(buf))) return false;
+    const int length = transport.recv_packet(response, sizeof(response));
+    if ((length < 2) || (response[0] != uint8_t(Command::ACQUIRE_ANY)) || (response[1] != uint8_t(Status_Acquire::SUCCESS))) {
+        return false;
+    }
+
+    send(SetAxisCurveRequest::write(buf, uint8_t(Axis::X), 5, 100, 20, 0, 50));
+    send(SetPlayoutRequest::write(buf, 1, 1, 5));
+    // NOTE: Buttons are control packets which would be rejected instead of conflated past the burst
+    for (int i = 0; i < TOTAL_BUTTON_PACKETS; i++) {
+        send(SetButtonRequest::write(buf, 1, uint8_t(i % 2)));
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.total_packets; i++) {
+        send(SetAxisRequest::write(buf, uint8_t(Axis::X), uint8_t(i % 201)));
+        const auto client_time_us = uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        const auto inner_packet = SetAxisRequest::write(inner, uint8_t(Axis::Y), uint8_t((i*7) % 201));
+        send(TimestampedRequest::write(buf, client_time_us, inner_packet));
+    }
+
+    // Gives the rate limiter time to refill and apply the conflated axes and the jitter buffer time to play out
+    // Replies are then in order so device info comes after everything above was handled
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (!send(GetDevInfoRequest::write(buf))) return false;
+    int total_replies = 0;
+    while (true) {
+        const int length = transport.recv_packet(response, sizeof(response));
+        if (length < 1) return false;
+        if (response[0] == uint8_t(Command::GET_DEV_INFO)) break;
+        if (response[0] == uint8_t(Command::INVALID_REQUEST)) return false;
+        if (response[0] == uint8_t(Command::FLOW_CONTROL)) continue;
+        total_replies++;
+    }
+    const int total_sent = 2 + TOTAL_BUTTON_PACKETS + 2*args.total_packets;
+    total_conflated += uint64_t(std::max(0, total_sent - total_replies));
+    return true;
+}
+
+void print_usage(void) {
+    fprintf(stderr,
+        "allocation_check, Check the server doesn't allocate when clients connect and send input\n\n"
+        "\t[--port <port>                (default: 3999)]\n"
+        "\t[--static-filepath <filepath> (default: './static')]\n"
+        "\t[--warmup <n>                 (default: 20 connections before counting)]\n"
+        "\t[--rounds <n>                 (default: 100 connections while counting)]\n"
+        "\t[--packets <n>                (default: 50 axis and 50 timestamped axis packets per connection)]\n"
+        "\t[--help                       (show usage)]\n"
+    );
+}
+
+ArgumentParser parse_arguments(int argc, char** argv) {
+    ArgumentParser parser;
+    parser.port = 3999;
+    parser.static_filepath = "./static";
+    parser.total_warmup = 20;
+    parser.total_rounds = 100;
+    parser.total_packets = 50;
+
+    struct optparse options;
+    optparse_init(&options, argv);
+    struct optparse_long longopts[] = {
+        {"port",            'p', OPTPARSE_REQUIRED},
+        {"static-filepath", 'd', OPTPARSE_REQUIRED},
+        {"warmup",          'w', OPTPARSE_REQUIRED},
+        {"rounds",          'r', OPTPARSE_REQUIRED},
+        {"packets",         'n', OPTPARSE_REQUIRED},
+        {"help",            'h', OPTPARSE_NONE},
+        {0},
+    };
+
+    while (true) {
+        const int code = optparse_long(&options, longopts, nullptr);
+        if (code == -1) break;
+        switch (code) {
+        case 'p': parser.port = atoi(options.optarg); break;
+        case 'd': parser.static_filepath = options.optarg; break;
+        case 'w': parser.total_warmup = atoi(options.optarg); break;
+        case 'r': parser.total_rounds = atoi(options.optarg); break;
+        case 'n': parser.total_packets = atoi(options.optarg); break;
+        case 'h':
+        case '?':
+            print_usage();
+            exit(1);
+            break;
+        }
+    }
+
+    if ((parser.total_warmup < 0) || (parser.total_rounds <= 0) || (parser.total_packets <= 0)) {
+        fprintf(stderr, "Warm up must not be negative, rounds and packets must be positive\n");
+        exit(1);
+    }
+    return parser;
+}
+
+int main(int argc, char** argv) {
+    const auto args = parse_arguments(argc, argv);
+    if (!get_is_allocation_counter_enabled()) {
+        fprintf(stderr, "Allocations aren't counted, configure with -DCOUNT_ALLOCATIONS=ON\n");
+        return 1;
+    }
+    if (!vjoy::api_is_enabled()) {
+        fprintf(stderr, "vjoy is not enabled\n");
+        return 1;
+    }
+#ifdef _WIN32
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+    ServerConfig config;
+    config.port = args.port;
+    config.static_filepath = args.static_filepath;
+    auto& rate_limit = config.websocket.rate_limit;
+    rate_limit.is_enabled = true;
+    rate_limit.messages.rate = RATE_LIMIT_MESSAGES;
+    rate_limit.messages.burst = RATE_LIMIT_BURST;
+    config.log.level = LogLevel::WARN;
+    ControllerPacketHandlerFactory factory;
+    ServerControl control;
+    std::atomic<int> listen_status {0};
+    control.on_listen = [&listen_status](bool is_listening) {
+        listen_status.store(is_listening ? 1 : -1);
+    };
+    std::thread server_thread([&config, &factory, &control]() {
+        run_server(config, &factory, &control);
+    });
+    while (listen_status.load() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (listen_status.load() < 0) {
+        server_thread.join();
+        fprintf(stderr, "Failed to start server on port=%d\n", args.port);
+        return 1;
+    }
+
+    // NOTE: The server releases the device once it sees the close, so give it time before the next acquire
+    const auto round_gap = std::chrono::milliseconds(20);
+    int total_failed = 0;
+    uint64_t total_conflated = 0;
+    for (int i = 0; i < args.total_warmup; i++) {
+        if (!run_round(args, total_conflated)) total_failed++;
+        std::this_thread::sleep_for(round_gap);
+    }
+    const auto before = get_allocation_counts();
+    total_conflated = 0;
+    for (int i = 0; i < args.total_rounds; i++) {
+        if (!run_round(args, total_conflated)) total_failed++;
+        std::this_thread::sleep_for(round_gap);
+    }
+    // Closes and cancelled tasks are handled before counting
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    const auto after = get_allocation_counts();
+
+    control.stop();
+    server_thread.join();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    const uint64_t total_allocations = after.total_allocations - before.total_allocations;
+    printf("%llu allocations (%llu bytes) over %d connections with %d packets each, %llu conflated\n",
+        (unsigned long long)total_allocations,
+        (unsigned long long)(after.total_bytes - before.total_bytes),
+        args.total_rounds, 2*args.total_packets + TOTAL_BUTTON_PACKETS + 4,
+        (unsigned long long)total_conflated
+    );
+    if (total_failed > 0) {
+        fprintf(stderr, "%d connections failed to acquire a device or get every reply\n", total_failed);
+        return 1;
+    }
+    if (total_conflated == 0) {
+        fprintf(stderr, "Input never went over the rate limit, increase --packets\n");
+        return 1;
+    }
+    return (total_allocations == 0) ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+// Measure round trip latency of the websocket and udp transports
+// Sends set axis packets one at a time and waits for each acknowledgement
+// NOTE: Run the server with --no-rate-limit otherwise packets will be conflated
+// With --interval samples are spaced out like real input, which shows how long the server takes to wake up
+// With --acquire it also measures how long acquiring a device takes on a fresh connection
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#define OPTPARSE_IMPLEMENTATION
+#include "utility/optparse.h"
+#include "loopback_transport.hpp"
+
+struct ArgumentParser {
+    const char* host;
+    int port;
+    int udp_port;
+    int device_id;
+    int total_samples;
+    int total_acquires;
+    int interval_us;
+    int timeout_ms;
+};
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchResult {
+    std::vector<double> rtt_us;
+    int total_lost = 0;
+};
+
+BenchResult run_bench(Transport& transport, const ArgumentParser& args) {
+    BenchResult result;
+    uint8_t response[256];
+
+    // Acquire device so set axis goes through the full path to the driver
+    const uint8_t acquire[2] = { 0x00, uint8_t(args.device_id) };
+    transport.send_packet(acquire, sizeof(acquire));
+    const int length = transport.recv_packet(response, sizeof(response));
+    if ((length >= 2) && (response[0] == 0x00) && (response[1] == 0x00)) {
+        printf("  acquired device %d\n", args.device_id);
+    } else {
+        printf("  failed to acquire device %d, measuring error responses instead\n", args.device_id);
+    }
+
+    result.rtt_us.reserve(size_t(args.total_samples));
+    auto next_send = Clock::now();
+    for (int i = 0; i < args.total_samples; i++) {
+        // NOTE: Spin instead of sleeping so the os timer resolution doesn't skew the spacing
+        if (args.interval_us > 0) {
+            next_send += std::chrono::microseconds(args.interval_us);
+            while (Clock::now() < next_send) {}
+        }
+        const uint8_t packet[3] = { 0x02, 0x00, uint8_t(i % 201) };
+        const auto start = Clock::now();
+        if (!transport.send_packet(packet, sizeof(packet))) {
+            result.total_lost++;
+            continue;
+        }
+        if (transport.recv_packet(response, sizeof(response)) < 0) {
+            result.total_lost++;
+            continue;
+        }
+        const auto end = Clock::now();
+        result.rtt_us.push_back(std::chrono::duration<double, std::micro>(end-start).count());
+    }
+    return result;
+}
+
+// Each sample is a new connection so the server creates the controller from scratch every time
+// NOTE: The device is released when the server sees the previous connection close, acquires that lose the race count as lost
+BenchResult run_acquire_bench(const ArgumentParser& args) {
+    BenchResult result;
+    uint8_t response[256];
+    result.rtt_us.reserve(size_t(args.total_acquires));
+    for (int i = 0; i < args.total_acquires; i++) {
+        WebsocketTransport transport;
+        if (!transport.open(args.host, args.port, args.timeout_ms)) {
+            result.total_lost++;
+            continue;
+        }
+        const uint8_t acquire[2] = { 0x00, uint8_t(args.device_id) };
+        const auto start = Clock::now();
+        if (!transport.send_packet(acquire, sizeof(acquire))) {
+            result.total_lost++;
+            continue;
+        }
+        const int length = transport.recv_packet(response, sizeof(response));
+        const auto end = Clock::now();
+        if ((length < 2) || (response[0] != 0x00) || (response[1] != 0x00)) {
+            result.total_lost++;
+            continue;
+        }
+        result.rtt_us.push_back(std::chrono::duration<double, std::micro>(end-start).count());
+    }
+    return result;
+}
+
+void print_result(const char* name, BenchResult& result) {
+    auto& v = result.rtt_us;
+    if (v.empty()) {
+        printf("%-10s no samples (lost=%d)\n", name, result.total_lost);
+        return;
+    }
+    std::sort(v.begin(), v.end());
+    auto percentile = [&v](const double p) {
+        const size_t i = std::min(v.size()-1, size_t(p*double(v.size())));
+        return v[i];
+    };
+    double sum = 0.0;
+    for (const double x: v) sum += x;
+    printf(
+        "%-10s n=%zu lost=%d mean=%.1fus min=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus\n",
+        name, v.size(), result.total_lost, sum/double(v.size()),
+        v.front(), percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), v.back()
+    );
+}
+
+void print_usage(void) {
+    fprintf(stderr,
+        "loopback_bench, Measure round trip latency of websocket and udp transports\n\n"
+        "\t[--host <ipv4>      (default: 127.0.0.1)]\n"
+        "\t[--port <port>      (default: 3000, 0 to skip websocket)]\n"
+        "\t[--udp-port <port>  (default: 3001, 0 to skip udp)]\n"
+        "\t[--device <id>      (default: 1)]\n"
+        "\t[--samples <n>      (default: 10000)]\n"
+        "\t[--interval <us>    (default: 0, wait between samples, 8000 is a client sending at 125Hz)]\n"
+        "\t[--acquire <n>      (default: 0, acquires on new websocket connections)]\n"
+        "\t[--timeout <ms>     (default: 1000)]\n"
+        "\t[--help             (show usage)]\n"
+    );
+}
+
+ArgumentParser parse_arguments(int argc, char** argv) {
+    ArgumentParser parser;
+    parser.host = "127.0.0.1";
+    parser.port = 3000;
+    parser.udp_port = 3001;
+    parser.device_id = 1;
+    parser.total_samples = 10000;
+    parser.total_acquires = 0;
+    parser.interval_us = 0;
+    parser.timeout_ms = 1000;
+
+    struct optparse options;
+    optparse_init(&options, argv);
+    struct optparse_long longopts[] = {
+        {"host",     'H', OPTPARSE_REQUIRED},
+        {"port",     'p', OPTPARSE_REQUIRED},
+        {"udp-port", 'u', OPTPARSE_REQUIRED},
+        {"device",   'd', OPTPARSE_REQUIRED},
+        {"samples",  'n', OPTPARSE_REQUIRED},
+        {"interval", 'i', OPTPARSE_REQUIRED},
+        {"acquire",  'a', OPTPARSE_REQUIRED},
+        {"timeout",  't', OPTPARSE_REQUIRED},
+        {"help",     'h', OPTPARSE_NONE},
+        {0},
+    };
+
+    while (true) {
+        const int code = optparse_long(&options, longopts, nullptr);
+        if (code == -1) break;
+        switch (code) {
+        case 'H': parser.host = options.optarg; break;
+        case 'p': parser.port = atoi(options.optarg); break;
+        case 'u': parser.udp_port = atoi(options.optarg); break;
+        case 'd': parser.device_id = atoi(options.optarg); break;
+        case 'n': parser.total_samples = atoi(options.optarg); break;
+        case 'i': parser.interval_us = atoi(options.optarg); break;
+        case 'a': parser.total_acquires = atoi(options.optarg); break;
+        case 't': parser.timeout_ms = atoi(options.optarg); break;
+        case 'h':
+        case '?':
+            print_usage();
+            exit(1);
+            break;
+        }
+    }
+
+    if (parser.total_samples <= 0) {
+        fprintf(stderr, "Number of samples must be positive\n");
+        exit(1);
+    }
+    if (parser.interval_us < 0) {
+        fprintf(stderr, "Interval must not be negative\n");
+        exit(1);
+    }
+    return parser;
+}
+
+int main(int argc, char** argv) {
+    const auto args = parse_arguments(argc, argv);
+#ifdef _WIN32
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+    // NOTE: Each transport is closed before the next starts so the device is released
+    if (args.port > 0) {
+        printf("Benchmarking websocket on %s:%d\n", args.host, args.port);
+        WebsocketTransport transport;
+        if (transport.open(args.host, args.port, args.timeout_ms)) {
+            auto result = run_bench(transport, args);
+            print_result("websocket", result);
+        } else {
+            fprintf(stderr, "Failed to open websocket\n");
+        }
+    }
+
+    if ((args.port > 0) && (args.total_acquires > 0)) {
+        printf("Benchmarking acquire on %s:%d\n", args.host, args.port);
+        auto result = run_acquire_bench(args);
+        print_result("acquire", result);
+    }
+
+    if (args.udp_port > 0) {
+        printf("Benchmarking udp on %s:%d\n", args.host, args.udp_port);
+        UdpTransport transport;
+        if (transport.open(args.host, args.udp_port, args.timeout_ms)) {
+            auto result = run_bench(transport, args);
+            print_result("udp", result);
+        } else {
+            fprintf(stderr, "Failed to open udp socket\n");
+        }
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,192 @@
+#pragma once
+// Blocking websocket and udp clients for the tools that talk to a running server
+// NOTE: The websocket transport never allocates so it can run while allocations are counted
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using socket_t = SOCKET;
+inline void close_socket(socket_t s) { closesocket(s); }
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+using socket_t = int;
+constexpr socket_t INVALID_SOCKET = -1;
+inline void close_socket(socket_t s) { close(s); }
+#endif
+
+// Blocking socket with convenience methods for request/response benchmarking
+class Transport
+{
+public:
+    virtual ~Transport() {}
+    virtual bool send_packet(const uint8_t* buf, const size_t N) = 0;
+    // Returns length of response or -1 on timeout/error
+    virtual int recv_packet(uint8_t* buf, const size_t N) = 0;
+};
+
+inline void set_timeout(socket_t s, const int timeout_ms) {
+#ifdef _WIN32
+    DWORD timeout = DWORD(timeout_ms);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#else
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+}
+
+inline bool recv_exact(socket_t s, uint8_t* buf, const size_t N) {
+    size_t total = 0;
+    while (total < N) {
+        const int rv = recv(s, reinterpret_cast<char*>(buf+total), int(N-total), 0);
+        if (rv <= 0) return false;
+        total += size_t(rv);
+    }
+    return true;
+}
+
+class WebsocketTransport: public Transport
+{
+private:
+    socket_t sock = INVALID_SOCKET;
+public:
+    ~WebsocketTransport() override {
+        if (sock != INVALID_SOCKET) close_socket(sock);
+    }
+
+    bool open(const char* host, const int port, const int timeout_ms) {
+        sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET) return false;
+        int flag = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&flag), sizeof(flag));
+        set_timeout(sock, timeout_ms);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(uint16_t(port));
+        inet_pton(AF_INET, host, &addr.sin_addr);
+        if (connect(sock, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            return false;
+        }
+
+        char request[512];
+        const int N = snprintf(request, sizeof(request),
+            "GET /websocket HTTP/1.1\r\n"
+            "Host: %s:%d\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "\r\n",
+            host, port
+        );
+        if (send(sock, request, N, 0) != N) return false;
+
+        // Read until end of http headers
+        char response[4096];
+        size_t M = 0;
+        while (M < sizeof(response)-1) {
+            if (recv(sock, &response[M], 1, 0) != 1) return false;
+            M++;
+            if ((M >= 4) && (memcmp(&response[M-4], "\r\n\r\n", 4) == 0)) break;
+        }
+        response[M] = 0;
+        return strstr(response, " 101 ") != nullptr;
+    }
+
+    bool send_packet(const uint8_t* buf, const size_t N) override {
+        // Client frames must be masked, we only send small binary frames
+        if (N >= 126) return false;
+        uint8_t frame[2+4+126];
+        const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+        frame[0] = 0x82;
+        frame[1] = 0x80 | uint8_t(N);
+        memcpy(&frame[2], mask, 4);
+        for (size_t i = 0; i < N; i++) {
+            frame[6+i] = buf[i] ^ mask[i % 4];
+        }
+        const int total = int(6+N);
+        return send(sock, reinterpret_cast<const char*>(frame), total, 0) == total;
+    }
+
+    int recv_packet(uint8_t* buf, const size_t N) override {
+        uint8_t header[2];
+        if (!recv_exact(sock, header, 2)) return -1;
+        uint64_t length = header[1] & 0x7F;
+        if (length == 126) {
+            uint8_t ext[2];
+            if (!recv_exact(sock, ext, 2)) return -1;
+            length = (uint64_t(ext[0]) << 8) | uint64_t(ext[1]);
+        } else if (length == 127) {
+            return -1;
+        }
+        if (length > N) return -1;
+        if (!recv_exact(sock, buf, size_t(length))) return -1;
+        return int(length);
+    }
+};
+
+class UdpTransport: public Transport
+{
+private:
+    socket_t sock = INVALID_SOCKET;
+    struct sockaddr_in addr;
+    uint8_t token[4];
+public:
+    ~UdpTransport() override {
+        if (sock != INVALID_SOCKET) close_socket(sock);
+    }
+
+    bool open(const char* host, const int port, const int timeout_ms) {
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET) return false;
+        set_timeout(sock, timeout_ms);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(uint16_t(port));
+        inet_pton(AF_INET, host, &addr.sin_addr);
+        std::random_device rd;
+        const uint32_t value = rd();
+        memcpy(token, &value, sizeof(token));
+        return true;
+    }
+
+    bool send_packet(const uint8_t* buf, const size_t N) override {
+        uint8_t datagram[256];
+        if (N+4 > sizeof(datagram)) return false;
+        memcpy(datagram, token, 4);
+        memcpy(datagram+4, buf, N);
+        const int total = int(N+4);
+        const int rv = sendto(
+            sock, reinterpret_cast<const char*>(datagram), total, 0,
+            reinterpret_cast<const struct sockaddr*>(&addr), sizeof(addr)
+        );
+        return rv == total;
+    }
+
+    int recv_packet(uint8_t* buf, const size_t N) override {
+        uint8_t datagram[256];
+        while (true) {
+            const int rv = recv(sock, reinterpret_cast<char*>(datagram), sizeof(datagram), 0);
+            if (rv < 4) return -1;
+            // Ignore late responses from an older session
+            if (memcmp(datagram, token, 4) != 0) continue;
+            const size_t length = std::min(size_t(rv-4), N);
+            memcpy(buf, datagram+4, length);
+            return int(length);
+        }
+    }
+};
+
@@ -0,0 +1,555 @@
+// Generate the C++ and javascript packet codecs from src/controller/packets.schema
+// Usage: packet_codegen <schema> <output.hpp> <output.js>
+// Outputs are only written when they change so dependents aren't rebuilt needlessly
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+enum class FieldType {
+    U8,
+    U16,
+    U32,
+    ENUM,
+    LIST,
+    BYTES,
+};
+
+struct Field {
+    FieldType type;
+    std::string name;
+    // Name of the enum for FieldType::ENUM
+    std::string enum_name;
+};
+
+struct EnumValue {
+    std::string name;
+    int value;
+};
+
+struct Enum {
+    std::string name;
+    std::vector<EnumValue> values;
+};
+
+struct Packet {
+    bool is_request;
+    std::string command;
+    int value;
+    std::vector<Field> fields;
+    std::string description;
+};
+
+struct Schema {
+    std::vector<Enum> enums;
+    std::vector<Packet> packets;
+
+    const Enum* find_enum(const std::string& name) const {
+        for (const auto& e: enums) {
+            if (e.name == name) return &e;
+        }
+        return nullptr;
+    }
+};
+
+static size_t get_field_size(FieldType type) {
+    switch (type) {
+    case FieldType::U8:     return 1;
+    case FieldType::U16:    return 2;
+    case FieldType::U32:    return 4;
+    case FieldType::ENUM:   return 1;
+    // Only the count is fixed
+    case FieldType::LIST:   return 1;
+    case FieldType::BYTES:  return 0;
+    default:                return 0;
+    }
+}
+
+// SET_AXIS -> SetAxis
+static std::string to_pascal_case(const std::string& name) {
+    std::string dst;
+    bool is_upper = true;
+    for (const char c: name) {
+        if (c == '_') {
+            is_upper = true;
+            continue;
+        }
+        dst.push_back(is_upper ? char(toupper(uint8_t(c))) : char(tolower(uint8_t(c))));
+        is_upper = false;
+    }
+    return dst;
+}
+
+// SET_AXIS -> set_axis
+static std::string to_snake_case(const std::string& name) {
+    std::string dst = name;
+    std::transform(dst.begin(), dst.end(), dst.begin(), [](char c) { return char(tolower(uint8_t(c))); });
+    return dst;
+}
+
+static std::string to_hex(int value) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "0x%02X", value);
+    return buf;
+}
+
+static std::vector<std::string> split_tokens(const std::string& line) {
+    std::vector<std::string> tokens;
+    std::istringstream stream(line);
+    std::string token;
+    while (stream >> token) tokens.push_back(token);
+    return tokens;
+}
+
+static bool parse_schema(const char* filepath, Schema& schema) {
+    std::ifstream file(filepath);
+    if (!file.is_open()) {
+        fprintf(stderr, "Failed to open schema '%s'\n", filepath);
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    Enum* current_enum = nullptr;
+    Packet* current_packet = nullptr;
+    auto fail = [&](const char* message) {
+        fprintf(stderr, "%s:%d: %s\n", filepath, line_number, message);
+        return false;
+    };
+
+    while (std::getline(file, line)) {
+        line_number++;
+        if (!line.empty() && (line.back() == '\r')) line.pop_back();
+        const auto tokens = split_tokens(line);
+        if (tokens.empty() || (tokens[0][0] == '#')) continue;
+
+        // Indented lines continue the enum or packet above
+        if (isspace(uint8_t(line[0]))) {
+            if (current_enum != nullptr) {
+                if (tokens.size() != 2) return fail("Expected <NAME> <value>");
+                current_enum->values.push_back({tokens[0], int(strtol(tokens[1].c_str(), nullptr, 0))});
+            } else if (current_packet != nullptr) {
+                for (const auto& token: tokens) {
+                    if (!current_packet->description.empty()) current_packet->description.push_back(' ');
+                    current_packet->description.append(token);
+                }
+            } else {
+                return fail("Indented line without an enum or packet");
+            }
+            continue;
+        }
+
+        current_enum = nullptr;
+        current_packet = nullptr;
+        if (tokens[0] == "enum") {
+            if (tokens.size() != 2) return fail("Expected enum <Name>");
+            schema.enums.push_back({tokens[1], {}});
+            current_enum = &schema.enums.back();
+            continue;
+        }
+        if ((tokens[0] != "request") && (tokens[0] != "response")) {
+            return fail("Expected enum, request or response");
+        }
+        if (tokens.size() < 2) return fail("Expected a command");
+
+        Packet packet;
+        packet.is_request = (tokens[0] == "request");
+        packet.command = tokens[1];
+        const auto* commands = schema.find_enum("Command");
+        if (commands == nullptr) return fail("Command enum must be defined before packets");
+        auto it = std::find_if(commands->values.begin(), commands->values.end(), [&packet](const auto& v) {
+            return v.name == packet.command;
+        });
+        if (it == commands->values.end()) return fail("Unknown command");
+        packet.value = it->value;
+
+        size_t i = 2;
+        for (; i < tokens.size(); i++) {
+            const auto& token = tokens[i];
+            const size_t separator = token.find('=');
+            if (separator == std::string::npos) break;
+            if (!packet.fields.empty() && (packet.fields.back().type == FieldType::BYTES)) {
+                return fail("bytes must be the last field");
+            }
+            Field field;
+            const std::string type = token.substr(0, separator);
+            field.name = token.substr(separator+1);
+            if (type == "u8")           field.type = FieldType::U8;
+            else if (type == "u16")     field.type = FieldType::U16;
+            else if (type == "u32")     field.type = FieldType::U32;
+            else if (type == "list")    field.type = FieldType::LIST;
+            else if (type == "bytes")   field.type = FieldType::BYTES;
+            else if (schema.find_enum(type) != nullptr) {
+                field.type = FieldType::ENUM;
+                field.enum_name = type;
+            } else {
+                return fail("Unknown field type");
+            }
+            packet.fields.push_back(field);
+        }
+        for (; i < tokens.size(); i++) {
+            if (!packet.description.empty()) packet.description.push_back(' ');
+            packet.description.append(tokens[i]);
+        }
+        for (const auto& other: schema.packets) {
+            if ((other.is_request == packet.is_request) && (other.command == packet.command)) {
+                return fail("Packet is defined twice");
+            }
+        }
+        schema.packets.push_back(std::move(packet));
+        current_packet = &schema.packets.back();
+    }
+    return true;
+}
+
+// Fixed size including the command, variable fields add to this
+static size_t get_min_size(const Packet& packet) {
+    size_t size = 1;
+    for (const auto& field: packet.fields) size += get_field_size(field.type);
+    return size;
+}
+
+static bool get_is_fixed_size(const Packet& packet) {
+    return std::none_of(packet.fields.begin(), packet.fields.end(), [](const Field& field) {
+        return (field.type == FieldType::LIST) || (field.type == FieldType::BYTES);
+    });
+}
+
+// Offset expression of each field, constant until the first list
+static std::vector<std::string> get_field_offsets(const Packet& packet) {
+    std::vector<std::string> offsets;
+    std::string dynamic;
+    size_t fixed = 1;
+    for (const auto& field: packet.fields) {
+        std::string at = dynamic.empty() ? std::to_string(fixed) : (dynamic + "+" + std::to_string(fixed));
+        if (!dynamic.empty() && (fixed == 0)) at = dynamic;
+        offsets.push_back(at);
+        if (field.type == FieldType::LIST) {
+            dynamic = at + "+1+buf[" + at + "]";
+            fixed = 0;
+        } else {
+            fixed += get_field_size(field.type);
+        }
+    }
+    return offsets;
+}
+
+static std::string get_cpp_type(const Field& field) {
+    switch (field.type) {
+    case FieldType::U8:     return "uint8_t";
+    case FieldType::U16:    return "uint16_t";
+    case FieldType::U32:    return "uint32_t";
+    case FieldType::ENUM:   return field.enum_name;
+    default:                return "tcb::span<const uint8_t>";
+    }
+}
+
+static std::string get_schema_line(const Packet& packet) {
+    std::string line = to_hex(packet.value);
+    for (const auto& field: packet.fields) {
+        line.append(" ");
+        switch (field.type) {
+        case FieldType::U8:     line.append("u8"); break;
+        case FieldType::U16:    line.append("u16"); break;
+        case FieldType::U32:    line.append("u32"); break;
+        case FieldType::ENUM:   line.append(field.enum_name); break;
+        case FieldType::LIST:   line.append("list"); break;
+        case FieldType::BYTES:  line.append("bytes"); break;
+        }
+        line.append("=" + field.name);
+    }
+    return line;
+}
+
+static std::string generate_cpp(const Schema& schema) {
+    std::ostringstream out;
+    out << "// Generated by src/tools/packet_codegen.cpp from src/controller/packets.schema, do not edit\n";
+    out << "#pragma once\n";
+    out << "#include <stdint.h>\n";
+    out << "#include <stddef.h>\n";
+    out << "#include <array>\n";
+    out << "#include \"utility/span.hpp\"\n";
+    out << "#include \"controller/packet_codec.hpp\"\n\n";
+
+    for (const auto& e: schema.enums) {
+        size_t width = 0;
+        for (const auto& v: e.values) width = std::max(width, v.name.size());
+        out << "enum class " << e.name << ": uint8_t {\n";
+        for (const auto& v: e.values) {
+            out << "    " << v.name << std::string(width - v.name.size() + 1, ' ') << "= " << to_hex(v.value) << ",\n";
+        }
+        out << "};\n\n";
+    }
+
+    // Views read fields in place and write builds the packet into a buffer
+    for (const auto& packet: schema.packets) {
+        const std::string name = to_pascal_case(packet.command) + (packet.is_request ? "Request" : "Response");
+        const size_t min_size = get_min_size(packet);
+        out << "// " << get_schema_line(packet) << "\n";
+        if (!packet.description.empty()) out << "// " << packet.description << "\n";
+        out << "struct " << name << " {\n";
+        out << "    static constexpr Command COMMAND = Command::" << packet.command << ";\n";
+        out << "    static constexpr size_t MIN_SIZE = " << min_size << ";\n";
+        out << "    static constexpr size_t MAX_SIZE = " << (get_is_fixed_size(packet) ? std::to_string(min_size) : "PACKET_UNBOUNDED_SIZE") << ";\n";
+        out << "    tcb::span<const uint8_t> buf;\n";
+
+        const auto offsets = get_field_offsets(packet);
+        for (size_t i = 0; i < packet.fields.size(); i++) {
+            const auto& field = packet.fields[i];
+            const auto& at = offsets[i];
+            out << "    " << get_cpp_type(field) << " get_" << field.name << "() const { ";
+            switch (field.type) {
+            case FieldType::U8:     out << "return buf[" << at << "];"; break;
+            case FieldType::U16:    out << "return read_packet_u16(buf.subspan(" << at << "));"; break;
+            case FieldType::U32:    out << "return read_packet_u32(buf.subspan(" << at << "));"; break;
+            case FieldType::ENUM:   out << "return " << field.enum_name << "(buf[" << at << "]);"; break;
+            case FieldType::LIST:   out << "return buf.subspan(" << at << "+1, buf[" << at << "]);"; break;
+            case FieldType::BYTES:  out << "return buf.subspan(" << at << ");"; break;
+            }
+            out << " }\n";
+        }
+
+        // Lists can claim more bytes than the packet has
+        out << "    bool get_is_valid() const {\n";
+        out << "        if ((buf.size() < MIN_SIZE) || (buf.size() > MAX_SIZE)) return false;\n";
+        // NOTE: Checked one list at a time so each count is read from inside the packet
+        std::string list_size;
+        for (size_t i = 0; i < packet.fields.size(); i++) {
+            if (packet.fields[i].type != FieldType::LIST) continue;
+            list_size += "+buf[" + offsets[i] + "]";
+            const bool is_last_list = std::none_of(packet.fields.begin()+i+1, packet.fields.end(), [](const Field& field) {
+                return field.type == FieldType::LIST;
+            });
+            const bool is_exact = is_last_list && (packet.fields.back().type != FieldType::BYTES);
+            out << "        if (buf.size() " << (is_exact ? "!=" : "<") << " MIN_SIZE" << list_size << ") return false;\n";
+        }
+        out << "        return true;\n";
+        out << "    }\n";
+
+        out << "    static tcb::span<const uint8_t> write(tcb::span<uint8_t> dst";
+        for (const auto& field: packet.fields) {
+            out << ", " << get_cpp_type(field) << " " << field.name;
+        }
+        out << ") {\n";
+        out << "        size_t i = 0;\n";
+        out << "        dst[i++] = uint8_t(COMMAND);\n";
+        for (const auto& field: packet.fields) {
+            switch (field.type) {
+            case FieldType::U8:
+                out << "        dst[i++] = " << field.name << ";\n";
+                break;
+            case FieldType::ENUM:
+                out << "        dst[i++] = uint8_t(" << field.name << ");\n";
+                break;
+            case FieldType::U16:
+                out << "        write_packet_u16(dst.subspan(i), " << field.name << "); i += 2;\n";
+                break;
+            case FieldType::U32:
+                out << "        write_packet_u32(dst.subspan(i), " << field.name << "); i += 4;\n";
+                break;
+            case FieldType::LIST:
+                out << "        dst[i++] = uint8_t(" << field.name << ".size());\n";
+                out << "        i = write_packet_bytes(dst, i, " << field.name << ");\n";
+                break;
+            case FieldType::BYTES:
+                out << "        i = write_packet_bytes(dst, i, " << field.name << ");\n";
+                break;
+            }
+        }
+        out << "        return dst.first(i);\n";
+        out << "    }\n";
+        out << "};\n\n";
+    }
+
+    // Requests are routed to T::on_<command>(<Command>Request) after one length check
+    out << "// Dispatch table for requests indexed by the command byte\n";
+    out << "// NOTE: T must befriend PacketRoutes<T> if its handlers are private\n";
+    out << "template <typename T>\n";
+    out << "struct PacketRoutes {\n";
+    out << "    using Callback = tcb::span<const uint8_t> (*)(T&, tcb::span<const uint8_t>);\n";
+    out << "    struct Route {\n";
+    out << "        Callback callback = nullptr;\n";
+    out << "        size_t min_size = 0;\n";
+    out << "        size_t max_size = 0;\n";
+    out << "    };\n";
+    out << "    static constexpr std::array<Route, 256> create() {\n";
+    out << "        std::array<Route, 256> routes {};\n";
+    for (const auto& packet: schema.packets) {
+        if (!packet.is_request) continue;
+        const std::string name = to_pascal_case(packet.command) + "Request";
+        out << "        routes[" << to_hex(packet.value) << "] = { [](T& handler, tcb::span<const uint8_t> buf) { return handler.on_"
+            << to_snake_case(packet.command) << "(" << name << "{buf}); }, " << name << "::MIN_SIZE, " << name << "::MAX_SIZE };\n";
+    }
+    out << "        return routes;\n";
+    out << "    }\n";
+    out << "    static constexpr std::array<Route, 256> ROUTES = create();\n";
+    out << "};\n";
+    return out.str();
+}
+
+static std::string generate_js(const Schema& schema) {
+    std::ostringstream out;
+    out << "// Generated by src/tools/packet_codegen.cpp from src/controller/packets.schema, do not edit\n\n";
+    for (const auto& e: schema.enums) {
+        size_t width = 0;
+        for (const auto& v: e.values) width = std::max(width, v.name.size());
+        out << "const " << e.name << " = {\n";
+        for (const auto& v: e.values) {
+            out << "    " << v.name << std::string(width - v.name.size() + 1, ' ') << ": " << to_hex(v.value) << ",\n";
+        }
+        out << "};\n\n";
+    }
+
+    // Requests are encoded by the client
+    std::vector<std::string> exports;
+    for (const auto& packet: schema.packets) {
+        if (!packet.is_request) continue;
+        const std::string name = "encode_" + to_snake_case(packet.command);
+        exports.push_back(name);
+        out << "// " << get_schema_line(packet) << "\n";
+        if (!packet.description.empty()) out << "// " << packet.description << "\n";
+        out << "const " << name << " = (";
+        for (size_t i = 0; i < packet.fields.size(); i++) {
+            out << (i > 0 ? ", " : "") << packet.fields[i].name;
+        }
+        out << ") => {\n";
+        out << "    const data = new Uint8Array(" << get_min_size(packet);
+        for (const auto& field: packet.fields) {
+            if ((field.type == FieldType::LIST) || (field.type == FieldType::BYTES)) out << " + " << field.name << ".length";
+        }
+        out << ");\n";
+        out << "    let i = 0;\n";
+        out << "    data[i++] = Command." << packet.command << ";\n";
+        for (const auto& field: packet.fields) {
+            switch (field.type) {
+            case FieldType::U8:
+            case FieldType::ENUM:
+                out << "    data[i++] = " << field.name << ";\n";
+                break;
+            case FieldType::U16:
+                out << "    data[i++] = " << field.name << " & 0xFF;\n";
+                out << "    data[i++] = (" << field.name << " >>> 8) & 0xFF;\n";
+                break;
+            case FieldType::U32:
+                out << "    data[i++] = " << field.name << " & 0xFF;\n";
+                out << "    data[i++] = (" << field.name << " >>> 8) & 0xFF;\n";
+                out << "    data[i++] = (" << field.name << " >>> 16) & 0xFF;\n";
+                out << "    data[i++] = (" << field.name << " >>> 24) & 0xFF;\n";
+                break;
+            case FieldType::LIST:
+                out << "    data[i++] = " << field.name << ".length;\n";
+                out << "    data.set(" << field.name << ", i); i += " << field.name << ".length;\n";
+                break;
+            case FieldType::BYTES:
+                out << "    data.set(" << field.name << ", i); i += " << field.name << ".length;\n";
+                break;
+            }
+        }
+        out << "    return data;\n";
+        out << "};\n\n";
+    }
+
+    // Responses are decoded by the client, null if the length is wrong
+    for (const auto& packet: schema.packets) {
+        if (packet.is_request) continue;
+        const std::string name = "decode_" + to_snake_case(packet.command);
+        exports.push_back(name);
+        const size_t min_size = get_min_size(packet);
+        out << "// " << get_schema_line(packet) << "\n";
+        if (!packet.description.empty()) out << "// " << packet.description << "\n";
+        out << "const " << name << " = (data) => {\n";
+        if (get_is_fixed_size(packet)) {
+            out << "    if (data.length !== " << min_size << " || data[0] !== Command." << packet.command << ") return null;\n";
+        } else {
+            out << "    if (data.length < " << min_size << " || data[0] !== Command." << packet.command << ") return null;\n";
+        }
+        out << "    let i = 1;\n";
+        out << "    const packet = {};\n";
+        for (const auto& field: packet.fields) {
+            switch (field.type) {
+            case FieldType::U8:
+            case FieldType::ENUM:
+                out << "    packet." << field.name << " = data[i++];\n";
+                break;
+            case FieldType::U16:
+                out << "    packet." << field.name << " = data[i] | (data[i+1] << 8); i += 2;\n";
+                break;
+            case FieldType::U32:
+                out << "    packet." << field.name << " = (data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24)) >>> 0; i += 4;\n";
+                break;
+            case FieldType::LIST:
+                out << "    packet." << field.name << " = data.slice(i+1, i+1+data[i]); i += 1+data[i];\n";
+                break;
+            case FieldType::BYTES:
+                out << "    packet." << field.name << " = data.slice(i); i = data.length;\n";
+                break;
+            }
+        }
+        if (!get_is_fixed_size(packet)) {
+            out << "    if (i !== data.length) return null;\n";
+        }
+        out << "    return packet;\n";
+        out << "};\n\n";
+    }
+
+    out << "// Decoders of responses indexed by command\n";
+    out << "const response_decoders = {\n";
+    for (const auto& packet: schema.packets) {
+        if (packet.is_request) continue;
+        out << "    [Command." << packet.command << "]: decode_" << to_snake_case(packet.command) << ",\n";
+    }
+    out << "};\n\n";
+    out << "// Returns null if the response is unknown or malformed\n";
+    out << "const decode_response = (data) => {\n";
+    out << "    if (data.length === 0) return null;\n";
+    out << "    const decoder = response_decoders[data[0]];\n";
+    out << "    return decoder ? decoder(data) : null;\n";
+    out << "};\n\n";
+
+    out << "export {\n";
+    for (const auto& e: schema.enums) out << "    " << e.name << ",\n";
+    for (const auto& name: exports) out << "    " << name << ",\n";
+    out << "    decode_response,\n";
+    out << "};\n";
+    return out.str();
+}
+
+static bool write_if_changed(const char* filepath, const std::string& data) {
+    {
+        std::ifstream file(filepath, std::ios::binary);
+        if (file.is_open()) {
+            std::string prev((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            if (prev == data) return true;
+        }
+    }
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        fprintf(stderr, "Failed to write '%s'\n", filepath);
+        return false;
+    }
+    file << data;
+    return bool(file);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <schema> <output.hpp> <output.js>\n", argv[0]);
+        return 1;
+    }
+    Schema schema;
+    if (!parse_schema(argv[1], schema)) {
+        return 1;
+    }
+    if (!write_if_changed(argv[2], generate_cpp(schema))) {
+        return 1;
+    }
+    if (!write_if_changed(argv[3], generate_js(schema))) {
+        return 1;
+    }
+    return 0;
+}
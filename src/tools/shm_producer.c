@@ -0,0 +1,46 @@
+/* Example producer for the shared memory input ring
+ * Sweeps the X axis of a device at 1kHz
+ * Usage: shm_producer [device_id] [seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "shm/input_ring.h"
+
+static void sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    usleep((useconds_t)ms*1000u);
+#endif
+}
+
+int main(int argc, char** argv) {
+    const uint8_t device_id = (uint8_t)((argc > 1) ? atoi(argv[1]) : 1);
+    const int total_seconds = (argc > 2) ? atoi(argv[2]) : 5;
+    const uint32_t producer_id = 0xC0FFEEu;
+    vjoy_input_ring_handle handle;
+    int i;
+    int total_dropped = 0;
+
+    const int rv = vjoy_input_ring_open(&handle, VJOY_INPUT_RING_DEFAULT_NAME);
+    if (rv != 0) {
+        fprintf(stderr, "Failed to open input ring (%d), is the server running with --shm?\n", rv);
+        vjoy_input_ring_close(&handle);
+        return 1;
+    }
+
+    vjoy_input_ring_acquire_device(handle.ring, producer_id, device_id);
+    vjoy_input_ring_reset(handle.ring, producer_id);
+    for (i = 0; i < total_seconds*1000; i++) {
+        const uint8_t value = (uint8_t)(i % 201);
+        if (!vjoy_input_ring_set_axis(handle.ring, producer_id, 0x00, value)) {
+            total_dropped++;
+        }
+        sleep_ms(1);
+    }
+    vjoy_input_ring_reset(handle.ring, producer_id);
+    printf("Sent %d axis updates, dropped %d\n", i, total_dropped);
+
+    vjoy_input_ring_close(&handle);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "allocation_counter.hpp"
+
+#ifdef COUNT_ALLOCATIONS
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<uint64_t> total_allocations {0};
+static std::atomic<uint64_t> total_frees {0};
+static std::atomic<uint64_t> total_bytes {0};
+
+// NOTE: Replacing the global allocation functions also covers make_unique, std::function and containers
+//       Over aligned allocations use separate functions and aren't counted
+void* operator new(size_t size) {
+    total_allocations.fetch_add(1, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = malloc((size > 0) ? size : 1);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr == nullptr) return;
+    total_frees.fetch_add(1, std::memory_order_relaxed);
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+bool get_is_allocation_counter_enabled() {
+    return true;
+}
+
+AllocationCounts get_allocation_counts() {
+    AllocationCounts counts;
+    counts.total_allocations = total_allocations.load(std::memory_order_relaxed);
+    counts.total_frees = total_frees.load(std::memory_order_relaxed);
+    counts.total_bytes = total_bytes.load(std::memory_order_relaxed);
+    return counts;
+}
+#else
+bool get_is_allocation_counter_enabled() {
+    return false;
+}
+
+AllocationCounts get_allocation_counts() {
+    return {0, 0, 0};
+}
+#endif
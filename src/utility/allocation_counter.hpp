@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Counts every call to the global operator new when built with COUNT_ALLOCATIONS
+// Used to check that connecting and steady state traffic don't allocate, refer to /api/stats and src/tools/allocation_check.cpp
+struct AllocationCounts {
+    uint64_t total_allocations;
+    uint64_t total_frees;
+    uint64_t total_bytes;
+};
+
+bool get_is_allocation_counter_enabled();
+AllocationCounts get_allocation_counts();
@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include <array>
+
+// First in first out ring buffer with a fixed capacity so it never allocates
+template <typename T, size_t N>
+class FixedQueue
+{
+private:
+    std::array<T, N> items;
+    size_t head = 0;
+    size_t count = 0;
+public:
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+    size_t size() const { return count; }
+    T& front() { return items[head]; }
+    T& back() { return items[(head + count - 1) % N]; }
+    // Index from the front
+    T& operator[](size_t i) { return items[(head + i) % N]; }
+    // Returns false if the queue is full
+    bool push_back(const T& item) {
+        if (count == N) return false;
+        items[(head + count) % N] = item;
+        count++;
+        return true;
+    }
+    void pop_front() {
+        head = (head + 1) % N;
+        count--;
+    }
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+};
@@ -0,0 +1,171 @@
+#include "logger.hpp"
+#include "thread_tuning.hpp"
+#include <ctype.h>
+#include <time.h>
+#include <filesystem>
+#include <string>
+
+LogWriter::LogWriter(const LogConfig& _config)
+:   config(_config), file(nullptr), file_size(0), total_dropped(0), is_stopping(false)
+{
+    get_log_registry().set_level(config.level);
+    batch.reserve(LogRing::CAPACITY);
+    if (config.filepath != nullptr) {
+        open_file();
+    }
+    thread = std::thread([this]() { run(); });
+}
+
+LogWriter::~LogWriter() {
+    {
+        auto lock = std::lock_guard(mutex);
+        is_stopping = true;
+    }
+    is_stopping_changed.notify_one();
+    thread.join();
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+// NOTE: Producers never wake us up since that would need a lock, so records wait up to the flush interval
+void LogWriter::run() {
+    if ((config.cpu >= 0) && !pin_current_thread(config.cpu)) {
+        log_warn("Failed to pin the log writer to cpu {}", config.cpu);
+    }
+    auto lock = std::unique_lock(mutex);
+    while (!is_stopping) {
+        is_stopping_changed.wait_for(lock, std::chrono::milliseconds(config.flush_interval_ms));
+        lock.unlock();
+        write_batch();
+        lock.lock();
+    }
+    lock.unlock();
+    write_batch();
+}
+
+void LogWriter::write_batch() {
+    batch.clear();
+    const uint64_t new_total_dropped = get_log_registry().pop_all(batch);
+    if ((new_total_dropped == total_dropped) && batch.empty()) return;
+
+    // Threads are merged by time so lines read in order
+    std::stable_sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) {
+        return a.time_ns < b.time_ns;
+    });
+    buffer.clear();
+    for (const auto& record: batch) {
+        format_record(record);
+    }
+    if (new_total_dropped != total_dropped) {
+        char buf[128];
+        const int N = snprintf(buf, sizeof(buf), "Dropped %llu log records since the rings were full\n",
+            (unsigned long long)(new_total_dropped - total_dropped));
+        buffer.append(buf, size_t(N));
+        total_dropped = new_total_dropped;
+    }
+
+    FILE* dst = (file != nullptr) ? file : stderr;
+    fwrite(buffer.data(), 1, buffer.size(), dst);
+    fflush(dst);
+    if (file != nullptr) {
+        file_size += buffer.size();
+        if (file_size >= config.max_file_size) {
+            rotate_file();
+        }
+    }
+}
+
+// Format: <date> <time> <level> [<session>] <message>
+void LogWriter::format_record(const LogRecord& record) {
+    const time_t seconds = time_t(record.time_ns / 1000000000ull);
+    const unsigned milliseconds = unsigned((record.time_ns / 1000000ull) % 1000ull);
+    struct tm local_time;
+#ifdef _WIN32
+    localtime_s(&local_time, &seconds);
+#else
+    localtime_r(&seconds, &local_time);
+#endif
+    char buf[64];
+    size_t N = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &local_time);
+    buffer.append(buf, N);
+    const size_t level = std::min(size_t(record.level), size_t(LogLevel::TOTAL)-1);
+    N = size_t(snprintf(buf, sizeof(buf), ".%03u %-5s ", milliseconds, log_level_names[level]));
+    buffer.append(buf, N);
+    if (record.session_id != 0) {
+        N = size_t(snprintf(buf, sizeof(buf), "[session %u] ", unsigned(record.session_id)));
+        buffer.append(buf, N);
+    }
+
+    // Each {} takes the next argument
+    const auto format = std::string_view(record.format);
+    size_t arg_index = 0;
+    size_t pos = 0;
+    while (pos < format.size()) {
+        const size_t next = format.find("{}", pos);
+        buffer.append(format.substr(pos, next-pos));
+        if (next == std::string_view::npos) break;
+        pos = next+2;
+        if (arg_index >= record.total_args) continue;
+        const auto& arg = record.args[arg_index];
+        switch (record.types[arg_index]) {
+        case LogArgType::I64: N = size_t(snprintf(buf, sizeof(buf), "%lld", (long long)arg.i64)); break;
+        case LogArgType::U64: N = size_t(snprintf(buf, sizeof(buf), "%llu", (unsigned long long)arg.u64)); break;
+        case LogArgType::F64: N = size_t(snprintf(buf, sizeof(buf), "%g", arg.f64)); break;
+        case LogArgType::TEXT:
+        default:
+            N = 0;
+            buffer.append(record.text + arg.text.offset, arg.text.length);
+            break;
+        }
+        buffer.append(buf, N);
+        arg_index++;
+    }
+    buffer.push_back('\n');
+}
+
+void LogWriter::open_file() {
+    file = fopen(config.filepath, "ab");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open log file '%s', logging to stderr\n", config.filepath);
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    file_size = (size > 0) ? size_t(size) : 0;
+}
+
+// <filepath> becomes <filepath>.1, <filepath>.1 becomes <filepath>.2 and so on
+void LogWriter::rotate_file() {
+    namespace fs = std::filesystem;
+    fclose(file);
+    file = nullptr;
+    const std::string filepath = config.filepath;
+    std::error_code ec;
+    if (config.max_files > 0) {
+        fs::remove(filepath + "." + std::to_string(config.max_files), ec);
+        for (int i = config.max_files-1; i >= 1; i--) {
+            fs::rename(filepath + "." + std::to_string(i), filepath + "." + std::to_string(i+1), ec);
+        }
+        fs::rename(filepath, filepath + ".1", ec);
+    } else {
+        fs::remove(filepath, ec);
+    }
+    open_file();
+}
+
+bool parse_log_level(std::string_view name, LogLevel& level) {
+    for (size_t i = 0; i < size_t(LogLevel::TOTAL); i++) {
+        const auto level_name = std::string_view(log_level_names[i]);
+        if (level_name.size() != name.size()) continue;
+        bool is_match = true;
+        for (size_t j = 0; j < name.size(); j++) {
+            is_match = is_match && (tolower((unsigned char)name[j]) == tolower((unsigned char)level_name[j]));
+        }
+        if (is_match) {
+            level = LogLevel(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,260 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Logging that never blocks or allocates on the event loop
+// Callers copy a fixed size record into a per thread ring and LogWriter formats them on its own thread
+//
+// Example
+// log_info("Websocket connected from {}", address);
+// NOTE: Only the pointer of the format is recorded so it must be a string literal
+// NOTE: ERROR is a macro in wingdi.h
+enum class LogLevel: uint8_t {
+    DEBUG, INFO, WARN, ERR, TOTAL,
+};
+
+constexpr const char* log_level_names[] = {
+    "DEBUG", "INFO", "WARN", "ERROR",
+};
+
+enum class LogArgType: uint8_t {
+    I64, U64, F64, TEXT,
+};
+
+// Arguments are stored by value, text is truncated to fit the record
+struct LogRecord {
+    static constexpr size_t MAX_ARGS = 6;
+    static constexpr size_t TEXT_SIZE = 48;
+    struct TextSlice {
+        uint8_t offset;
+        uint8_t length;
+    };
+    union Arg {
+        int64_t i64;
+        uint64_t u64;
+        double f64;
+        TextSlice text;
+    };
+
+    uint64_t time_ns;
+    const char* format;
+    uint32_t session_id;
+    LogLevel level;
+    uint8_t total_args;
+    uint8_t text_length;
+    LogArgType types[MAX_ARGS];
+    Arg args[MAX_ARGS];
+    char text[TEXT_SIZE];
+
+    template <typename T>
+    void add_arg(const T& value) {
+        if (total_args >= MAX_ARGS) return;
+        auto& arg = args[total_args];
+        auto& type = types[total_args];
+        if constexpr (std::is_floating_point_v<T>) {
+            type = LogArgType::F64;
+            arg.f64 = double(value);
+        } else if constexpr (std::is_enum_v<T>) {
+            type = LogArgType::I64;
+            arg.i64 = int64_t(value);
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            type = LogArgType::I64;
+            arg.i64 = int64_t(value);
+        } else if constexpr (std::is_integral_v<T>) {
+            type = LogArgType::U64;
+            arg.u64 = uint64_t(value);
+        } else {
+            const auto str = std::string_view(value);
+            const size_t length = std::min(str.size(), TEXT_SIZE - size_t(text_length));
+            memcpy(text + text_length, str.data(), length);
+            type = LogArgType::TEXT;
+            arg.text = { text_length, uint8_t(length) };
+            text_length += uint8_t(length);
+        }
+        total_args++;
+    }
+};
+static_assert(sizeof(LogRecord) == 128, "Log records should stay two cache lines");
+
+// Single writer single reader ring, records are dropped instead of waiting when it is full
+class LogRing
+{
+public:
+    static constexpr size_t CAPACITY = 1024;
+    static_assert((CAPACITY & (CAPACITY-1)) == 0, "Ring capacity must be a power of 2");
+private:
+    std::atomic<uint64_t> total_written {0};
+    std::atomic<uint64_t> total_read {0};
+    std::atomic<uint64_t> total_dropped {0};
+    std::array<LogRecord, CAPACITY> records;
+public:
+    void push(const LogRecord& record) {
+        const uint64_t index = total_written.load(std::memory_order_relaxed);
+        if (index - total_read.load(std::memory_order_acquire) >= CAPACITY) {
+            total_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        records[index & (CAPACITY-1)] = record;
+        total_written.store(index+1, std::memory_order_release);
+    }
+
+    // Only called by the writer thread
+    void pop_all(std::vector<LogRecord>& dst) {
+        const uint64_t end = total_written.load(std::memory_order_acquire);
+        uint64_t index = total_read.load(std::memory_order_relaxed);
+        for (; index < end; index++) {
+            dst.push_back(records[index & (CAPACITY-1)]);
+        }
+        total_read.store(index, std::memory_order_release);
+    }
+
+    uint64_t get_total_dropped() const {
+        return total_dropped.load(std::memory_order_relaxed);
+    }
+};
+
+class LogRegistry
+{
+private:
+    std::mutex mutex;
+    // NOTE: Rings outlive their thread so records logged just before a thread exits are still written
+    std::vector<std::unique_ptr<LogRing>> rings;
+    std::atomic<LogLevel> min_level {LogLevel::INFO};
+    std::atomic<uint32_t> total_sessions {0};
+public:
+    LogRing* create_ring() {
+        auto lock = std::lock_guard(mutex);
+        rings.push_back(std::make_unique<LogRing>());
+        return rings.back().get();
+    }
+
+    // Returns the records of every thread and how many were dropped in total
+    uint64_t pop_all(std::vector<LogRecord>& dst) {
+        auto lock = std::lock_guard(mutex);
+        uint64_t total_dropped = 0;
+        for (auto& ring: rings) {
+            ring->pop_all(dst);
+            total_dropped += ring->get_total_dropped();
+        }
+        return total_dropped;
+    }
+
+    bool is_enabled(LogLevel level) const { return level >= min_level.load(std::memory_order_relaxed); }
+    void set_level(LogLevel level) { min_level.store(level, std::memory_order_relaxed); }
+    // Unique across transports so log lines from different servers don't collide
+    uint32_t create_session_id() { return total_sessions.fetch_add(1, std::memory_order_relaxed)+1; }
+};
+
+inline LogRegistry& get_log_registry() {
+    // NOTE: Never destroyed so threads can still log during static destruction
+    static auto* registry = new LogRegistry();
+    return *registry;
+}
+
+// NOTE: Created on the first record of a thread, which is the only time logging allocates
+inline LogRing& get_log_ring() {
+    thread_local LogRing* ring = get_log_registry().create_ring();
+    return *ring;
+}
+
+inline uint32_t& get_log_session_id() {
+    thread_local uint32_t session_id = 0;
+    return session_id;
+}
+
+// Records from this thread are tagged with the session while in scope
+class LogSessionScope
+{
+private:
+    const uint32_t prev_session_id;
+public:
+    LogSessionScope(uint32_t session_id): prev_session_id(get_log_session_id()) {
+        get_log_session_id() = session_id;
+    }
+    ~LogSessionScope() {
+        get_log_session_id() = prev_session_id;
+    }
+};
+
+template <typename... Args>
+void log_write(LogLevel level, const char* format, const Args&... args) {
+    static_assert(sizeof...(Args) <= LogRecord::MAX_ARGS, "Too many log arguments");
+    if (!get_log_registry().is_enabled(level)) return;
+    LogRecord record;
+    record.time_ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    record.format = format;
+    record.session_id = get_log_session_id();
+    record.level = level;
+    record.total_args = 0;
+    record.text_length = 0;
+    (record.add_arg(args), ...);
+    get_log_ring().push(record);
+}
+
+template <typename... Args>
+void log_debug(const char* format, const Args&... args) { log_write(LogLevel::DEBUG, format, args...); }
+template <typename... Args>
+void log_info(const char* format, const Args&... args) { log_write(LogLevel::INFO, format, args...); }
+template <typename... Args>
+void log_warn(const char* format, const Args&... args) { log_write(LogLevel::WARN, format, args...); }
+template <typename... Args>
+void log_error(const char* format, const Args&... args) { log_write(LogLevel::ERR, format, args...); }
+
+struct LogConfig {
+    LogLevel level = LogLevel::INFO;
+    // Written to stderr if null
+    const char* filepath = nullptr;
+    // The file is rotated to <filepath>.1 up to <filepath>.<max_files> once it reaches this size
+    size_t max_file_size = 8*1024*1024;
+    int max_files = 3;
+    int flush_interval_ms = 50;
+    // Core the writer thread is pinned to so it stays off the event loop's core, -1 to not pin
+    int cpu = -1;
+};
+
+// Formats and writes records in batches from a background thread while it exists
+// NOTE: Records still queued are written when it is destroyed
+class LogWriter
+{
+private:
+    const LogConfig config;
+    FILE* file;
+    size_t file_size;
+    uint64_t total_dropped;
+    std::vector<LogRecord> batch;
+    std::string buffer;
+    std::mutex mutex;
+    std::condition_variable is_stopping_changed;
+    bool is_stopping;
+    std::thread thread;
+public:
+    LogWriter(const LogConfig& config);
+    ~LogWriter();
+    LogWriter(const LogWriter&) = delete;
+    LogWriter(LogWriter&&) = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+    LogWriter& operator=(LogWriter&&) = delete;
+private:
+    void run();
+    void write_batch();
+    void format_record(const LogRecord& record);
+    void open_file();
+    void rotate_file();
+};
+
+// Returns false if the name isn't a level
+bool parse_log_level(std::string_view name, LogLevel& level);
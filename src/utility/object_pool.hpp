@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <new>
+#include <string>
+
+struct ObjectPoolStats {
+    size_t capacity = 0;
+    size_t total_active = 0;
+    size_t peak_active = 0;
+    // Allocations that went to the heap because the pool was full
+    uint64_t total_overflows = 0;
+
+    void write_stats(std::string& dst, const char* name) const {
+        char buf[128];
+        const int N = snprintf(buf, sizeof(buf),
+            "\"%s\":{\"capacity\":%zu,\"active\":%zu,\"peak\":%zu,\"overflows\":%llu}",
+            name, capacity, total_active, peak_active, (unsigned long long)total_overflows
+        );
+        dst.append(buf, size_t(N));
+    }
+};
+
+// Fixed capacity storage with a free list for objects that are created on every connection
+// NOTE: A mutex is used since the embedding library can create controllers from the host thread
+template <size_t SIZE, size_t ALIGN, size_t N>
+class ObjectPool
+{
+private:
+    struct alignas(ALIGN) Slot {
+        uint8_t data[SIZE];
+    };
+    std::array<Slot, N> slots;
+    std::array<uint16_t, N> free_list;
+    size_t total_free;
+    ObjectPoolStats stats;
+    std::mutex mutex;
+public:
+    ObjectPool(): total_free(N) {
+        static_assert(N <= UINT16_MAX, "Pool capacity must fit the free list");
+        for (size_t i = 0; i < N; i++) {
+            free_list[i] = uint16_t(N-1-i);
+        }
+        stats.capacity = N;
+    }
+
+    void* allocate(size_t size) {
+        {
+            auto lock = std::lock_guard(mutex);
+            // NOTE: Derived classes can be larger than the slot
+            if ((size <= SIZE) && (total_free > 0)) {
+                const uint16_t index = free_list[--total_free];
+                stats.total_active++;
+                stats.peak_active = std::max(stats.peak_active, stats.total_active);
+                return slots[index].data;
+            }
+            stats.total_overflows++;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* ptr) {
+        auto* slot = static_cast<uint8_t*>(ptr);
+        auto* begin = reinterpret_cast<uint8_t*>(slots.data());
+        auto* end = reinterpret_cast<uint8_t*>(slots.data() + N);
+        if ((slot < begin) || (slot >= end)) {
+            ::operator delete(ptr);
+            return;
+        }
+        auto lock = std::lock_guard(mutex);
+        free_list[total_free++] = uint16_t(size_t(slot - begin) / sizeof(Slot));
+        stats.total_active--;
+    }
+
+    ObjectPoolStats get_stats() {
+        auto lock = std::lock_guard(mutex);
+        return stats;
+    }
+};
+
+// Inherit to allocate T from a pool of N objects so make_unique<T> doesn't touch the heap
+// The pool is shared by every instance of T and falls back to the heap when it is full
+template <typename T, size_t N>
+class Pooled
+{
+public:
+    static void* operator new(size_t size) {
+        return get_pool().allocate(size);
+    }
+    static void operator delete(void* ptr) {
+        get_pool().deallocate(ptr);
+    }
+    static ObjectPoolStats get_pool_stats() {
+        return get_pool().get_stats();
+    }
+private:
+    static auto& get_pool() {
+        // NOTE: Pool is created on first use when T is a complete type
+        //       It is never destroyed so objects can still be freed during static destruction
+        static auto* pool = new ObjectPool<sizeof(T), alignof(T), N>();
+        return *pool;
+    }
+};
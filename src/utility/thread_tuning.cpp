@@ -0,0 +1,48 @@
+#include "thread_tuning.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+bool pin_current_thread(int cpu) {
+    // NOTE: Affinity masks only cover the 64 cores of our processor group
+    if ((cpu < 0) || (cpu >= 64)) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
+bool raise_current_thread_priority(ThreadPriority priority) {
+    // NOTE: The process priority class is left alone since we may be embedded in another program
+    if (priority == ThreadPriority::REALTIME) {
+        if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) return true;
+    }
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST) != 0;
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+bool pin_current_thread(int cpu) {
+    if ((cpu < 0) || (cpu >= CPU_SETSIZE)) return false;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+bool raise_current_thread_priority(ThreadPriority priority) {
+    if (priority == ThreadPriority::REALTIME) {
+        // NOTE: Middle of the range so kernel threads that need to preempt us still can
+        struct sched_param param;
+        param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO))/2;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) return true;
+    }
+    // Nice values are per thread on linux
+    const auto tid = id_t(syscall(SYS_gettid));
+    return setpriority(PRIO_PROCESS, tid, -20) == 0;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+// Scheduling of the calling thread for dedicated machines
+// NOTE: These return false instead of failing when the os or our permissions don't allow it
+
+// Keep the calling thread on one core, cpu starts at 0
+bool pin_current_thread(int cpu);
+
+enum class ThreadPriority {
+    // Highest priority among normal threads
+    HIGH,
+    // Preempts every normal thread, falls back to HIGH if not permitted
+    // NOTE: A thread that never sleeps at this priority starves kernel work on its core
+    REALTIME,
+};
+
+bool raise_current_thread_priority(ThreadPriority priority);
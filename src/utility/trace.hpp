@@ -0,0 +1,172 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timestamps each stage of an input into a per thread ring when built with ENABLE_TRACING
+// The rings are dumped as Chrome trace JSON from /api/trace, open it in ui.perfetto.dev or chrome://tracing
+// Nested spans show where the time went between the websocket message and the reply
+enum class TraceSpanId: uint8_t {
+    WEBSOCKET_MESSAGE,
+    ON_PACKET,
+    CONTROLLER_UPDATE,
+    DEVICE_UPDATE,
+    WEBSOCKET_SEND,
+};
+
+constexpr const char* trace_span_names[] = {
+    "websocket_message",
+    "on_packet",
+    "controller_update",
+    "vjoy_device_update",
+    "websocket_send",
+};
+
+struct TraceEvent {
+    uint64_t begin_ns;
+    uint32_t duration_ns;
+    TraceSpanId id;
+};
+
+// Single writer ring that keeps the most recent events of a thread
+class TraceRing
+{
+public:
+    static constexpr size_t CAPACITY = 16384;
+    static_assert((CAPACITY & (CAPACITY-1)) == 0, "Ring capacity must be a power of 2");
+    const uint32_t thread_id;
+private:
+    std::atomic<uint64_t> total_events {0};
+    std::array<TraceEvent, CAPACITY> events;
+public:
+    TraceRing(uint32_t _thread_id): thread_id(_thread_id) {}
+
+    void push(const TraceEvent& event) {
+        const uint64_t index = total_events.load(std::memory_order_relaxed);
+        events[index & (CAPACITY-1)] = event;
+        total_events.store(index+1, std::memory_order_release);
+    }
+
+    // Copies the events that weren't overwritten while copying, oldest first
+    void copy(std::vector<TraceEvent>& dst) const {
+        const uint64_t end = total_events.load(std::memory_order_acquire);
+        uint64_t begin = (end > CAPACITY) ? end-CAPACITY : 0;
+        const size_t offset = dst.size();
+        for (uint64_t i = begin; i < end; i++) {
+            dst.push_back(events[i & (CAPACITY-1)]);
+        }
+        // NOTE: The writer can lap us while copying, the slot it is writing belongs to index latest-CAPACITY
+        const uint64_t latest = total_events.load(std::memory_order_acquire);
+        const uint64_t first_valid = (latest >= CAPACITY) ? latest-CAPACITY+1 : 0;
+        if (first_valid > begin) {
+            const size_t total_torn = size_t(std::min(first_valid, end) - begin);
+            dst.erase(dst.begin()+offset, dst.begin()+offset+total_torn);
+        }
+    }
+};
+
+class TraceRegistry
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point epoch = Clock::now();
+private:
+    std::mutex mutex;
+    // NOTE: Rings outlive their thread so a dump never reads freed memory
+    std::vector<std::unique_ptr<TraceRing>> rings;
+public:
+    TraceRing* create_ring() {
+        auto lock = std::lock_guard(mutex);
+        rings.push_back(std::make_unique<TraceRing>(uint32_t(rings.size()+1)));
+        return rings.back().get();
+    }
+
+    uint64_t get_elapsed_ns(Clock::time_point time) const {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count());
+    }
+
+    void write_trace(std::string& dst) {
+        std::vector<std::pair<uint32_t, std::vector<TraceEvent>>> snapshots;
+        {
+            auto lock = std::lock_guard(mutex);
+            for (const auto& ring: rings) {
+                snapshots.push_back({ring->thread_id, {}});
+                ring->copy(snapshots.back().second);
+            }
+        }
+
+        char buf[256];
+        bool is_first = true;
+        dst.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (const auto& [thread_id, events]: snapshots) {
+            int N = snprintf(buf, sizeof(buf),
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                is_first ? "" : ",", thread_id, thread_id
+            );
+            dst.append(buf, size_t(N));
+            is_first = false;
+            for (const auto& event: events) {
+                N = snprintf(buf, sizeof(buf),
+                    ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    trace_span_names[size_t(event.id)], thread_id,
+                    double(event.begin_ns)*1e-3, double(event.duration_ns)*1e-3
+                );
+                dst.append(buf, size_t(N));
+            }
+        }
+        dst.append("]}");
+    }
+};
+
+inline TraceRegistry& get_trace_registry() {
+    // NOTE: Never destroyed so threads can still trace during static destruction
+    static auto* registry = new TraceRegistry();
+    return *registry;
+}
+
+inline TraceRing& get_trace_ring() {
+    thread_local TraceRing* ring = get_trace_registry().create_ring();
+    return *ring;
+}
+
+// Records the time between construction and destruction
+class TraceSpan
+{
+private:
+    const TraceSpanId id;
+    const TraceRegistry::Clock::time_point begin;
+public:
+    TraceSpan(TraceSpanId _id): id(_id), begin(TraceRegistry::Clock::now()) {}
+    ~TraceSpan() {
+        const auto end = TraceRegistry::Clock::now();
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        TraceEvent event;
+        event.begin_ns = get_trace_registry().get_elapsed_ns(begin);
+        event.duration_ns = uint32_t(std::min<int64_t>(duration, INT32_MAX));
+        event.id = id;
+        get_trace_ring().push(event);
+    }
+};
+
+constexpr bool get_is_tracing_enabled() {
+#ifdef ENABLE_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#ifdef ENABLE_TRACING
+#define TRACE_SPAN(id) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(id)
+#else
+#define TRACE_SPAN(id) ((void)0)
+#endif
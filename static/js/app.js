@@ -1,18 +1,30 @@
 import { JoyStick } from "./joystick.js";
 import { Button } from "./button.js";
-import { PacketEncoder, Axis } from "./packets.js";
+import { PacketEncoder, PacketDecoder, MacroBuilder, Axis, Command, Status_Acquire } from "./packets.js";
 
 class App {
-    constructor(device_id) {
+    // device_id is null to let the server pick any free device
+    constructor(device_id = null) {
         this.packet_encoder = new PacketEncoder();
+        this.packet_decoder = new PacketDecoder();
 
         this.device_id = device_id;
+        // Device the server gave us, null until acquired
+        this.acquired_device_id = null;
         this.registered_axes = new Set();
         this.registered_buttons = new Set();
 
         this.buttons = [];
         this.joysticks = [];
         this.sliders = [];
+        this.macros = new Map();    // macro_id => MacroBuilder
+        // Timestamp input so the server jitter buffer can smooth it, null if disabled
+        this.playout = null;
+        // Send rate recommended by the server, axis updates are conflated to one per batch window
+        this.flow = { max_rate_hz: null, batch_ms: 0 };
+        this.pending_axes = new Map();  // axis_id => value
+        this.axes_flush_id = null;
+        this.axes_last_flush_ms = 0;
 
         this.ws_url = (`ws://${document.location.host}/websocket`);
         this.ws = null;
@@ -26,8 +38,14 @@ class App {
         // Only let one wakelock toggle occur
         this.wakelock_is_updating = false;
 
+        // Latency estimates from clock sync replies which are also reported to the server
+        this.latency = { rtt_ms: null, one_way_ms: null, clock_offset_us: null };
+        this.clock_samples = [];    // recent { rtt_us, clock_offset_us }
+
         this.on_connection_change = new Set();  // list of ws_state => {} handlers
         this.on_wakelock_change = new Set();    // list of is_wakelock => {} handlers
+        this.on_latency_change = new Set();     // list of latency => {} handlers
+        this.on_device_change = new Set();      // list of device_id => {} handlers
     }
 
     // utility methods
@@ -37,6 +55,54 @@ class App {
         this.ws.send(data);
     }
 
+    send_acquire = () => {
+        if (this.device_id === null) {
+            // NOTE: Resending while acquired just replies with the device we already hold
+            this.send_data(this.packet_encoder.acquire_any());
+        } else {
+            this.send_data(this.packet_encoder.acquire_device(this.device_id));
+        }
+    }
+
+    send_input = (data) => {
+        if (this.playout !== null) {
+            data = this.packet_encoder.timestamped(data);
+        }
+        this.send_data(data);
+    }
+
+    // Pointer events can fire faster than the server wants input so only the latest value of each axis is kept
+    send_axis = (axis_id, value) => {
+        if (this.flow.batch_ms === 0) {
+            this.send_input(this.packet_encoder.set_axis(axis_id, value));
+            return;
+        }
+        this.pending_axes.set(axis_id, value);
+        if (this.axes_flush_id !== null) return;
+        const wait_ms = this.axes_last_flush_ms + this.flow.batch_ms - performance.now();
+        if (wait_ms <= 0) {
+            this.flush_axes();
+            return;
+        }
+        this.axes_flush_id = setTimeout(this.flush_axes, wait_ms);
+    }
+
+    flush_axes = () => {
+        this.axes_flush_id = null;
+        this.axes_last_flush_ms = performance.now();
+        for (const [axis_id, value] of this.pending_axes) {
+            this.send_input(this.packet_encoder.set_axis(axis_id, value));
+        }
+        this.pending_axes.clear();
+    }
+
+    reset_flow = () => {
+        if (this.axes_flush_id !== null) clearTimeout(this.axes_flush_id);
+        this.axes_flush_id = null;
+        this.pending_axes.clear();
+        this.flow = { max_rate_hz: null, batch_ms: 0 };
+    }
+
     convert_axis_value = val => {
         return val+100;
     }
@@ -53,6 +119,48 @@ class App {
         }
     }
 
+    notify_latency = () => {
+        for (let callback of this.on_latency_change) {
+            callback(this.latency);
+        }
+    }
+
+    notify_device = () => {
+        for (let callback of this.on_device_change) {
+            callback(this.acquired_device_id);
+        }
+    }
+
+    on_acquire_reply = (reply) => {
+        const is_acquired = reply.status === Status_Acquire.SUCCESS || reply.status === Status_Acquire.ERROR_DEVICE_ALREADY_ACQUIRED;
+        if (!is_acquired || reply.vjoy_id === this.acquired_device_id) return;
+        this.acquired_device_id = reply.vjoy_id;
+        this.notify_device();
+    }
+
+    // NTP style estimate, refer to CLOCK_SYNC in src/controller/packets.txt
+    on_clock_sync = (sync) => {
+        const rtt_us = ((sync.client_receive_us - sync.client_send_us) >>> 0) - ((sync.server_send_us - sync.server_receive_us) >>> 0);
+        // NOTE: Clocks wrap at 32bits so both offsets are kept close to each other before averaging
+        const offset_a = (sync.server_receive_us - sync.client_send_us) | 0;
+        const offset_b = offset_a + (((sync.server_send_us - sync.client_receive_us) - offset_a) | 0);
+        const clock_offset_us = Math.round((offset_a + offset_b) / 2);
+
+        // Sample with the lowest rtt has the most accurate offset
+        const MAX_SAMPLES = 8;
+        this.clock_samples.push({ rtt_us, clock_offset_us });
+        if (this.clock_samples.length > MAX_SAMPLES) this.clock_samples.shift();
+        const best = this.clock_samples.reduce((a, b) => (b.rtt_us < a.rtt_us) ? b : a);
+
+        this.latency = {
+            rtt_ms: rtt_us / 1000,
+            one_way_ms: best.rtt_us / 2000,
+            clock_offset_us: best.clock_offset_us,
+        };
+        this.send_data(this.packet_encoder.report_latency(rtt_us, best.clock_offset_us >>> 0));
+        this.notify_latency();
+    }
+
     // websocket methods
     close_ws_heartbeat = () => {
         if (this.ws_heartbeat_id === null) return;
@@ -63,15 +171,19 @@ class App {
     open_ws_heartbeat = () => {
         this.close_ws_heartbeat();
         this.ws_heartbeat_id = setInterval(() => {
-            this.send_data(this.packet_encoder.acquire_device(this.device_id));
+            this.send_acquire();
+            this.send_data(this.packet_encoder.clock_sync());
         }, 1000);
     }
 
     open_websocket = () => {
         this.ws = new WebSocket(this.ws_url);
+        this.ws.binaryType = "arraybuffer";
         this.ws.onopen = () => {
-            this.send_data(this.packet_encoder.acquire_device(this.device_id));
+            this.send_acquire();
             this.send_data(this.packet_encoder.reset_device());
+            this.send_playout();
+            this.upload_macros();
             this.force_update();
             this.open_ws_heartbeat();
             this.notify_ws_state(WebSocket.OPEN);
@@ -79,12 +191,29 @@ class App {
         };
 
         this.ws.onmessage = (ev) => { 
-            let message = ev.data;
-            // console.log(message);
+            const data = new Uint8Array(ev.data);
+            const sync = this.packet_decoder.clock_sync(data);
+            if (sync !== null) {
+                this.on_clock_sync(sync);
+                return;
+            }
+            const reply = this.packet_decoder.response(data);
+            if (reply === null) return;
+            if (data[0] === Command.ACQUIRE_ANY || data[0] === Command.ACQUIRE_DEVICE) {
+                this.on_acquire_reply(reply);
+            } else if (data[0] === Command.FLOW_CONTROL) {
+                this.flow = { max_rate_hz: reply.max_rate_hz, batch_ms: reply.batch_ms };
+            }
         };
 
         this.ws.onclose = () => { 
             this.ws = null;
+            this.clock_samples = [];
+            this.reset_flow();
+            if (this.acquired_device_id !== null) {
+                this.acquired_device_id = null;
+                this.notify_device();
+            }
             this.close_ws_heartbeat();
             this.notify_ws_state(WebSocket.CLOSED);
             this.ws_is_updating = false;
@@ -104,8 +233,8 @@ class App {
         joystick.on_change.add(data => {
             let x = this.convert_axis_value(data.x);
             let y = this.convert_axis_value(data.y);
-            this.send_data(this.packet_encoder.set_axis(axis_x, x));
-            this.send_data(this.packet_encoder.set_axis(axis_y, y));
+            this.send_axis(axis_x, x);
+            this.send_axis(axis_y, y);
         });
         this.joysticks.push(joystick);
 
@@ -118,7 +247,7 @@ class App {
     add_slider = (slider, axis_id) => {
         slider.on_change.add(value => {
             let x = this.convert_axis_value(value);
-            this.send_data(this.packet_encoder.set_axis(axis_id, x));
+            this.send_axis(axis_id, x);
         });
         this.sliders.push(slider);
         if (this.registered_axes.has(axis_id)) console.error(`Conflicting axis: ${axis_id}`);
@@ -127,13 +256,42 @@ class App {
 
     add_button = (button, button_id) => {
         button.on_change.add(state => {
-            this.send_data(this.packet_encoder.set_button(button_id, state));
+            this.send_input(this.packet_encoder.set_button(button_id, state));
         });
         this.buttons.push(button);
         if (this.registered_buttons.has(button_id)) console.error(`Conflicting button: ${button_id}`);
         this.registered_buttons.add(button_id);
     }
 
+    // Plays the macro on the server when the button is pressed
+    add_macro_button = (button, macro_id, macro) => {
+        button.on_change.add(state => {
+            if (!state) return;
+            this.send_data(this.packet_encoder.trigger_macro(macro_id));
+        });
+        if (this.macros.has(macro_id)) console.error(`Conflicting macro: ${macro_id}`);
+        this.macros.set(macro_id, macro);
+        this.send_data(this.packet_encoder.upload_macro(macro_id, macro));
+    }
+
+    // Trade a few milliseconds of latency for evenly spaced input on congested wifi
+    enable_jitter_buffer = (min_delay_ms = 0, max_delay_ms = 40) => {
+        this.playout = { min_delay_ms, max_delay_ms };
+        this.send_playout();
+    }
+
+    send_playout = () => {
+        if (this.playout === null) return;
+        const { min_delay_ms, max_delay_ms } = this.playout;
+        this.send_data(this.packet_encoder.set_playout(true, min_delay_ms, max_delay_ms));
+    }
+
+    upload_macros = () => {
+        for (let [macro_id, macro] of this.macros) {
+            this.send_data(this.packet_encoder.upload_macro(macro_id, macro));
+        }
+    }
+
     reset_device = () => {
         if (this.ws === null) {
             this.start();
@@ -202,4 +360,4 @@ class App {
 
 };
 
-export { App, Axis };
\ No newline at end of file
+export { App, MacroBuilder, Axis };
\ No newline at end of file
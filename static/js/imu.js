@@ -0,0 +1,99 @@
+// Streams the phone's gyroscope and accelerometer to the server which fuses them into axes
+// Refer to IMU STREAMING in src/controller/packets.txt for the sample layout
+//
+// Example, tilt steering on the X axis
+// const imu = new ImuStream(app);
+// imu.configure({ roll_axis: Axis.X, range_deg: 30 });
+// button.addEventListener("click", () => imu.start());   // iOS only allows this from a user gesture
+
+const SAMPLE_SIZE = 12;
+const MAX_SAMPLES = 32;
+const AXIS_DISABLED = 0xFF;
+
+const clamp_i16 = (value) => {
+    return Math.max(-32768, Math.min(32767, Math.round(value)));
+};
+
+class ImuStream {
+    constructor(app) {
+        this.app = app;
+        this.config = { roll_axis: AXIS_DISABLED, pitch_axis: AXIS_DISABLED, yaw_axis: AXIS_DISABLED, range_deg: 45, beta: 10 };
+        // Samples are batched so 100-200Hz sensors don't need as many messages
+        this.send_interval_ms = 20;
+        this.samples = new DataView(new ArrayBuffer(SAMPLE_SIZE*MAX_SAMPLES));
+        this.total_samples = 0;
+        this.interval_us = 10000;
+        this.send_timer_id = null;
+        this.is_running = false;
+
+        this.app.on_connection_change.add(state => {
+            if (state === WebSocket.OPEN) this.send_config();
+        });
+    }
+
+    // Axis ids are inputs like Axis.X, range_deg gives full deflection and beta is the filter gain in hundredths
+    configure = (config) => {
+        this.config = { ...this.config, ...config };
+        this.send_config();
+    }
+
+    // Centers the axes on the current attitude
+    recenter = () => {
+        this.send_config();
+    }
+
+    send_config = () => {
+        const c = this.config;
+        this.app.send_data(this.app.packet_encoder.set_imu(c.roll_axis, c.pitch_axis, c.yaw_axis, c.range_deg, c.beta));
+    }
+
+    start = async () => {
+        if (this.is_running) return true;
+        if (typeof DeviceMotionEvent === "undefined") return false;
+        if (typeof DeviceMotionEvent.requestPermission === "function") {
+            const permission = await DeviceMotionEvent.requestPermission();
+            if (permission !== "granted") return false;
+        }
+        window.addEventListener("devicemotion", this.on_motion);
+        this.send_timer_id = setInterval(this.flush, this.send_interval_ms);
+        this.is_running = true;
+        return true;
+    }
+
+    stop = () => {
+        if (!this.is_running) return;
+        window.removeEventListener("devicemotion", this.on_motion);
+        clearInterval(this.send_timer_id);
+        this.send_timer_id = null;
+        this.total_samples = 0;
+        this.is_running = false;
+    }
+
+    // gyro is 0.1 deg/s and accel is mm/s^2 including gravity
+    on_motion = (ev) => {
+        const rate = ev.rotationRate;
+        const accel = ev.accelerationIncludingGravity;
+        if (rate === null || accel === null) return;
+        if (this.total_samples >= MAX_SAMPLES) this.flush();
+        if (ev.interval > 0) this.interval_us = Math.min(50000, Math.max(1000, Math.round(ev.interval*1000)));
+
+        const offset = this.total_samples*SAMPLE_SIZE;
+        const values = [
+            (rate.beta ?? 0)*10, (rate.gamma ?? 0)*10, (rate.alpha ?? 0)*10,
+            (accel.x ?? 0)*1000, (accel.y ?? 0)*1000, (accel.z ?? 0)*1000,
+        ];
+        for (let i = 0; i < values.length; i++) {
+            this.samples.setInt16(offset + i*2, clamp_i16(values[i]), true);
+        }
+        this.total_samples++;
+    }
+
+    flush = () => {
+        if (this.total_samples === 0) return;
+        const samples = new Uint8Array(this.samples.buffer, 0, this.total_samples*SAMPLE_SIZE);
+        this.app.send_input(this.app.packet_encoder.imu_samples(this.interval_us, samples));
+        this.total_samples = 0;
+    }
+};
+
+export { ImuStream, AXIS_DISABLED };
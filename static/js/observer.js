@@ -0,0 +1,99 @@
+// Read only view of the applied state of a device
+// Refer to OBSERVERS in src/controller/packets.txt for the frame layout
+//
+// Example
+// const observer = new Observer(1);
+// observer.on_change.add(state => console.log(state.axes, state.buttons));
+// observer.start();
+
+const Frame = {
+    STATE    : 0x00,
+    RELEASED : 0x01,
+};
+
+const TOTAL_AXES = 16;
+const TOTAL_BUTTON_WORDS = 4;
+
+class Observer {
+    constructor(device_id) {
+        this.device_id = device_id;
+        this.ws_url = (`ws://${document.location.host}/observer`);
+        this.ws = null;
+        this.is_acquired = false;
+        this.axes = new Array(TOTAL_AXES).fill(0);                  // normalised between -1 and +1
+        this.buttons = new Array(TOTAL_BUTTON_WORDS*32).fill(false);
+        this.on_change = new Set();     // list of state => {} handlers
+        // Reconnect after a delay if the connection drops
+        this.reconnect_ms = 1000;
+        this.is_running = false;
+    }
+
+    notify_change = () => {
+        const state = { is_acquired: this.is_acquired, axes: this.axes, buttons: this.buttons };
+        for (let callback of this.on_change) {
+            callback(state);
+        }
+    }
+
+    on_frame = (data) => {
+        if (data.length < 2 || data[1] !== this.device_id) return;
+        if (data[0] === Frame.RELEASED) {
+            this.is_acquired = false;
+            this.notify_change();
+            return;
+        }
+        if (data[0] !== Frame.STATE || data.length < 5) return;
+
+        const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+        const axis_mask = view.getUint16(2, true);
+        const button_mask = view.getUint8(4);
+        let offset = 5;
+        for (let i = 0; i < TOTAL_AXES; i++) {
+            if (!(axis_mask & (1 << i))) continue;
+            this.axes[i] = view.getInt16(offset, true) / 32767;
+            offset += 2;
+        }
+        for (let i = 0; i < TOTAL_BUTTON_WORDS; i++) {
+            if (!(button_mask & (1 << i))) continue;
+            const word = view.getUint32(offset, true);
+            offset += 4;
+            for (let j = 0; j < 32; j++) {
+                this.buttons[i*32 + j] = ((word >>> j) & 1) === 1;
+            }
+        }
+        this.is_acquired = true;
+        this.notify_change();
+    }
+
+    open_websocket = () => {
+        this.ws = new WebSocket(this.ws_url);
+        this.ws.binaryType = "arraybuffer";
+        this.ws.onopen = () => {
+            this.ws.send(new Uint8Array([this.device_id]));
+        };
+        this.ws.onmessage = (ev) => {
+            this.on_frame(new Uint8Array(ev.data));
+        };
+        this.ws.onclose = () => {
+            this.ws = null;
+            if (!this.is_running) return;
+            setTimeout(() => {
+                if (this.is_running && this.ws === null) this.open_websocket();
+            }, this.reconnect_ms);
+        };
+    }
+
+    // public methods
+    start = () => {
+        if (this.is_running) return;
+        this.is_running = true;
+        this.open_websocket();
+    }
+
+    stop = () => {
+        this.is_running = false;
+        if (this.ws !== null) this.ws.close();
+    }
+};
+
+export { Observer };
@@ -1,89 +1,142 @@
 // Encode packets for vjoy controller websocket
-// Refer to the following source files for protocol:
-// - src/controller/packets.txt
-// - src/controller/packets.hpp
-// - src/controller/controller_packet_handler.cpp
-
-const Command = {
-    ACQUIRE_DEVICE  : 0x00,
-    SET_BUTTON      : 0x01,
-    SET_AXIS        : 0x02,
-    RESET           : 0x03,
-    GET_DEV_INFO    : 0x04,
-    INVALID_REQUEST : 0xFF,
-};
+// Layouts and enums come from packets_generated.js which is generated from src/controller/packets.schema
+// Refer to src/controller/packets.txt for how the commands behave
+import * as packets from "./packets_generated.js";
 
-const Axis = {
-    X           : 0x00,
-    Y           : 0x01,
-    Z           : 0x02,
-    RX          : 0x03,
-    RY          : 0x04,
-    RZ          : 0x05,
-    SLIDER      : 0x06,
-    DIAL        : 0x07,
-    WHEEL       : 0x08,
-    ACCELERATOR : 0x09,
-    BRAKE       : 0x0A,
-    CLUTCH      : 0x0B,
-    STEERING    : 0x0C,
-    AILERON     : 0x0D,
-    RUDDER      : 0x0E,
-    THROTTLE    : 0x0F,
-};
+const { Command, Axis, MacroStep, Status_Acquire } = packets;
 
-const Status_Acquire = {
-    SUCCESS                       : 0x00,
-    ERROR_DEVICE_ALREADY_ACQUIRED : 0x01,
-    ERROR_DEVICE_NOT_EXISTS       : 0x02,
-    ERROR_DEVICE_BUSY             : 0x03,
-};
+// Builds the steps of a macro which is played by the server
+// E.g. new MacroBuilder().button(3, true).wait(80).button(3, false)
+class MacroBuilder {
+    constructor() {
+        this.data = [];
+    }
 
-const Status_Button = {
-    SUCCESS              : 0x00,
-    ERROR_INVALID_BUTTON : 0x01,
-    ERROR_INVALID_VALUE  : 0x02,
-};
+    encode_u16 = (value) => {
+        return [value & 0xFF, (value >> 8) & 0xFF];
+    }
 
-const Status_Axis = {
-    SUCCESS             : 0x00,
-    ERROR_INVALID_AXIS  : 0x01,
-    ERROR_INVALID_VALUE : 0x02,
-};
+    button = (button_id, state) => {
+        this.data.push(MacroStep.BUTTON, button_id, state ? 1 : 0);
+        return this;
+    }
+
+    // value is between 0 and 200 with 100 as the center
+    axis = (axis_id, value) => {
+        this.data.push(MacroStep.AXIS, axis_id, value);
+        return this;
+    }
+
+    wait = (duration_ms) => {
+        this.data.push(MacroStep.WAIT, ...this.encode_u16(duration_ms));
+        return this;
+    }
+
+    ramp = (axis_id, start, end, duration_ms) => {
+        this.data.push(MacroStep.RAMP, axis_id, start, end, ...this.encode_u16(duration_ms));
+        return this;
+    }
 
-const Status_Reset = {
-    SUCCESS : 0x00,
+    pulse = (button_id, period_ms, count) => {
+        this.data.push(MacroStep.PULSE, button_id, ...this.encode_u16(period_ms), ...this.encode_u16(count));
+        return this;
+    }
 };
 
-const Status_Error = {
-    INVALID_COMMAND     : 0x00,
-    INCORRECT_LENGTH    : 0x01,
-    EMPTY_REQUEST       : 0x02,
-    API_DISABLED        : 0x03,
-    DEVICE_NOT_ACQUIRED : 0x04,
-    UNKNOWN_ERROR       : 0xFF,
+// Microsecond clock that wraps at 32bits like the server
+const get_time_us = () => {
+    return Math.floor(performance.now()*1000) >>> 0;
 };
 
 class PacketEncoder {
     acquire_device = (device_id) => {
-        return new Uint8Array([Command.ACQUIRE_DEVICE, device_id]);
+        return packets.encode_acquire_device(device_id);
+    }
+
+    // Server picks a free device and replies with its id and device info
+    acquire_any = () => {
+        return packets.encode_acquire_any();
     }
 
     set_button = (button_id, state) => {
-        return new Uint8Array([Command.SET_BUTTON, button_id, state]);
+        return packets.encode_set_button(button_id, state);
     }
 
     set_axis = (axis_id, value) => {
-        return new Uint8Array([Command.SET_AXIS, axis_id, value]);
+        return packets.encode_set_axis(axis_id, value);
     };
 
     reset_device = () => {
-        return new Uint8Array([Command.RESET]);
+        return packets.encode_reset();
     }
 
     get_dev_info = () => {
-        return new Uint8Array([Command.GET_DEV_INFO]);
+        return packets.encode_get_dev_info();
+    }
+
+    upload_macro = (macro_id, macro) => {
+        return packets.encode_upload_macro(macro_id, macro.data);
+    }
+
+    trigger_macro = (macro_id) => {
+        return packets.encode_trigger_macro(macro_id);
+    }
+
+    stop_macro = (macro_id) => {
+        return packets.encode_stop_macro(macro_id);
+    }
+
+    // Wrap a packet with the time it was created so the server can smooth out network jitter
+    timestamped = (packet) => {
+        return packets.encode_timestamped(get_time_us(), packet);
+    }
+
+    set_playout = (is_enabled, min_delay_ms, max_delay_ms) => {
+        return packets.encode_set_playout(is_enabled ? 1 : 0, min_delay_ms, max_delay_ms);
+    }
+
+    clock_sync = () => {
+        return packets.encode_clock_sync(get_time_us());
+    }
+
+    report_latency = (rtt_us, clock_offset_us) => {
+        return packets.encode_report_latency(rtt_us, clock_offset_us);
+    }
+
+    // All values except smoothing_ms are percentages
+    set_axis_curve = (axis_id, deadzone, saturation, expo, s_curve, smoothing_ms) => {
+        return packets.encode_set_axis_curve(axis_id, deadzone, saturation, expo, s_curve, smoothing_ms);
+    }
+
+    // Packed gyroscope and accelerometer samples, refer to ImuStream in imu.js
+    imu_samples = (interval_us, samples) => {
+        return packets.encode_imu_samples(interval_us, samples);
+    }
+
+    // Axis ids are 0xFF to leave that angle unmapped, beta is in hundredths
+    set_imu = (roll_axis, pitch_axis, yaw_axis, range_deg, beta) => {
+        return packets.encode_set_imu(roll_axis, pitch_axis, yaw_axis, range_deg, beta);
+    }
+
+    // Empty name selects the default profile of the device
+    select_profile = (name) => {
+        return packets.encode_select_profile(new TextEncoder().encode(name));
+    }
+};
+
+class PacketDecoder {
+    // Returns null if the packet isn't a clock sync reply
+    clock_sync = (data) => {
+        const reply = packets.decode_clock_sync(data);
+        if (reply === null) return null;
+        reply.client_receive_us = get_time_us();
+        return reply;
+    }
+
+    // Returns the fields of any response, or null if it is unknown or malformed
+    response = (data) => {
+        return packets.decode_response(data);
     }
 };
 
-export { PacketEncoder, Axis };
\ No newline at end of file
+export { PacketEncoder, PacketDecoder, MacroBuilder, Axis, Command, Status_Acquire };
@@ -0,0 +1,602 @@
+// Generated by src/tools/packet_codegen.cpp from src/controller/packets.schema, do not edit
+
+const Command = {
+    ACQUIRE_DEVICE  : 0x00,
+    SET_BUTTON      : 0x01,
+    SET_AXIS        : 0x02,
+    RESET           : 0x03,
+    GET_DEV_INFO    : 0x04,
+    UPLOAD_MACRO    : 0x05,
+    TRIGGER_MACRO   : 0x06,
+    STOP_MACRO      : 0x07,
+    TIMESTAMPED     : 0x08,
+    SET_PLAYOUT     : 0x09,
+    CLOCK_SYNC      : 0x0A,
+    REPORT_LATENCY  : 0x0B,
+    SELECT_PROFILE  : 0x0C,
+    SET_AXIS_CURVE  : 0x0D,
+    ACQUIRE_ANY     : 0x0E,
+    IMU_SAMPLES     : 0x0F,
+    SET_IMU         : 0x10,
+    FLOW_CONTROL    : 0x11,
+    INVALID_REQUEST : 0xFF,
+};
+
+const Axis = {
+    X           : 0x00,
+    Y           : 0x01,
+    Z           : 0x02,
+    RX          : 0x03,
+    RY          : 0x04,
+    RZ          : 0x05,
+    SLIDER      : 0x06,
+    DIAL        : 0x07,
+    WHEEL       : 0x08,
+    ACCELERATOR : 0x09,
+    BRAKE       : 0x0A,
+    CLUTCH      : 0x0B,
+    STEERING    : 0x0C,
+    AILERON     : 0x0D,
+    RUDDER      : 0x0E,
+    THROTTLE    : 0x0F,
+};
+
+const Status_Acquire = {
+    SUCCESS                       : 0x00,
+    ERROR_DEVICE_ALREADY_ACQUIRED : 0x01,
+    ERROR_DEVICE_NOT_EXISTS       : 0x02,
+    ERROR_DEVICE_BUSY             : 0x03,
+    ERROR_NO_FREE_DEVICES         : 0x04,
+};
+
+const Status_Button = {
+    SUCCESS              : 0x00,
+    ERROR_INVALID_BUTTON : 0x01,
+    ERROR_INVALID_VALUE  : 0x02,
+};
+
+const Status_Axis = {
+    SUCCESS             : 0x00,
+    ERROR_INVALID_AXIS  : 0x01,
+    ERROR_INVALID_VALUE : 0x02,
+};
+
+const Status_Reset = {
+    SUCCESS : 0x00,
+};
+
+const MacroStep = {
+    BUTTON : 0x00,
+    AXIS   : 0x01,
+    WAIT   : 0x02,
+    RAMP   : 0x03,
+    PULSE  : 0x04,
+};
+
+const Status_Macro = {
+    SUCCESS                  : 0x00,
+    ERROR_INVALID_MACRO      : 0x01,
+    ERROR_INVALID_STEP       : 0x02,
+    ERROR_TOO_MANY_STEPS     : 0x03,
+    ERROR_MACRO_NOT_EXISTS   : 0x04,
+    ERROR_SCHEDULER_DISABLED : 0x05,
+};
+
+const Status_Playout = {
+    SUCCESS             : 0x00,
+    ERROR_INVALID_VALUE : 0x01,
+};
+
+const Status_Latency = {
+    SUCCESS : 0x00,
+};
+
+const Status_Profile = {
+    SUCCESS                  : 0x00,
+    ERROR_PROFILE_NOT_EXISTS : 0x01,
+};
+
+const Status_Curve = {
+    SUCCESS             : 0x00,
+    ERROR_INVALID_AXIS  : 0x01,
+    ERROR_INVALID_VALUE : 0x02,
+};
+
+const Status_Imu = {
+    SUCCESS               : 0x00,
+    ERROR_INVALID_AXIS    : 0x01,
+    ERROR_INVALID_VALUE   : 0x02,
+    ERROR_INVALID_SAMPLES : 0x03,
+};
+
+const Status_Error = {
+    INVALID_COMMAND     : 0x00,
+    INCORRECT_LENGTH    : 0x01,
+    EMPTY_REQUEST       : 0x02,
+    API_DISABLED        : 0x03,
+    DEVICE_NOT_ACQUIRED : 0x04,
+    RATE_LIMITED        : 0x05,
+    UNKNOWN_ERROR       : 0xFF,
+};
+
+// 0x00 u8=vjoy_id
+// Acquire the vJoy device with this id
+const encode_acquire_device = (vjoy_id) => {
+    const data = new Uint8Array(2);
+    let i = 0;
+    data[i++] = Command.ACQUIRE_DEVICE;
+    data[i++] = vjoy_id;
+    return data;
+};
+
+// 0x01 u8=button_id u8=state
+// Set button state (0 or 1)
+const encode_set_button = (button_id, state) => {
+    const data = new Uint8Array(3);
+    let i = 0;
+    data[i++] = Command.SET_BUTTON;
+    data[i++] = button_id;
+    data[i++] = state;
+    return data;
+};
+
+// 0x02 u8=axis_id u8=state
+// Set axis state (0 to 200, 100 is center)
+const encode_set_axis = (axis_id, state) => {
+    const data = new Uint8Array(3);
+    let i = 0;
+    data[i++] = Command.SET_AXIS;
+    data[i++] = axis_id;
+    data[i++] = state;
+    return data;
+};
+
+// 0x03
+// Reset everything
+const encode_reset = () => {
+    const data = new Uint8Array(1);
+    let i = 0;
+    data[i++] = Command.RESET;
+    return data;
+};
+
+// 0x04
+// Get device info
+const encode_get_dev_info = () => {
+    const data = new Uint8Array(1);
+    let i = 0;
+    data[i++] = Command.GET_DEV_INFO;
+    return data;
+};
+
+// 0x05 u8=macro_id bytes=steps
+// Upload macro (0 to 31, replaces existing)
+const encode_upload_macro = (macro_id, steps) => {
+    const data = new Uint8Array(2 + steps.length);
+    let i = 0;
+    data[i++] = Command.UPLOAD_MACRO;
+    data[i++] = macro_id;
+    data.set(steps, i); i += steps.length;
+    return data;
+};
+
+// 0x06 u8=macro_id
+// Trigger macro (restarts if playing)
+const encode_trigger_macro = (macro_id) => {
+    const data = new Uint8Array(2);
+    let i = 0;
+    data[i++] = Command.TRIGGER_MACRO;
+    data[i++] = macro_id;
+    return data;
+};
+
+// 0x07 u8=macro_id
+// Stop macro
+const encode_stop_macro = (macro_id) => {
+    const data = new Uint8Array(2);
+    let i = 0;
+    data[i++] = Command.STOP_MACRO;
+    data[i++] = macro_id;
+    return data;
+};
+
+// 0x08 u32=client_time_us bytes=packet
+// Apply packet through the jitter buffer
+const encode_timestamped = (client_time_us, packet) => {
+    const data = new Uint8Array(5 + packet.length);
+    let i = 0;
+    data[i++] = Command.TIMESTAMPED;
+    data[i++] = client_time_us & 0xFF;
+    data[i++] = (client_time_us >>> 8) & 0xFF;
+    data[i++] = (client_time_us >>> 16) & 0xFF;
+    data[i++] = (client_time_us >>> 24) & 0xFF;
+    data.set(packet, i); i += packet.length;
+    return data;
+};
+
+// 0x09 u8=is_enabled u16=min_delay_ms u16=max_delay_ms
+// Configure jitter buffer (default: enabled, 0 to 40ms)
+const encode_set_playout = (is_enabled, min_delay_ms, max_delay_ms) => {
+    const data = new Uint8Array(6);
+    let i = 0;
+    data[i++] = Command.SET_PLAYOUT;
+    data[i++] = is_enabled;
+    data[i++] = min_delay_ms & 0xFF;
+    data[i++] = (min_delay_ms >>> 8) & 0xFF;
+    data[i++] = max_delay_ms & 0xFF;
+    data[i++] = (max_delay_ms >>> 8) & 0xFF;
+    return data;
+};
+
+// 0x0A u32=client_send_us
+// Clock sync request
+const encode_clock_sync = (client_send_us) => {
+    const data = new Uint8Array(5);
+    let i = 0;
+    data[i++] = Command.CLOCK_SYNC;
+    data[i++] = client_send_us & 0xFF;
+    data[i++] = (client_send_us >>> 8) & 0xFF;
+    data[i++] = (client_send_us >>> 16) & 0xFF;
+    data[i++] = (client_send_us >>> 24) & 0xFF;
+    return data;
+};
+
+// 0x0B u32=rtt_us u32=clock_offset_us
+// Report latency estimate to server
+const encode_report_latency = (rtt_us, clock_offset_us) => {
+    const data = new Uint8Array(9);
+    let i = 0;
+    data[i++] = Command.REPORT_LATENCY;
+    data[i++] = rtt_us & 0xFF;
+    data[i++] = (rtt_us >>> 8) & 0xFF;
+    data[i++] = (rtt_us >>> 16) & 0xFF;
+    data[i++] = (rtt_us >>> 24) & 0xFF;
+    data[i++] = clock_offset_us & 0xFF;
+    data[i++] = (clock_offset_us >>> 8) & 0xFF;
+    data[i++] = (clock_offset_us >>> 16) & 0xFF;
+    data[i++] = (clock_offset_us >>> 24) & 0xFF;
+    return data;
+};
+
+// 0x0C bytes=name
+// Select remapping profile (empty for device default)
+const encode_select_profile = (name) => {
+    const data = new Uint8Array(1 + name.length);
+    let i = 0;
+    data[i++] = Command.SELECT_PROFILE;
+    data.set(name, i); i += name.length;
+    return data;
+};
+
+// 0x0D u8=axis_id u8=deadzone u8=saturation u8=expo u8=s_curve u16=smoothing_ms
+// Set axis response curve (percentages, refer to AXIS CURVES)
+const encode_set_axis_curve = (axis_id, deadzone, saturation, expo, s_curve, smoothing_ms) => {
+    const data = new Uint8Array(8);
+    let i = 0;
+    data[i++] = Command.SET_AXIS_CURVE;
+    data[i++] = axis_id;
+    data[i++] = deadzone;
+    data[i++] = saturation;
+    data[i++] = expo;
+    data[i++] = s_curve;
+    data[i++] = smoothing_ms & 0xFF;
+    data[i++] = (smoothing_ms >>> 8) & 0xFF;
+    return data;
+};
+
+// 0x0E
+// Acquire any free vJoy device
+const encode_acquire_any = () => {
+    const data = new Uint8Array(1);
+    let i = 0;
+    data[i++] = Command.ACQUIRE_ANY;
+    return data;
+};
+
+// 0x0F u16=interval_us bytes=samples
+// Fuse gyroscope and accelerometer samples (refer to IMU STREAMING)
+const encode_imu_samples = (interval_us, samples) => {
+    const data = new Uint8Array(3 + samples.length);
+    let i = 0;
+    data[i++] = Command.IMU_SAMPLES;
+    data[i++] = interval_us & 0xFF;
+    data[i++] = (interval_us >>> 8) & 0xFF;
+    data.set(samples, i); i += samples.length;
+    return data;
+};
+
+// 0x10 u8=roll_axis u8=pitch_axis u8=yaw_axis u8=range_deg u8=beta
+// Map fused attitude onto axes and recenter it (refer to IMU STREAMING)
+const encode_set_imu = (roll_axis, pitch_axis, yaw_axis, range_deg, beta) => {
+    const data = new Uint8Array(6);
+    let i = 0;
+    data[i++] = Command.SET_IMU;
+    data[i++] = roll_axis;
+    data[i++] = pitch_axis;
+    data[i++] = yaw_axis;
+    data[i++] = range_deg;
+    data[i++] = beta;
+    return data;
+};
+
+// 0x00 Status_Acquire=status u8=vjoy_id
+// Was device acquired?
+const decode_acquire_device = (data) => {
+    if (data.length !== 3 || data[0] !== Command.ACQUIRE_DEVICE) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.vjoy_id = data[i++];
+    return packet;
+};
+
+// 0x01 Status_Button=status u8=button_id
+// Was button update success?
+const decode_set_button = (data) => {
+    if (data.length !== 3 || data[0] !== Command.SET_BUTTON) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.button_id = data[i++];
+    return packet;
+};
+
+// 0x02 Status_Axis=status u8=axis_id
+// Was axis update success?
+const decode_set_axis = (data) => {
+    if (data.length !== 3 || data[0] !== Command.SET_AXIS) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.axis_id = data[i++];
+    return packet;
+};
+
+// 0x03 Status_Reset=status
+// Was reset success?
+const decode_reset = (data) => {
+    if (data.length !== 2 || data[0] !== Command.RESET) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// 0x04 list=axes u8=total_buttons u8=total_discrete_povs u8=total_continuous_povs
+// Device information
+const decode_get_dev_info = (data) => {
+    if (data.length < 5 || data[0] !== Command.GET_DEV_INFO) return null;
+    let i = 1;
+    const packet = {};
+    packet.axes = data.slice(i+1, i+1+data[i]); i += 1+data[i];
+    packet.total_buttons = data[i++];
+    packet.total_discrete_povs = data[i++];
+    packet.total_continuous_povs = data[i++];
+    if (i !== data.length) return null;
+    return packet;
+};
+
+// 0x05 Status_Macro=status u8=macro_id
+// Was macro uploaded?
+const decode_upload_macro = (data) => {
+    if (data.length !== 3 || data[0] !== Command.UPLOAD_MACRO) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.macro_id = data[i++];
+    return packet;
+};
+
+// 0x06 Status_Macro=status u8=macro_id
+// Was macro started?
+const decode_trigger_macro = (data) => {
+    if (data.length !== 3 || data[0] !== Command.TRIGGER_MACRO) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.macro_id = data[i++];
+    return packet;
+};
+
+// 0x07 Status_Macro=status u8=macro_id
+// Was macro stopped?
+const decode_stop_macro = (data) => {
+    if (data.length !== 3 || data[0] !== Command.STOP_MACRO) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.macro_id = data[i++];
+    return packet;
+};
+
+// 0x09 Status_Playout=status
+// Was jitter buffer configured?
+const decode_set_playout = (data) => {
+    if (data.length !== 2 || data[0] !== Command.SET_PLAYOUT) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// 0x0A u32=client_send_us u32=server_receive_us u32=server_send_us
+// Clock sync reply
+const decode_clock_sync = (data) => {
+    if (data.length !== 13 || data[0] !== Command.CLOCK_SYNC) return null;
+    let i = 1;
+    const packet = {};
+    packet.client_send_us = (data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24)) >>> 0; i += 4;
+    packet.server_receive_us = (data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24)) >>> 0; i += 4;
+    packet.server_send_us = (data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24)) >>> 0; i += 4;
+    return packet;
+};
+
+// 0x0B Status_Latency=status
+// Was report received?
+const decode_report_latency = (data) => {
+    if (data.length !== 2 || data[0] !== Command.REPORT_LATENCY) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// 0x0C Status_Profile=status
+// Was profile selected?
+const decode_select_profile = (data) => {
+    if (data.length !== 2 || data[0] !== Command.SELECT_PROFILE) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// 0x0D Status_Curve=status u8=axis_id
+// Was axis curve set?
+const decode_set_axis_curve = (data) => {
+    if (data.length !== 3 || data[0] !== Command.SET_AXIS_CURVE) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.axis_id = data[i++];
+    return packet;
+};
+
+// 0x0E Status_Acquire=status u8=vjoy_id u8=total_buttons u8=total_discrete_povs u8=total_continuous_povs list=axes
+// Which device was acquired and its device information
+const decode_acquire_any = (data) => {
+    if (data.length < 7 || data[0] !== Command.ACQUIRE_ANY) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    packet.vjoy_id = data[i++];
+    packet.total_buttons = data[i++];
+    packet.total_discrete_povs = data[i++];
+    packet.total_continuous_povs = data[i++];
+    packet.axes = data.slice(i+1, i+1+data[i]); i += 1+data[i];
+    if (i !== data.length) return null;
+    return packet;
+};
+
+// 0x0F Status_Imu=status
+// Only sent if samples were rejected
+const decode_imu_samples = (data) => {
+    if (data.length !== 2 || data[0] !== Command.IMU_SAMPLES) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// 0x10 Status_Imu=status
+// Was imu mapping set?
+const decode_set_imu = (data) => {
+    if (data.length !== 2 || data[0] !== Command.SET_IMU) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// 0x11 u16=max_rate_hz u16=batch_ms
+// Recommended send rate, pushed by the server (refer to FLOW CONTROL)
+const decode_flow_control = (data) => {
+    if (data.length !== 5 || data[0] !== Command.FLOW_CONTROL) return null;
+    let i = 1;
+    const packet = {};
+    packet.max_rate_hz = data[i] | (data[i+1] << 8); i += 2;
+    packet.batch_ms = data[i] | (data[i+1] << 8); i += 2;
+    return packet;
+};
+
+// 0xFF Status_Error=status
+// Invalid request
+const decode_invalid_request = (data) => {
+    if (data.length !== 2 || data[0] !== Command.INVALID_REQUEST) return null;
+    let i = 1;
+    const packet = {};
+    packet.status = data[i++];
+    return packet;
+};
+
+// Decoders of responses indexed by command
+const response_decoders = {
+    [Command.ACQUIRE_DEVICE]: decode_acquire_device,
+    [Command.SET_BUTTON]: decode_set_button,
+    [Command.SET_AXIS]: decode_set_axis,
+    [Command.RESET]: decode_reset,
+    [Command.GET_DEV_INFO]: decode_get_dev_info,
+    [Command.UPLOAD_MACRO]: decode_upload_macro,
+    [Command.TRIGGER_MACRO]: decode_trigger_macro,
+    [Command.STOP_MACRO]: decode_stop_macro,
+    [Command.SET_PLAYOUT]: decode_set_playout,
+    [Command.CLOCK_SYNC]: decode_clock_sync,
+    [Command.REPORT_LATENCY]: decode_report_latency,
+    [Command.SELECT_PROFILE]: decode_select_profile,
+    [Command.SET_AXIS_CURVE]: decode_set_axis_curve,
+    [Command.ACQUIRE_ANY]: decode_acquire_any,
+    [Command.IMU_SAMPLES]: decode_imu_samples,
+    [Command.SET_IMU]: decode_set_imu,
+    [Command.FLOW_CONTROL]: decode_flow_control,
+    [Command.INVALID_REQUEST]: decode_invalid_request,
+};
+
+// Returns null if the response is unknown or malformed
+const decode_response = (data) => {
+    if (data.length === 0) return null;
+    const decoder = response_decoders[data[0]];
+    return decoder ? decoder(data) : null;
+};
+
+export {
+    Command,
+    Axis,
+    Status_Acquire,
+    Status_Button,
+    Status_Axis,
+    Status_Reset,
+    MacroStep,
+    Status_Macro,
+    Status_Playout,
+    Status_Latency,
+    Status_Profile,
+    Status_Curve,
+    Status_Imu,
+    Status_Error,
+    encode_acquire_device,
+    encode_set_button,
+    encode_set_axis,
+    encode_reset,
+    encode_get_dev_info,
+    encode_upload_macro,
+    encode_trigger_macro,
+    encode_stop_macro,
+    encode_timestamped,
+    encode_set_playout,
+    encode_clock_sync,
+    encode_report_latency,
+    encode_select_profile,
+    encode_set_axis_curve,
+    encode_acquire_any,
+    encode_imu_samples,
+    encode_set_imu,
+    decode_acquire_device,
+    decode_set_button,
+    decode_set_axis,
+    decode_reset,
+    decode_get_dev_info,
+    decode_upload_macro,
+    decode_trigger_macro,
+    decode_stop_macro,
+    decode_set_playout,
+    decode_clock_sync,
+    decode_report_latency,
+    decode_select_profile,
+    decode_set_axis_curve,
+    decode_acquire_any,
+    decode_imu_samples,
+    decode_set_imu,
+    decode_flow_control,
+    decode_invalid_request,
+    decode_response,
+};